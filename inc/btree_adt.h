@@ -0,0 +1,479 @@
+#pragma once
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <limits>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace adt {
+
+template <class T, std::size_t kNodeKeys = 32>
+// BTreeAdt - B+ tree with the insert/find/CountByRange interface of Adt.
+// Every node holds up to kNodeKeys sorted keys, so a lookup touches about
+// log(N)/log(kNodeKeys) nodes instead of log2(N). Keys live in leaves linked
+// in both directions; inner nodes keep separators and subtree counts of their
+// children, which makes rank and CountByRange O(log N). In-node search counts
+// keys with SSE2 compares for 32-bit integers.
+class BTreeAdt {
+  static_assert(kNodeKeys >= 4 && kNodeKeys % 4 == 0,
+                "node size must be a multiple of 4 keys");
+  // fanout is at least kNodeKeys / 2, depth never reaches this for size_t
+  static constexpr std::size_t kMaxDepth = 48;
+  static constexpr bool kSimd =
+#if defined(__SSE2__)
+      std::is_integral_v<T> && std::is_signed_v<T> && sizeof(T) == 4;
+#else
+      false;
+#endif
+
+  struct Node {
+    std::size_t n_ = 0; // keys in leaf, children in inner node
+    bool leaf_;
+    explicit Node(bool leaf) : leaf_(leaf) {}
+  };
+
+  // Unused key slots hold Pad() so that SIMD search may scan whole blocks.
+  struct Leaf : Node {
+    T keys_[kNodeKeys];
+    Leaf *prev_ = nullptr;
+    Leaf *next_ = nullptr;
+    Leaf() : Node(true) { std::fill(keys_, keys_ + kNodeKeys, Pad()); }
+  };
+
+  // keys_[i] is the smallest key of child_[i + 1]
+  struct Inner : Node {
+    T keys_[kNodeKeys];
+    Node *child_[kNodeKeys];
+    std::size_t count_[kNodeKeys]; // items in subtree of child_[i]
+    Inner() : Node(false) { std::fill(keys_, keys_ + kNodeKeys, Pad()); }
+  };
+
+public:
+  class Iterator {
+    const BTreeAdt *ptr_ = nullptr;
+    const Leaf *leaf_ = nullptr; // nullptr - end()
+    std::size_t pos_ = 0;
+
+    Iterator(const BTreeAdt *p, const Leaf *leaf, std::size_t pos)
+        : ptr_(p), leaf_(leaf), pos_(pos) {}
+
+  public:
+    using iterator_category = std::bidirectional_iterator_tag;
+    using value_type = T;
+    using difference_type = std::ptrdiff_t;
+    using pointer = const T *;
+    using reference = const T &;
+
+    friend class BTreeAdt;
+
+    Iterator() = default;
+
+    reference operator*() const { return leaf_->keys_[pos_]; }
+    pointer operator->() const { return &leaf_->keys_[pos_]; }
+
+    bool operator==(const Iterator &rhs) const {
+      return ptr_ == rhs.ptr_ && leaf_ == rhs.leaf_ && pos_ == rhs.pos_;
+    }
+
+    Iterator &operator++() {
+      if (leaf_ != nullptr && ++pos_ == leaf_->n_) {
+        leaf_ = leaf_->next_;
+        pos_ = 0;
+      }
+      return *this;
+    }
+    Iterator operator++(int) {
+      Iterator retval = *this;
+      ++(*this);
+      return retval;
+    }
+    Iterator &operator--() {
+      if (leaf_ == nullptr) {
+        leaf_ = ptr_->tail_;
+        pos_ = leaf_ == nullptr ? 0 : leaf_->n_ - 1;
+      } else if (pos_ == 0) {
+        leaf_ = leaf_->prev_;
+        pos_ = leaf_ == nullptr ? 0 : leaf_->n_ - 1;
+      } else {
+        --pos_;
+      }
+      return *this;
+    }
+    Iterator operator--(int) {
+      Iterator retval = *this;
+      --(*this);
+      return retval;
+    }
+  };
+
+  using iterator = Iterator;
+  using InsertResult = std::pair<iterator, bool>;
+
+  BTreeAdt() = default;
+  BTreeAdt(const BTreeAdt &) = delete;
+  BTreeAdt &operator=(const BTreeAdt &) = delete;
+  ~BTreeAdt() { Clear(); }
+
+  std::size_t size() const { return size_; }
+  // number of node levels, 0 for empty tree
+  std::size_t height() const { return height_; }
+  // bytes used by nodes
+  std::size_t MemoryBytes() const {
+    return leaves_ * sizeof(Leaf) + inners_ * sizeof(Inner);
+  }
+  // Inserts element into the container, if the container doesn't already
+  // contain an element with an equivalent key.
+  InsertResult insert(const T &t);
+  // find element equal key, if not found = return end()
+  Iterator find(const T &key) const;
+  // find first element not less than v
+  Iterator lower_bound(const T &v) const { return Bound<false>(v); }
+  // find first element greater than v
+  Iterator upper_bound(const T &v) const { return Bound<true>(v); }
+  // number of elements less than v
+  std::size_t rank(const T &v) const { return Rank<false>(v); }
+  // count items in range
+  int CountByRange(const T &first, const T &second) const;
+  // clear tree
+  void Clear();
+
+  Iterator begin() const { return Iterator(this, head_, 0); }
+  Iterator end() const { return Iterator(this, nullptr, 0); }
+
+private:
+  Node *root_ = nullptr;
+  Leaf *head_ = nullptr; // leftmost leaf
+  Leaf *tail_ = nullptr; // rightmost leaf
+  std::size_t size_ = 0;
+  std::size_t height_ = 0;
+  std::size_t leaves_ = 0;
+  std::size_t inners_ = 0;
+
+  static T Pad() {
+    if constexpr (std::numeric_limits<T>::is_specialized) {
+      return std::numeric_limits<T>::max();
+    } else {
+      return T{};
+    }
+  }
+  // number of keys[0..n) less than v (kInclusive - not greater than v)
+  template <bool kInclusive>
+  static std::size_t CountKeys(const T *keys, std::size_t n, const T &v);
+  // child of inner node to descend for v
+  static std::size_t ChildIndex(const Inner *p, const T &v) {
+    return CountKeys<true>(p->keys_, p->n_ - 1, v);
+  }
+  template <bool kInclusive> Iterator Bound(const T &v) const;
+  template <bool kInclusive> std::size_t Rank(const T &v) const;
+  // move upper half of full leaf to the new right sibling
+  Leaf *SplitLeaf(Leaf *leaf);
+  // put child after slot of full inner node, return the new right sibling
+  // and separator moved up in sep
+  Inner *SplitInner(Inner *p, std::size_t slot, const T &key, Node *child,
+                    T &sep);
+  static void InsertChild(Inner *p, std::size_t slot, const T &key,
+                          Node *child);
+  static std::size_t Count(const Node *p);
+  void Destroy(Node *p);
+};
+
+template <class T, std::size_t kNodeKeys>
+template <bool kInclusive>
+std::size_t BTreeAdt<T, kNodeKeys>::CountKeys(const T *keys, std::size_t n,
+                                              const T &v) {
+#if defined(__SSE2__)
+  if constexpr (kSimd) {
+    // Slots past n hold Pad(), the maximum: they are never less than v, and
+    // are not greater than v only for v == Pad(), which min() cuts off.
+    const __m128i x = _mm_set1_epi32(static_cast<int>(v));
+    __m128i sum = _mm_setzero_si128();
+    for (std::size_t i = 0; i < n; i += 4) {
+      __m128i k =
+          _mm_loadu_si128(reinterpret_cast<const __m128i *>(keys + i));
+      // true lanes are -1, so subtraction counts them
+      sum = _mm_sub_epi32(sum, kInclusive ? _mm_cmpgt_epi32(k, x)
+                                          : _mm_cmplt_epi32(k, x));
+    }
+    sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, 0x4e));
+    sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, 0xb1));
+    auto c = static_cast<std::size_t>(_mm_cvtsi128_si32(sum));
+    if constexpr (kInclusive) {
+      std::size_t scanned = (n + 3) & ~std::size_t{3};
+      return std::min(scanned - c, n);
+    } else {
+      return c;
+    }
+  }
+#endif
+  std::size_t c = 0;
+  for (std::size_t i = 0; i < n; ++i) {
+    if constexpr (kInclusive) {
+      c += !(v < keys[i]);
+    } else {
+      c += keys[i] < v;
+    }
+  }
+  return c;
+}
+
+template <class T, std::size_t kNodeKeys>
+std::size_t BTreeAdt<T, kNodeKeys>::Count(const Node *p) {
+  if (p->leaf_) {
+    return p->n_;
+  }
+  const Inner *q = static_cast<const Inner *>(p);
+  std::size_t result = 0;
+  for (std::size_t i = 0; i < q->n_; ++i) {
+    result += q->count_[i];
+  }
+  return result;
+}
+
+template <class T, std::size_t kNodeKeys>
+template <bool kInclusive>
+typename BTreeAdt<T, kNodeKeys>::Iterator
+BTreeAdt<T, kNodeKeys>::Bound(const T &v) const {
+  if (root_ == nullptr) {
+    return end();
+  }
+  const Node *p = root_;
+  while (!p->leaf_) {
+    const Inner *q = static_cast<const Inner *>(p);
+    p = q->child_[ChildIndex(q, v)];
+  }
+  const Leaf *leaf = static_cast<const Leaf *>(p);
+  std::size_t pos = CountKeys<kInclusive>(leaf->keys_, leaf->n_, v);
+  if (pos == leaf->n_) { // bound is the first key of next leaf
+    return Iterator(this, leaf->next_, 0);
+  }
+  return Iterator(this, leaf, pos);
+}
+
+template <class T, std::size_t kNodeKeys>
+template <bool kInclusive>
+std::size_t BTreeAdt<T, kNodeKeys>::Rank(const T &v) const {
+  if (root_ == nullptr) {
+    return 0;
+  }
+  std::size_t result = 0;
+  const Node *p = root_;
+  while (!p->leaf_) {
+    const Inner *q = static_cast<const Inner *>(p);
+    std::size_t slot = ChildIndex(q, v);
+    for (std::size_t i = 0; i < slot; ++i) {
+      result += q->count_[i];
+    }
+    p = q->child_[slot];
+  }
+  const Leaf *leaf = static_cast<const Leaf *>(p);
+  return result + CountKeys<kInclusive>(leaf->keys_, leaf->n_, v);
+}
+
+template <class T, std::size_t kNodeKeys>
+typename BTreeAdt<T, kNodeKeys>::Iterator
+BTreeAdt<T, kNodeKeys>::find(const T &key) const {
+  Iterator it = lower_bound(key);
+  if (it != end() && !(key < *it)) {
+    return it;
+  }
+  return end();
+}
+
+template <class T, std::size_t kNodeKeys>
+int BTreeAdt<T, kNodeKeys>::CountByRange(const T &first,
+                                         const T &second) const {
+  if (second < first) {
+    return 0;
+  }
+  return static_cast<int>(Rank<true>(second) - Rank<false>(first));
+}
+
+template <class T, std::size_t kNodeKeys>
+void BTreeAdt<T, kNodeKeys>::InsertChild(Inner *p, std::size_t slot,
+                                         const T &key, Node *child) {
+  for (std::size_t i = p->n_; i > slot + 1; --i) {
+    p->child_[i] = p->child_[i - 1];
+    p->count_[i] = p->count_[i - 1];
+    p->keys_[i - 1] = p->keys_[i - 2];
+  }
+  p->child_[slot + 1] = child;
+  p->count_[slot + 1] = Count(child);
+  p->keys_[slot] = key;
+  p->count_[slot] = Count(p->child_[slot]);
+  ++p->n_;
+}
+
+template <class T, std::size_t kNodeKeys>
+typename BTreeAdt<T, kNodeKeys>::Leaf *
+BTreeAdt<T, kNodeKeys>::SplitLeaf(Leaf *leaf) {
+  Leaf *right = new Leaf;
+  ++leaves_;
+  std::size_t half = kNodeKeys / 2;
+  for (std::size_t i = half; i < kNodeKeys; ++i) {
+    right->keys_[i - half] = leaf->keys_[i];
+    leaf->keys_[i] = Pad();
+  }
+  leaf->n_ = half;
+  right->n_ = kNodeKeys - half;
+  right->prev_ = leaf;
+  right->next_ = leaf->next_;
+  if (leaf->next_ != nullptr) {
+    leaf->next_->prev_ = right;
+  } else {
+    tail_ = right;
+  }
+  leaf->next_ = right;
+  return right;
+}
+
+template <class T, std::size_t kNodeKeys>
+typename BTreeAdt<T, kNodeKeys>::Inner *
+BTreeAdt<T, kNodeKeys>::SplitInner(Inner *p, std::size_t slot, const T &key,
+                                   Node *child, T &sep) {
+  // Step 1 : build the overfull sequence of kNodeKeys + 1 children
+  const std::size_t total = kNodeKeys + 1;
+  T keys[kNodeKeys];
+  Node *children[total];
+  std::size_t counts[total];
+  for (std::size_t i = 0; i < kNodeKeys; ++i) {
+    children[i + (i > slot)] = p->child_[i];
+    counts[i + (i > slot)] = p->count_[i];
+  }
+  for (std::size_t i = 0; i + 1 < kNodeKeys; ++i) {
+    keys[i + (i >= slot)] = p->keys_[i];
+  }
+  children[slot + 1] = child;
+  counts[slot + 1] = Count(child);
+  counts[slot] = Count(children[slot]);
+  keys[slot] = key;
+  // Step 2 : left half stays in p, keys[half - 1] moves up
+  const std::size_t half = total / 2;
+  Inner *right = new Inner;
+  ++inners_;
+  for (std::size_t i = 0; i < half; ++i) {
+    p->child_[i] = children[i];
+    p->count_[i] = counts[i];
+  }
+  for (std::size_t i = 0; i < kNodeKeys; ++i) {
+    p->keys_[i] = i + 1 < half ? keys[i] : Pad();
+  }
+  p->n_ = half;
+  sep = keys[half - 1];
+  for (std::size_t i = half; i < total; ++i) {
+    right->child_[i - half] = children[i];
+    right->count_[i - half] = counts[i];
+    if (i + 1 < total) {
+      right->keys_[i - half] = keys[i];
+    }
+  }
+  right->n_ = total - half;
+  return right;
+}
+
+template <class T, std::size_t kNodeKeys>
+typename BTreeAdt<T, kNodeKeys>::InsertResult
+BTreeAdt<T, kNodeKeys>::insert(const T &t) {
+  if (root_ == nullptr) {
+    head_ = tail_ = new Leaf;
+    ++leaves_;
+    root_ = head_;
+    height_ = 1;
+  }
+  // Step 1 : descend, remember inner nodes and child slots
+  Inner *path[kMaxDepth];
+  std::size_t slots[kMaxDepth];
+  std::size_t depth = 0;
+  Node *p = root_;
+  while (!p->leaf_) {
+    Inner *q = static_cast<Inner *>(p);
+    path[depth] = q;
+    slots[depth] = ChildIndex(q, t);
+    p = q->child_[slots[depth]];
+    ++depth;
+  }
+  Leaf *leaf = static_cast<Leaf *>(p);
+  std::size_t pos = CountKeys<false>(leaf->keys_, leaf->n_, t);
+  if (pos < leaf->n_ && !(t < leaf->keys_[pos])) {
+    return InsertResult(Iterator(this, leaf, pos), false);
+  }
+  ++size_;
+  for (std::size_t i = 0; i < depth; ++i) {
+    ++path[i]->count_[slots[i]];
+  }
+  // Step 2 : split full leaf, then put key into its half
+  Leaf *right = nullptr;
+  if (leaf->n_ == kNodeKeys) {
+    right = SplitLeaf(leaf);
+    if (pos > leaf->n_) {
+      pos -= leaf->n_;
+      leaf = right;
+    }
+  }
+  for (std::size_t i = leaf->n_; i > pos; --i) {
+    leaf->keys_[i] = leaf->keys_[i - 1];
+  }
+  leaf->keys_[pos] = t;
+  ++leaf->n_;
+  InsertResult result(Iterator(this, leaf, pos), true);
+  if (right == nullptr) {
+    return result;
+  }
+  // Step 3 : carry separators up while parents are full
+  T sep = right->keys_[0];
+  Node *child = right;
+  while (depth > 0) {
+    --depth;
+    Inner *q = path[depth];
+    if (q->n_ < kNodeKeys) {
+      InsertChild(q, slots[depth], sep, child);
+      return result;
+    }
+    T up = sep;
+    child = SplitInner(q, slots[depth], sep, child, up);
+    sep = up;
+  }
+  // Step 4 : root was split, grow the tree
+  Inner *root = new Inner;
+  ++inners_;
+  root->child_[0] = root_;
+  root->count_[0] = Count(root_);
+  root->child_[1] = child;
+  root->count_[1] = Count(child);
+  root->keys_[0] = sep;
+  root->n_ = 2;
+  root_ = root;
+  ++height_;
+  return result;
+}
+
+template <class T, std::size_t kNodeKeys>
+void BTreeAdt<T, kNodeKeys>::Destroy(Node *p) {
+  if (p->leaf_) {
+    delete static_cast<Leaf *>(p);
+    return;
+  }
+  Inner *q = static_cast<Inner *>(p);
+  for (std::size_t i = 0; i < q->n_; ++i) {
+    Destroy(q->child_[i]);
+  }
+  delete q;
+}
+
+template <class T, std::size_t kNodeKeys> void BTreeAdt<T, kNodeKeys>::Clear() {
+  if (root_ != nullptr) {
+    Destroy(root_);
+  }
+  root_ = nullptr;
+  head_ = tail_ = nullptr;
+  size_ = height_ = leaves_ = inners_ = 0;
+}
+
+} // namespace adt
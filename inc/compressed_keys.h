@@ -0,0 +1,322 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <type_traits>
+#include <vector>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace adt {
+
+template <class T>
+// CompressedKeys - immutable compressed store of sorted unique integer keys,
+// e.g. an Adt::GetInorderVector() export of a cold tree. Keys are split into
+// blocks of kBlockKeys. A block keeps its first key in a header and the gaps
+// between neighbours minus one, bit-packed with the width of the largest gap.
+// Gaps are packed in four interleaved lanes, so SSE2 unpacks four of them per
+// step. Dense id sets take a few bits per key.
+class CompressedKeys {
+  static_assert(std::is_integral_v<T> && (sizeof(T) == 4 || sizeof(T) == 8),
+                "CompressedKeys needs 32 or 64-bit integer keys");
+  using Unsigned = std::make_unsigned_t<T>;
+  static constexpr std::size_t kLanes = 4;
+  // width of block stored as raw 64-bit gaps (gap does not fit 32 bits)
+  static constexpr std::uint8_t kRawWidth = 64;
+
+  // Block b holds keys [b * kBlockKeys, (b + 1) * kBlockKeys), so the count
+  // of keys before a block follows from its index.
+  struct Header {
+    T first;              // first key of block
+    std::uint32_t offset; // first word of packed gaps
+    std::uint8_t width;   // bits per gap
+  };
+
+public:
+  static constexpr std::size_t kBlockKeys = 128;
+  using Block = std::array<T, kBlockKeys>;
+
+  // Forward iterator, keeps its block decoded.
+  class Iterator {
+    const CompressedKeys *ptr_ = nullptr;
+    std::size_t block_ = 0;
+    std::size_t pos_ = 0;
+    Block keys_;
+
+    Iterator(const CompressedKeys *p, std::size_t block, std::size_t pos)
+        : ptr_(p), block_(block), pos_(pos) {
+      if (block_ < ptr_->headers_.size()) {
+        ptr_->Decode(block_, keys_.data());
+      }
+    }
+
+  public:
+    using iterator_category = std::forward_iterator_tag;
+    using value_type = T;
+    using difference_type = std::ptrdiff_t;
+    using pointer = const T *;
+    using reference = const T &;
+
+    friend class CompressedKeys;
+
+    Iterator() = default;
+
+    reference operator*() const { return keys_[pos_]; }
+    pointer operator->() const { return &keys_[pos_]; }
+
+    bool operator==(const Iterator &rhs) const {
+      return ptr_ == rhs.ptr_ && block_ == rhs.block_ && pos_ == rhs.pos_;
+    }
+
+    Iterator &operator++() {
+      if (++pos_ == ptr_->BlockSize(block_)) {
+        pos_ = 0;
+        if (++block_ < ptr_->headers_.size()) {
+          ptr_->Decode(block_, keys_.data());
+        }
+      }
+      return *this;
+    }
+    Iterator operator++(int) {
+      Iterator retval = *this;
+      ++(*this);
+      return retval;
+    }
+  };
+
+  using iterator = Iterator;
+
+  CompressedKeys() = default;
+  // keys must be sorted and unique
+  explicit CompressedKeys(const std::vector<T> &sorted);
+
+  std::size_t size() const { return size_; }
+  std::size_t BlockCount() const { return headers_.size(); }
+  // bytes used by headers and packed gaps
+  std::size_t MemoryBytes() const {
+    return headers_.capacity() * sizeof(Header) +
+           words_.capacity() * sizeof(std::uint32_t);
+  }
+  // number of keys less than v
+  std::size_t rank(const T &v) const { return Rank<false>(v); }
+  // find first element not less than v
+  Iterator lower_bound(const T &v) const { return At(Rank<false>(v)); }
+  // find first element greater than v
+  Iterator upper_bound(const T &v) const { return At(Rank<true>(v)); }
+  // count items in range
+  int CountByRange(const T &first, const T &second) const;
+  // call f(item) for every item in range in ascending order
+  template <class F>
+  void for_each_in_range(const T &first, const T &second, F f) const;
+  // decode keys of block b into out (room for kBlockKeys), return their
+  // number
+  std::size_t Decode(std::size_t b, T *out) const;
+
+  Iterator begin() const { return Iterator(this, 0, 0); }
+  Iterator end() const { return Iterator(this, headers_.size(), 0); }
+
+private:
+  std::vector<Header> headers_;
+  std::vector<std::uint32_t> words_;
+  std::size_t size_ = 0;
+
+  std::size_t BlockSize(std::size_t b) const {
+    return std::min(kBlockKeys, size_ - b * kBlockKeys);
+  }
+  Iterator At(std::size_t pos) const {
+    if (pos == size_) {
+      return end();
+    }
+    return Iterator(this, pos / kBlockKeys, pos % kBlockKeys);
+  }
+  // number of keys less than v (kInclusive - not greater than v)
+  template <bool kInclusive> std::size_t Rank(const T &v) const;
+  // unpack kBlockKeys gaps of width bits
+  static void Unpack(const std::uint32_t *words, unsigned width,
+                     std::uint32_t *gaps);
+};
+
+// Gap i goes to lane i % kLanes; every lane packs its gaps into consecutive
+// 32-bit words, word k of lane j is stored at kLanes * k + j.
+template <class T>
+CompressedKeys<T>::CompressedKeys(const std::vector<T> &sorted)
+    : size_(sorted.size()) {
+  headers_.reserve((size_ + kBlockKeys - 1) / kBlockKeys);
+  for (std::size_t start = 0; start < size_; start += kBlockKeys) {
+    std::size_t n = std::min(kBlockKeys, size_ - start);
+    std::uint64_t gaps[kBlockKeys] = {};
+    std::uint64_t max_gap = 0;
+    for (std::size_t i = 1; i < n; ++i) {
+      gaps[i] = static_cast<Unsigned>(sorted[start + i]) -
+                static_cast<Unsigned>(sorted[start + i - 1]) - 1;
+      max_gap = std::max(max_gap, gaps[i]);
+    }
+    Header h{sorted[start], static_cast<std::uint32_t>(words_.size()), 0};
+    if (max_gap > UINT32_MAX) {
+      h.width = kRawWidth;
+      for (std::size_t i = 0; i < kBlockKeys; ++i) {
+        words_.push_back(static_cast<std::uint32_t>(gaps[i]));
+        words_.push_back(static_cast<std::uint32_t>(gaps[i] >> 32));
+      }
+    } else {
+      h.width = static_cast<std::uint8_t>(std::bit_width(max_gap));
+      std::size_t base = words_.size();
+      words_.resize(base + h.width * kLanes);
+      // width 0 (consecutive keys) - no words, every gap is 0
+      for (std::size_t i = 0; i < kBlockKeys && h.width > 0; ++i) {
+        std::size_t bit = i / kLanes * h.width;
+        std::size_t word = base + bit / 32 * kLanes + i % kLanes;
+        std::uint64_t bits = gaps[i] << (bit % 32);
+        words_[word] |= static_cast<std::uint32_t>(bits);
+        if (bit % 32 + h.width > 32) {
+          words_[word + kLanes] |= static_cast<std::uint32_t>(bits >> 32);
+        }
+      }
+    }
+    headers_.push_back(h);
+  }
+  // unpacking may read one word group past the last block
+  words_.resize(words_.size() + kLanes);
+}
+
+template <class T>
+void CompressedKeys<T>::Unpack(const std::uint32_t *words, unsigned width,
+                               std::uint32_t *gaps) {
+  if (width == 0) {
+    std::fill(gaps, gaps + kBlockKeys, 0);
+    return;
+  }
+  const std::uint32_t mask =
+      width == 32 ? UINT32_MAX : (std::uint32_t{1} << width) - 1;
+#if defined(__SSE2__)
+  // all lanes share bit position, so one shift count serves four gaps
+  const __m128i m = _mm_set1_epi32(static_cast<int>(mask));
+  for (std::size_t v = 0, bit = 0; v < kBlockKeys / kLanes;
+       ++v, bit += width) {
+    const __m128i *p =
+        reinterpret_cast<const __m128i *>(words + bit / 32 * kLanes);
+    __m128i shift = _mm_cvtsi32_si128(static_cast<int>(bit % 32));
+    __m128i back = _mm_cvtsi32_si128(static_cast<int>(32 - bit % 32));
+    __m128i x = _mm_srl_epi32(_mm_loadu_si128(p), shift);
+    if (bit % 32 + width > 32) {
+      x = _mm_or_si128(x, _mm_sll_epi32(_mm_loadu_si128(p + 1), back));
+    }
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(gaps + v * kLanes),
+                     _mm_and_si128(x, m));
+  }
+#else
+  for (std::size_t i = 0; i < kBlockKeys; ++i) {
+    std::size_t bit = i / kLanes * width;
+    std::size_t word = bit / 32 * kLanes + i % kLanes;
+    std::uint64_t bits = words[word] >> (bit % 32);
+    if (bit % 32 + width > 32) {
+      bits |= static_cast<std::uint64_t>(words[word + kLanes])
+              << (32 - bit % 32);
+    }
+    gaps[i] = static_cast<std::uint32_t>(bits) & mask;
+  }
+#endif
+}
+
+// key[i] = first + i + gap[1] + ... + gap[i]
+template <class T>
+std::size_t CompressedKeys<T>::Decode(std::size_t b, T *out) const {
+  const Header &h = headers_[b];
+  const std::uint32_t *words = words_.data() + h.offset;
+  std::size_t n = BlockSize(b);
+  Unsigned key = static_cast<Unsigned>(h.first);
+  if (h.width == kRawWidth) {
+    for (std::size_t i = 0; i < n; ++i) {
+      std::uint64_t gap =
+          words[2 * i] | static_cast<std::uint64_t>(words[2 * i + 1]) << 32;
+      key += static_cast<Unsigned>(gap + (i > 0));
+      out[i] = static_cast<T>(key);
+    }
+    return n;
+  }
+  alignas(16) std::uint32_t gaps[kBlockKeys];
+  Unpack(words, h.width, gaps);
+#if defined(__SSE2__)
+  if constexpr (sizeof(T) == 4) {
+    // in-register prefix sum of 4 gaps, carry holds the last key broadcast
+    __m128i carry = _mm_set1_epi32(static_cast<int>(key));
+    __m128i index = _mm_set_epi32(3, 2, 1, 0);
+    const __m128i step = _mm_set1_epi32(static_cast<int>(kLanes));
+    for (std::size_t i = 0; i < kBlockKeys; i += kLanes) {
+      __m128i x = _mm_load_si128(reinterpret_cast<const __m128i *>(gaps + i));
+      x = _mm_add_epi32(x, _mm_slli_si128(x, 4));
+      x = _mm_add_epi32(x, _mm_slli_si128(x, 8));
+      x = _mm_add_epi32(x, carry);
+      carry = _mm_shuffle_epi32(x, 0xff);
+      _mm_storeu_si128(reinterpret_cast<__m128i *>(out + i),
+                       _mm_add_epi32(x, index));
+      index = _mm_add_epi32(index, step);
+    }
+    return n;
+  }
+#endif
+  for (std::size_t i = 0; i < n; ++i) {
+    key += gaps[i] + (i > 0);
+    out[i] = static_cast<T>(key);
+  }
+  return n;
+}
+
+template <class T>
+template <bool kInclusive>
+std::size_t CompressedKeys<T>::Rank(const T &v) const {
+  auto it = std::upper_bound(
+      headers_.begin(), headers_.end(), v,
+      [](const T &key, const Header &h) { return key < h.first; });
+  if (it == headers_.begin()) {
+    return 0;
+  }
+  std::size_t b = static_cast<std::size_t>(it - headers_.begin()) - 1;
+  Block keys;
+  std::size_t n = Decode(b, keys.data());
+  std::size_t c = 0;
+  for (std::size_t i = 0; i < n; ++i) {
+    if constexpr (kInclusive) {
+      c += !(v < keys[i]);
+    } else {
+      c += keys[i] < v;
+    }
+  }
+  return b * kBlockKeys + c;
+}
+
+template <class T>
+int CompressedKeys<T>::CountByRange(const T &first, const T &second) const {
+  if (second < first) {
+    return 0;
+  }
+  return static_cast<int>(Rank<true>(second) - Rank<false>(first));
+}
+
+template <class T>
+template <class F>
+void CompressedKeys<T>::for_each_in_range(const T &first, const T &second,
+                                          F f) const {
+  if (second < first) {
+    return;
+  }
+  std::size_t pos = Rank<false>(first);
+  Block keys;
+  for (std::size_t b = pos / kBlockKeys; b < headers_.size(); ++b) {
+    std::size_t n = Decode(b, keys.data());
+    for (std::size_t i = b == pos / kBlockKeys ? pos % kBlockKeys : 0; i < n;
+         ++i) {
+      if (second < keys[i]) {
+        return;
+      }
+      f(keys[i]);
+    }
+  }
+}
+
+} // namespace adt
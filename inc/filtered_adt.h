@@ -0,0 +1,134 @@
+#pragma once
+#include <algorithm>
+#include <cstddef>
+
+#include "membership_filter.h"
+#include "simple_adt.h"
+
+namespace adt {
+
+template <class T>
+// FilteredAdt - set of keys in Adt with a BlockedBloomFilter of them in front
+// of point lookups: a key the filter has never seen is a definite miss
+// answered without a descent. A filter hit still descends (it cannot prove
+// presence, so duplicate inserts gain nothing). Erased keys stay in the filter
+// and only raise its false positive rate; the filter is rebuilt from the tree
+// when keys outgrow it or erased keys reach half of it.
+class FilteredAdt {
+public:
+  using Iterator = typename Adt<T>::Iterator;
+
+  // lookup statistics since construction or ResetStats()
+  struct Stats {
+    std::size_t lookups = 0;         // find / contains / count calls
+    std::size_t filtered = 0;        // misses answered by the filter
+    std::size_t false_positives = 0; // passed the filter, key absent
+    std::size_t rebuilds = 0;        // filter rebuilds from the tree
+    // share of lookups that skipped the tree
+    double FilteredRate() const {
+      return lookups == 0 ? 0.0 : static_cast<double>(filtered) / lookups;
+    }
+    // share of absent keys that still descended
+    double FalsePositiveRate() const {
+      std::size_t misses = filtered + false_positives;
+      return misses == 0 ? 0.0
+                         : static_cast<double>(false_positives) / misses;
+    }
+  };
+
+  // expected_keys - initial filter capacity, it grows with the tree
+  explicit FilteredAdt(std::size_t expected_keys = 1024,
+                       double bits_per_key = 10)
+      : bits_per_key_(bits_per_key),
+        capacity_(std::max<std::size_t>(expected_keys, 1)),
+        filter_(capacity_, bits_per_key) {}
+
+  // number of keys
+  std::size_t size() const { return tree_.size(); }
+  // false if key is already stored
+  bool insert(const T &key);
+  // removes key, returns number of removed keys (0 or 1)
+  std::size_t erase(const T &key);
+  // find key, if not found = return end()
+  Iterator find(const T &key) const {
+    if (!Lookup(key)) {
+      return tree_.end();
+    }
+    auto it = tree_.find(key);
+    stats_.false_positives += it == tree_.end();
+    return it;
+  }
+  bool contains(const T &key) const { return count(key) > 0; }
+  std::size_t count(const T &key) const {
+    if (!Lookup(key)) {
+      return 0;
+    }
+    std::size_t result = tree_.count(key);
+    stats_.false_positives += result == 0;
+    return result;
+  }
+  Iterator end() const { return tree_.end(); }
+  // range queries go to the tree directly
+  const Adt<T> &Tree() const { return tree_; }
+  const Stats &Statistics() const { return stats_; }
+  void ResetStats() { stats_ = Stats{}; }
+  std::size_t FilterBytes() const { return filter_.MemoryBytes(); }
+  // bytes used by nodes and filter
+  std::size_t MemoryBytes() const {
+    return tree_.MemoryBytes() + filter_.MemoryBytes();
+  }
+  // refill the filter with current keys, sized for twice as many
+  void Rebuild();
+
+private:
+  Adt<T> tree_;
+  double bits_per_key_;
+  std::size_t capacity_;   // keys the filter is sized for
+  std::size_t filled_ = 0; // keys added to the filter since its rebuild
+  std::size_t erased_ = 0; // of them erased from the tree
+  BlockedBloomFilter<T> filter_;
+  mutable Stats stats_;
+
+  // false - definite miss
+  bool Lookup(const T &key) const {
+    ++stats_.lookups;
+    if (!filter_.MayContain(key)) {
+      ++stats_.filtered;
+      return false;
+    }
+    return true;
+  }
+};
+
+template <class T> bool FilteredAdt<T>::insert(const T &key) {
+  if (!tree_.insert(key).second) {
+    return false;
+  }
+  filter_.insert(key);
+  if (++filled_ > capacity_) {
+    Rebuild();
+  }
+  return true;
+}
+
+template <class T> std::size_t FilteredAdt<T>::erase(const T &key) {
+  std::size_t removed = tree_.erase(key);
+  erased_ += removed;
+  if (2 * erased_ > capacity_) {
+    Rebuild();
+  }
+  return removed;
+}
+
+template <class T> void FilteredAdt<T>::Rebuild() {
+  capacity_ = std::max<std::size_t>(2 * tree_.size(), 1);
+  filter_ = BlockedBloomFilter<T>(capacity_, bits_per_key_);
+  for (const T &key : tree_) {
+    filter_.insert(key);
+  }
+  filled_ = tree_.size();
+  erased_ = 0;
+  ++stats_.rebuilds;
+}
+
+} // namespace adt
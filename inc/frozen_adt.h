@@ -0,0 +1,216 @@
+#pragma once
+#include <bit>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <limits>
+#include <vector>
+
+namespace adt {
+
+template <class T>
+// FrozenAdt - immutable snapshot of Adt. Keys are stored in Eytzinger (BFS)
+// order of an implicit complete tree: children of keys_[k] are keys_[2k] and
+// keys_[2k+1]. Searches are branchless and prefetch four levels ahead, so
+// there are no pointers to chase. rank_[k] is the in-order position of
+// keys_[k], it turns two searches into a range count.
+class FrozenAdt {
+  using RankType = std::uint32_t;
+  // keys in one cache line, also the block of descendants four levels down
+  static constexpr std::size_t kPrefetchStride =
+      64 / sizeof(T) > 0 ? 64 / sizeof(T) : 1;
+
+public:
+  class Iterator {
+    const FrozenAdt *ptr_ = nullptr;
+    std::size_t k_ = 0; // Eytzinger index, 0 - end()
+
+    Iterator(const FrozenAdt *p, std::size_t k) : ptr_(p), k_(k) {}
+
+  public:
+    using iterator_category = std::bidirectional_iterator_tag;
+    using value_type = T;
+    using difference_type = std::ptrdiff_t;
+    using pointer = const T *;
+    using reference = const T &;
+
+    friend class FrozenAdt;
+
+    Iterator() = default;
+
+    reference operator*() const { return ptr_->keys_[k_]; }
+    pointer operator->() const { return &ptr_->keys_[k_]; }
+    // position in sorted order, size() for end()
+    std::size_t rank() const { return ptr_->Rank(k_); }
+
+    bool operator==(const Iterator &rhs) const {
+      return ptr_ == rhs.ptr_ && k_ == rhs.k_;
+    }
+
+    Iterator &operator++() {
+      k_ = ptr_->Next(k_);
+      return *this;
+    }
+    Iterator operator++(int) {
+      Iterator retval = *this;
+      ++(*this);
+      return retval;
+    }
+    Iterator &operator--() {
+      k_ = ptr_->Prev(k_);
+      return *this;
+    }
+    Iterator operator--(int) {
+      Iterator retval = *this;
+      --(*this);
+      return retval;
+    }
+  };
+
+  using iterator = Iterator;
+
+  FrozenAdt() = default;
+  // keys must be sorted
+  explicit FrozenAdt(const std::vector<T> &sorted);
+
+  std::size_t size() const { return size_; }
+  // bytes used by keys and ranks
+  std::size_t MemoryBytes() const {
+    return keys_.capacity() * sizeof(T) + rank_.capacity() * sizeof(RankType);
+  }
+  // find element equal key, if not found = return end()
+  Iterator find(const T &key) const;
+  // find first element not less than v
+  Iterator lower_bound(const T &v) const {
+    return Iterator(this, LowerBound(v));
+  }
+  // find first element greater than v
+  Iterator upper_bound(const T &v) const {
+    return Iterator(this, UpperBound(v));
+  }
+  // count items in range
+  int CountByRange(const T &first, const T &second) const;
+
+  Iterator begin() const { return Iterator(this, First()); }
+  Iterator end() const { return Iterator(this, 0); }
+
+private:
+  std::vector<T> keys_; // keys_[0] is not used
+  std::vector<RankType> rank_;
+  std::size_t size_ = 0;
+
+  void Prefetch(std::size_t k) const {
+#if defined(__GNUC__)
+    __builtin_prefetch(keys_.data() + k * kPrefetchStride);
+#endif
+  }
+  std::size_t Rank(std::size_t k) const { return k == 0 ? size_ : rank_[k]; }
+  // Eytzinger index of first key not less than v, 0 - none
+  std::size_t LowerBound(const T &v) const;
+  // Eytzinger index of first key greater than v, 0 - none
+  std::size_t UpperBound(const T &v) const;
+  // in-order neighbours in implicit tree, 0 - none
+  std::size_t First() const;
+  std::size_t Last() const;
+  std::size_t Next(std::size_t k) const;
+  std::size_t Prev(std::size_t k) const;
+};
+
+template <class T>
+FrozenAdt<T>::FrozenAdt(const std::vector<T> &sorted)
+    : keys_(sorted.size() + 1), rank_(sorted.size() + 1),
+      size_(sorted.size()) {
+  assert(size_ < std::numeric_limits<RankType>::max());
+  std::size_t k = First();
+  for (std::size_t i = 0; i < size_; ++i, k = Next(k)) {
+    keys_[k] = sorted[i];
+    rank_[k] = static_cast<RankType>(i);
+  }
+}
+
+// Go left while key < v is false. The answer is the last node where search
+// turned left: strip trailing right turns (ones) and that left turn.
+template <class T> std::size_t FrozenAdt<T>::LowerBound(const T &v) const {
+  std::size_t k = 1;
+  while (k <= size_) {
+    Prefetch(k);
+    k = 2 * k + (keys_[k] < v);
+  }
+  return k >> (std::countr_one(k) + 1);
+}
+
+template <class T> std::size_t FrozenAdt<T>::UpperBound(const T &v) const {
+  std::size_t k = 1;
+  while (k <= size_) {
+    Prefetch(k);
+    k = 2 * k + !(v < keys_[k]);
+  }
+  return k >> (std::countr_one(k) + 1);
+}
+
+template <class T>
+typename FrozenAdt<T>::Iterator FrozenAdt<T>::find(const T &key) const {
+  std::size_t k = LowerBound(key);
+  if (k != 0 && !(key < keys_[k])) {
+    return Iterator(this, k);
+  }
+  return end();
+}
+
+template <class T>
+int FrozenAdt<T>::CountByRange(const T &first, const T &second) const {
+  if (second < first) {
+    return 0;
+  }
+  return static_cast<int>(Rank(UpperBound(second)) - Rank(LowerBound(first)));
+}
+
+template <class T> std::size_t FrozenAdt<T>::First() const {
+  if (size_ == 0) {
+    return 0;
+  }
+  std::size_t k = 1;
+  while (2 * k <= size_) {
+    k = 2 * k;
+  }
+  return k;
+}
+
+template <class T> std::size_t FrozenAdt<T>::Last() const {
+  if (size_ == 0) {
+    return 0;
+  }
+  std::size_t k = 1;
+  while (2 * k + 1 <= size_) {
+    k = 2 * k + 1;
+  }
+  return k;
+}
+
+template <class T> std::size_t FrozenAdt<T>::Next(std::size_t k) const {
+  if (2 * k + 1 <= size_) { // leftmost node of right subtree
+    k = 2 * k + 1;
+    while (2 * k <= size_) {
+      k = 2 * k;
+    }
+    return k;
+  }
+  return k >> (std::countr_one(k) + 1); // up while k is right child
+}
+
+template <class T> std::size_t FrozenAdt<T>::Prev(std::size_t k) const {
+  if (k == 0) {
+    return Last();
+  }
+  if (2 * k <= size_) { // rightmost node of left subtree
+    k = 2 * k;
+    while (2 * k + 1 <= size_) {
+      k = 2 * k + 1;
+    }
+    return k;
+  }
+  return k >> (std::countr_zero(k) + 1); // up while k is left child
+}
+
+} // namespace adt
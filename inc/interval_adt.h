@@ -0,0 +1,157 @@
+#pragma once
+#include <algorithm>
+#include <compare>
+#include <cstddef>
+#include <cstdint>
+#include <initializer_list>
+#include <vector>
+
+#include "simple_adt.h"
+
+namespace adt {
+
+// closed interval [first, second]
+template <class T> struct Interval {
+  T first;
+  T second;
+  auto operator<=>(const Interval &) const = default;
+};
+
+// max end of intervals in subtree
+template <class T> struct AdtTagExtra<Interval<T>> {
+  T max_end_{};
+  void Update(const Interval<T> &key, const AdtTagExtra *left,
+              const AdtTagExtra *right) {
+    max_end_ = key.second;
+    for (const AdtTagExtra *child : {left, right}) {
+      if (nullptr != child && max_end_ < child->max_end_) {
+        max_end_ = child->max_end_;
+      }
+    }
+  }
+};
+
+template <class T>
+// IntervalAdt - multiset of closed intervals ordered by start. Tags of the
+// start tree keep the max end of every subtree, so enumeration skips subtrees
+// that end before the query and stops at the first start after it. That is
+// an augmented interval tree, not an output-sensitive one: reporting k
+// intervals costs O(min(N, k log N)), since every reported node may sit on
+// its own path of entered subtrees. Counting is O(log N): a second tree of
+// ends turns it into two rank descents, an interval overlaps [a, b] unless
+// it starts after b or ends before a.
+class IntervalAdt {
+  using Tree = Adt<Interval<T>>;
+  using NodePtr = typename Tree::NodePtr;
+
+public:
+  IntervalAdt() {
+    starts_.SetMultiset(true);
+    ends_.SetMultiset(true);
+  }
+
+  // number of intervals
+  std::size_t size() const { return starts_.size(); }
+  // add interval [first, second], false if first > second
+  bool insert(const T &first, const T &second);
+  // call f(interval) for every interval overlapping [a, b], ordered by
+  // start, O(min(N, k log N)) for k intervals
+  template <class F>
+  void for_each_overlapping(const T &a, const T &b, F f) const;
+  // intervals overlapping [a, b] ordered by start
+  std::vector<Interval<T>> overlapping(const T &a, const T &b) const;
+  // number of intervals overlapping [a, b]
+  std::size_t count_overlapping(const T &a, const T &b) const;
+  // number of intervals containing x
+  std::size_t stab(const T &x) const { return count_overlapping(x, x); }
+  void Clear() {
+    starts_.Clear();
+    ends_.Clear();
+  }
+
+private:
+  Tree starts_;
+  Adt<T> ends_;
+
+  // number of intervals starting not after b
+  std::size_t StartsUpTo(const T &b) const;
+};
+
+template <class T>
+bool IntervalAdt<T>::insert(const T &first, const T &second) {
+  if (second < first) {
+    return false;
+  }
+  starts_.insert(Interval<T>{first, second});
+  ends_.insert(second);
+  return true;
+}
+
+template <class T>
+std::size_t IntervalAdt<T>::StartsUpTo(const T &b) const {
+  starts_.RefreshTags();
+  std::size_t result = 0;
+  for (NodePtr p = starts_.root_; nullptr != p;) {
+    if (b < p->avl_data_.first) {
+      p = p->avl_link_[0];
+    } else {
+      result += Tree::Count(p->avl_link_[0]) + p->avl_count_;
+      p = p->avl_link_[1];
+    }
+  }
+  return result;
+}
+
+// An interval ending before a also starts before b, so it is one of
+// StartsUpTo(b).
+template <class T>
+std::size_t IntervalAdt<T>::count_overlapping(const T &a, const T &b) const {
+  if (b < a) {
+    return 0;
+  }
+  return StartsUpTo(b) - ends_.rank(a);
+}
+
+// In-order walk: a subtree is entered only if its max end is not before a and
+// its min start is not after b.
+template <class T>
+template <class F>
+void IntervalAdt<T>::for_each_overlapping(const T &a, const T &b, F f) const {
+  if (b < a) {
+    return;
+  }
+  starts_.RefreshTags();
+  auto useful = [&a, &b](NodePtr p) {
+    return nullptr != p && !(p->tag_.extra_.max_end_ < a) &&
+           !(b < p->tag_.bound_[0]->avl_data_.first);
+  };
+  typename Tree::NodePtrStack stack;
+  NodePtr p = starts_.root_;
+  while (useful(p) || !stack.empty()) {
+    for (; useful(p); p = p->avl_link_[0]) {
+      stack.push_back(p);
+    }
+    p = stack.back();
+    stack.pop_back();
+    if (b < p->avl_data_.first) {
+      return; // all following intervals start after b
+    }
+    if (!(p->avl_data_.second < a)) {
+      for (std::uint32_t i = 0; i < p->avl_count_; ++i) {
+        f(p->avl_data_);
+      }
+    }
+    p = p->avl_link_[1];
+  }
+}
+
+template <class T>
+std::vector<Interval<T>> IntervalAdt<T>::overlapping(const T &a,
+                                                     const T &b) const {
+  std::vector<Interval<T>> result;
+  for_each_overlapping(
+      a, b, [&result](const Interval<T> &v) { result.push_back(v); });
+  return result;
+}
+
+} // namespace adt
@@ -0,0 +1,190 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <random>
+#include <vector>
+
+namespace adt {
+
+template <class T>
+// KllSketch - mergeable quantile sketch (Karnin, Lang, Liberty) with the
+// insert/CountByRange interface of Adt. Memory is O(k) for any stream length,
+// answers are approximate: every count is within MaxCountError() of the exact
+// one with 99% confidence. Unlike Adt every insert is counted, duplicates
+// included.
+class KllSketch {
+  static constexpr double kCapacityRatio = 2.0 / 3.0;
+  static constexpr std::size_t kMinCapacity = 2;
+  // empirical 99% confidence fit for the difference of two ranks
+  static constexpr double kErrorScale = 2.446;
+  static constexpr double kErrorPower = 0.9433;
+
+  using Level = std::vector<T>;
+
+public:
+  static constexpr std::size_t kDefaultK = 200;
+
+  explicit KllSketch(std::size_t k = kDefaultK)
+      : k_(std::max(k, kMinCapacity)), capacity_(TotalCapacity()) {}
+  // smallest k that keeps normalized error not greater than epsilon
+  static std::size_t KFromErrorBound(double epsilon);
+  // number of inserted items
+  std::size_t size() const { return size_; }
+  // number of items kept by sketch
+  std::size_t RetainedItems() const { return retained_; }
+  std::size_t k() const { return k_; }
+  // Add one item to the stream.
+  void insert(const T &t);
+  // Add all items of other sketch
+  void Merge(const KllSketch &other);
+  // approximate number of items less than v
+  std::size_t rank(const T &v) const;
+  // approximate count of items in range
+  int CountByRange(T first, T second) const;
+  // normalized error of CountByRange (fraction of size())
+  double ErrorBound() const;
+  // absolute error of CountByRange
+  std::size_t MaxCountError() const;
+
+private:
+  std::vector<Level> levels_ = std::vector<Level>(1);
+  std::size_t k_;
+  std::size_t size_ = 0;
+  std::size_t retained_ = 0;
+  std::size_t capacity_; // TotalCapacity() for current number of levels
+  std::minstd_rand random_;
+
+  // capacity of level, top level has capacity k_
+  std::size_t Capacity(std::size_t level) const;
+  std::size_t TotalCapacity() const;
+  // compact lowest full level until sketch fits in capacity
+  void Compress();
+  // halve items of level and promote survivors to next level
+  void Compact(std::size_t level);
+};
+
+template <class T> std::size_t KllSketch<T>::KFromErrorBound(double epsilon) {
+  if (epsilon <= 0.0) {
+    return kDefaultK;
+  }
+  double k = std::pow(kErrorScale / epsilon, 1.0 / kErrorPower);
+  return std::max(static_cast<std::size_t>(std::ceil(k)), kMinCapacity);
+}
+
+template <class T>
+std::size_t KllSketch<T>::Capacity(std::size_t level) const {
+  std::size_t depth = levels_.size() - level - 1;
+  auto cap = static_cast<std::size_t>(
+      std::ceil(k_ * std::pow(kCapacityRatio, static_cast<double>(depth))));
+  return std::max(cap, kMinCapacity);
+}
+
+template <class T> std::size_t KllSketch<T>::TotalCapacity() const {
+  std::size_t result = 0;
+  for (std::size_t h = 0; h < levels_.size(); ++h) {
+    result += Capacity(h);
+  }
+  return result;
+}
+
+template <class T> void KllSketch<T>::insert(const T &t) {
+  levels_[0].push_back(t);
+  ++size_;
+  ++retained_;
+  if (retained_ > capacity_) {
+    Compress();
+  }
+}
+
+template <class T> void KllSketch<T>::Merge(const KllSketch &other) {
+  if (other.levels_.size() > levels_.size()) {
+    levels_.resize(other.levels_.size());
+    capacity_ = TotalCapacity();
+  }
+  for (std::size_t h = 0; h < other.levels_.size(); ++h) {
+    levels_[h].insert(levels_[h].end(), other.levels_[h].begin(),
+                      other.levels_[h].end());
+  }
+  size_ += other.size_;
+  retained_ += other.retained_;
+  Compress();
+}
+
+template <class T> void KllSketch<T>::Compress() {
+  while (retained_ > capacity_) {
+    for (std::size_t h = 0; h < levels_.size(); ++h) {
+      if (levels_[h].size() >= Capacity(h)) {
+        Compact(h);
+        break;
+      }
+    }
+  }
+}
+
+template <class T> void KllSketch<T>::Compact(std::size_t level) {
+  if (level + 1 == levels_.size()) {
+    levels_.emplace_back();
+    capacity_ = TotalCapacity();
+  }
+  Level &src = levels_[level];
+  Level &dst = levels_[level + 1];
+  std::sort(src.begin(), src.end());
+  // odd item stays on its level with its own weight
+  T odd{};
+  bool has_odd = src.size() % 2 == 1;
+  if (has_odd) {
+    odd = src.back();
+    src.pop_back();
+  }
+  std::size_t offset = random_() & 1u;
+  for (std::size_t i = offset; i < src.size(); i += 2) {
+    dst.push_back(src[i]);
+  }
+  retained_ -= src.size() / 2;
+  src.clear();
+  if (has_odd) {
+    src.push_back(odd);
+  }
+}
+
+template <class T> std::size_t KllSketch<T>::rank(const T &v) const {
+  std::size_t result = 0;
+  for (std::size_t h = 0; h < levels_.size(); ++h) {
+    std::size_t n = 0;
+    for (const T &a : levels_[h]) {
+      n += a < v;
+    }
+    result += n << h;
+  }
+  return result;
+}
+
+template <class T> int KllSketch<T>::CountByRange(T first, T second) const {
+  if (first > second) {
+    return 0;
+  }
+  std::size_t result = 0;
+  for (std::size_t h = 0; h < levels_.size(); ++h) {
+    std::size_t n = 0;
+    for (const T &a : levels_[h]) {
+      n += first <= a && a <= second;
+    }
+    result += n << h;
+  }
+  return static_cast<int>(result);
+}
+
+template <class T> double KllSketch<T>::ErrorBound() const {
+  if (levels_.size() == 1) {
+    return 0.0; // nothing was compacted yet, answers are exact
+  }
+  return kErrorScale / std::pow(static_cast<double>(k_), kErrorPower);
+}
+
+template <class T> std::size_t KllSketch<T>::MaxCountError() const {
+  return static_cast<std::size_t>(std::ceil(ErrorBound() * size_));
+}
+
+} // namespace adt
@@ -0,0 +1,150 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <limits>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace adt {
+
+template <class T>
+// LearnedIndex - read-only index over sorted integer keys, e.g. an
+// Adt::GetInorderVector() export. Positions are predicted by a piecewise
+// linear model, every key is within Epsilon() of its predicted position, so a
+// lookup is a search among segment starts plus a binary search over
+// 2 * Epsilon() + 3 keys. Smooth keys (timestamps, ids) need few segments.
+class LearnedIndex {
+  static_assert(std::is_integral_v<T>, "LearnedIndex needs integral keys");
+  using Unsigned = std::make_unsigned_t<T>;
+
+  struct Segment {
+    T key;             // first key of segment
+    std::size_t start; // position of key
+    double slope;      // positions per key unit
+  };
+
+public:
+  static constexpr std::size_t kDefaultEpsilon = 32;
+
+  LearnedIndex() = default;
+  // keys must be sorted and unique
+  explicit LearnedIndex(std::vector<T> sorted,
+                        std::size_t epsilon = kDefaultEpsilon);
+
+  std::size_t size() const { return keys_.size(); }
+  // guaranteed max distance between predicted and actual position
+  std::size_t Epsilon() const { return epsilon_; }
+  // max distance observed on the indexed keys
+  std::size_t MaxError() const { return max_error_; }
+  std::size_t SegmentCount() const { return segments_.size(); }
+  // bytes used by the model
+  std::size_t ModelBytes() const {
+    return segments_.capacity() * sizeof(Segment);
+  }
+  // bytes used by the model and keys
+  std::size_t MemoryBytes() const {
+    return ModelBytes() + keys_.capacity() * sizeof(T);
+  }
+  // number of keys less than v
+  std::size_t rank(const T &v) const;
+  bool contains(const T &key) const {
+    std::size_t pos = rank(key);
+    return pos < keys_.size() && keys_[pos] == key;
+  }
+  // count items in range
+  int CountByRange(const T &first, const T &second) const;
+
+private:
+  std::vector<T> keys_;
+  std::vector<Segment> segments_;
+  std::size_t epsilon_ = kDefaultEpsilon;
+  std::size_t max_error_ = 0;
+
+  // distance between keys as double, without signed overflow
+  static double Distance(const T &from, const T &to) {
+    return static_cast<double>(static_cast<Unsigned>(to) -
+                               static_cast<Unsigned>(from));
+  }
+  // model position of v inside segment s, clamped to positions of segment
+  std::size_t Predict(std::size_t s, const T &v) const;
+};
+
+// Greedy shrinking cone: a segment keeps the range of slopes [lo, hi] for
+// which every key seen so far stays within epsilon of its position. A key
+// outside of the cone starts the next segment.
+template <class T>
+LearnedIndex<T>::LearnedIndex(std::vector<T> sorted, std::size_t epsilon)
+    : keys_(std::move(sorted)), epsilon_(epsilon) {
+  const double eps = static_cast<double>(epsilon_);
+  std::size_t start = 0;
+  double lo = 0.0;
+  double hi = std::numeric_limits<double>::infinity();
+  for (std::size_t i = 1; i <= keys_.size(); ++i) {
+    if (i < keys_.size()) {
+      double dx = Distance(keys_[start], keys_[i]);
+      double dy = static_cast<double>(i - start);
+      double slope = dy / dx;
+      if (lo <= slope && slope <= hi) {
+        lo = std::max(lo, (dy - eps) / dx);
+        hi = std::min(hi, (dy + eps) / dx);
+        continue;
+      }
+    }
+    double slope = std::isinf(hi) ? lo : (lo + hi) / 2;
+    segments_.push_back({keys_[start], start, slope});
+    start = i;
+    lo = 0.0;
+    hi = std::numeric_limits<double>::infinity();
+  }
+  for (std::size_t s = 0, i = 0; i < keys_.size(); ++i) {
+    if (s + 1 < segments_.size() && segments_[s + 1].start == i) {
+      ++s;
+    }
+    std::size_t pos = Predict(s, keys_[i]);
+    max_error_ = std::max(max_error_, pos > i ? pos - i : i - pos);
+  }
+}
+
+template <class T>
+std::size_t LearnedIndex<T>::Predict(std::size_t s, const T &v) const {
+  const Segment &seg = segments_[s];
+  std::size_t end =
+      s + 1 < segments_.size() ? segments_[s + 1].start : keys_.size();
+  double pos = static_cast<double>(seg.start) +
+               std::round(seg.slope * Distance(seg.key, v));
+  return static_cast<std::size_t>(std::min(pos, static_cast<double>(end)));
+}
+
+// Between two keys of a segment the model is monotone, so the answer is
+// within Epsilon() + 1 of the prediction.
+template <class T> std::size_t LearnedIndex<T>::rank(const T &v) const {
+  if (keys_.empty() || v <= keys_.front()) {
+    return 0;
+  }
+  auto it = std::upper_bound(
+      segments_.begin(), segments_.end(), v,
+      [](const T &key, const Segment &seg) { return key < seg.key; });
+  std::size_t s = static_cast<std::size_t>(it - segments_.begin()) - 1;
+  std::size_t pos = Predict(s, v);
+  std::size_t first = pos > epsilon_ + 1 ? pos - epsilon_ - 1 : 0;
+  std::size_t last = std::min(pos + epsilon_ + 2, keys_.size());
+  return static_cast<std::size_t>(
+      std::lower_bound(keys_.begin() + first, keys_.begin() + last, v) -
+      keys_.begin());
+}
+
+template <class T>
+int LearnedIndex<T>::CountByRange(const T &first, const T &second) const {
+  if (second < first) {
+    return 0;
+  }
+  std::size_t upper = rank(second);
+  if (upper < keys_.size() && keys_[upper] == second) {
+    ++upper;
+  }
+  return static_cast<int>(upper - rank(first));
+}
+
+} // namespace adt
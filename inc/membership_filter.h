@@ -0,0 +1,242 @@
+#pragma once
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <span>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "frozen_adt.h"
+#include "simple_adt.h" // Fnv1a
+
+namespace adt {
+
+// 64-bit finalizer of MurmurHash3, spreads every input bit over the result
+inline std::uint64_t Mix64(std::uint64_t x) {
+  x ^= x >> 33;
+  x *= 0xff51afd7ed558ccdull;
+  x ^= x >> 33;
+  x *= 0xc4ceb9fe1a85ec53ull;
+  x ^= x >> 33;
+  return x;
+}
+
+// Hash of keys for membership filters. Equal keys must hash equally, so the
+// default covers integers, float/double (both zeros hash alike) and types
+// whose bytes are their value; specialize it for other key types.
+template <class T> struct FilterHash {
+  std::uint64_t operator()(const T &key) const {
+    if constexpr (std::is_integral_v<T>) {
+      return Mix64(static_cast<std::uint64_t>(key));
+    } else if constexpr (std::is_same_v<T, float> ||
+                         std::is_same_v<T, double>) {
+      T value = key == T{} ? T{} : key;
+      return Mix64(Fnv1a(&value, sizeof(value)));
+    } else {
+      static_assert(std::has_unique_object_representations_v<T>,
+                    "specialize FilterHash for this key type");
+      return Mix64(Fnv1a(&key, sizeof(key)));
+    }
+  }
+};
+
+template <class T>
+// BlockedBloomFilter - approximate set of keys for a growing tree. A key sets
+// one bit in each of the 8 words of one 64-byte block chosen by its hash, so
+// insert and lookup touch a single cache line. False positive rate is about
+// 1.5% at 10 bits per key. Keys cannot be removed: a filter of a shrinking
+// set is rebuilt from its keys.
+class BlockedBloomFilter {
+  static constexpr std::size_t kWords = 8;
+  static constexpr std::size_t kBlockBits = kWords * 64;
+  struct alignas(64) Block {
+    std::uint64_t words[kWords] = {};
+  };
+
+public:
+  BlockedBloomFilter() : BlockedBloomFilter(0) {}
+  // room for expected_keys at the given density
+  explicit BlockedBloomFilter(std::size_t expected_keys,
+                              double bits_per_key = 10)
+      : blocks_(std::max<std::size_t>(
+            1, static_cast<std::size_t>(std::ceil(
+                   static_cast<double>(expected_keys) * bits_per_key /
+                   kBlockBits)))) {}
+
+  void insert(const T &key) {
+    std::uint64_t hash = FilterHash<T>()(key);
+    Block &block = blocks_[BlockIndex(hash)];
+    for (std::size_t i = 0; i < kWords; ++i) {
+      block.words[i] |= Bit(hash, i);
+    }
+  }
+  // false - key was never inserted
+  bool MayContain(const T &key) const {
+    std::uint64_t hash = FilterHash<T>()(key);
+    const Block &block = blocks_[BlockIndex(hash)];
+    bool all = true;
+    for (std::size_t i = 0; i < kWords; ++i) { // no early exit, vectorizes
+      all &= (block.words[i] & Bit(hash, i)) != 0;
+    }
+    return all;
+  }
+  void Clear() { std::fill(blocks_.begin(), blocks_.end(), Block{}); }
+  std::size_t MemoryBytes() const { return blocks_.size() * sizeof(Block); }
+
+private:
+  std::vector<Block> blocks_;
+
+  // high half of the hash picks the block without a division
+  std::size_t BlockIndex(std::uint64_t hash) const {
+    return static_cast<std::size_t>((hash >> 32) * blocks_.size() >> 32);
+  }
+  // low half times an odd salt per word, top 6 bits pick the bit
+  static std::uint64_t Bit(std::uint64_t hash, std::size_t i) {
+    static constexpr std::uint32_t kSalt[kWords] = {
+        0x47b6137bu, 0x44974d91u, 0x8824ad5bu, 0xa2b7289du,
+        0x705495c7u, 0x2df1424bu, 0x9efc4947u, 0x5c6bfb31u};
+    std::uint32_t mixed = static_cast<std::uint32_t>(hash) * kSalt[i];
+    return std::uint64_t{1} << (mixed >> 26);
+  }
+};
+
+template <class T>
+// XorFilter - static approximate set with 8-bit fingerprints (Graf and
+// Lemire): a key maps to one slot in each third of a table of 1.23 N + 32
+// bytes, and the xor of the three slots is the key's fingerprint. 9.8 bits per
+// key, false positive rate 1/256, lookup reads three bytes. The table is
+// built by peeling: a slot hit by a single key is assigned last, after the
+// other keys of the slots it shares.
+class XorFilter {
+  static constexpr int kMaxAttempts = 64;
+
+public:
+  // Replace content with keys (duplicates allowed). false - no table found
+  // (only if different keys share a 64-bit hash), the filter is empty then.
+  bool Build(std::span<const T> keys);
+  // keys of a frozen snapshot
+  bool Build(const FrozenAdt<T> &frozen) {
+    std::vector<T> keys(frozen.begin(), frozen.end());
+    return Build(std::span<const T>(keys));
+  }
+  // false - key is not in the built set
+  bool MayContain(const T &key) const {
+    if (fingerprints_.empty()) {
+      return false;
+    }
+    std::uint64_t hash = Mix64(FilterHash<T>()(key) + seed_);
+    std::size_t slot[3];
+    Slots(hash, slot);
+    return Fingerprint(hash) == (fingerprints_[slot[0]] ^
+                                 fingerprints_[slot[1]] ^
+                                 fingerprints_[slot[2]]);
+  }
+  // number of distinct keys
+  std::size_t size() const { return size_; }
+  std::size_t MemoryBytes() const { return fingerprints_.capacity(); }
+
+private:
+  std::vector<std::uint8_t> fingerprints_;
+  std::uint64_t seed_ = 0;
+  std::size_t segment_ = 0; // slots in each third of the table
+  std::size_t size_ = 0;
+
+  static std::uint8_t Fingerprint(std::uint64_t hash) {
+    return static_cast<std::uint8_t>(hash ^ hash >> 32);
+  }
+  static std::size_t Reduce(std::uint64_t hash, std::size_t n) {
+    return static_cast<std::size_t>((hash & 0xffffffffu) * n >> 32);
+  }
+  void Slots(std::uint64_t hash, std::size_t slot[3]) const {
+    slot[0] = Reduce(hash, segment_);
+    slot[1] = Reduce(std::rotl(hash, 21), segment_) + segment_;
+    slot[2] = Reduce(std::rotl(hash, 42), segment_) + 2 * segment_;
+  }
+};
+
+template <class T> bool XorFilter<T>::Build(std::span<const T> keys) {
+  // Step 1 : Distinct hashes
+  std::vector<std::uint64_t> hashes;
+  hashes.reserve(keys.size());
+  for (const T &key : keys) {
+    hashes.push_back(FilterHash<T>()(key));
+  }
+  std::sort(hashes.begin(), hashes.end());
+  hashes.erase(std::unique(hashes.begin(), hashes.end()), hashes.end());
+  const std::size_t n = hashes.size();
+  size_ = 0;
+  if (n == 0) { // no table, MayContain() is false for every key
+    fingerprints_.clear();
+    return true;
+  }
+  segment_ = (32 + n + n * 23 / 100 + 2) / 3;
+  const std::size_t slots = 3 * segment_;
+  // Step 2 : Peel slots with one key until every key has its own slot
+  std::vector<std::uint64_t> xors(slots);
+  std::vector<std::uint32_t> counts(slots);
+  std::vector<std::size_t> queue;
+  std::vector<std::pair<std::uint64_t, std::size_t>> order; // hash, own slot
+  order.reserve(n);
+  std::uint64_t seed = 0;
+  for (int attempt = 0; attempt < kMaxAttempts && order.size() < n;
+       ++attempt) {
+    seed = Mix64(seed + 0x9e3779b97f4a7c15ull);
+    std::fill(xors.begin(), xors.end(), 0);
+    std::fill(counts.begin(), counts.end(), 0);
+    order.clear();
+    seed_ = seed;
+    std::size_t slot[3];
+    for (std::uint64_t key_hash : hashes) {
+      std::uint64_t hash = Mix64(key_hash + seed);
+      Slots(hash, slot);
+      for (std::size_t s : slot) {
+        xors[s] ^= hash;
+        ++counts[s];
+      }
+    }
+    queue.clear();
+    for (std::size_t s = 0; s < slots; ++s) {
+      if (counts[s] == 1) {
+        queue.push_back(s);
+      }
+    }
+    while (!queue.empty()) {
+      std::size_t own = queue.back();
+      queue.pop_back();
+      if (counts[own] != 1) {
+        continue;
+      }
+      std::uint64_t hash = xors[own]; // the only key left in the slot
+      order.emplace_back(hash, own);
+      Slots(hash, slot);
+      for (std::size_t s : slot) {
+        xors[s] ^= hash;
+        if (--counts[s] == 1) {
+          queue.push_back(s);
+        }
+      }
+    }
+  }
+  if (order.size() < n) {
+    fingerprints_.clear();
+    return false;
+  }
+  // Step 3 : Assign own slots in reverse peeling order, the other two slots
+  // of a key are final by then
+  fingerprints_.assign(slots, 0);
+  for (auto it = order.rbegin(); it != order.rend(); ++it) {
+    auto [hash, own] = *it;
+    std::size_t slot[3];
+    Slots(hash, slot);
+    fingerprints_[own] = Fingerprint(hash) ^ fingerprints_[slot[0]] ^
+                         fingerprints_[slot[1]] ^ fingerprints_[slot[2]];
+  }
+  size_ = n;
+  return true;
+}
+
+} // namespace adt
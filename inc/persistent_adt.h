@@ -0,0 +1,536 @@
+#pragma once
+#if defined(__unix__)
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <compare>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <iterator>
+#include <string>
+#include <type_traits>
+
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "simple_adt.h"
+
+namespace adt {
+
+template <class T>
+// PersistentAdt - AVL tree whose nodes live in a memory-mapped file. Links are
+// node indices, so the file is valid in every process that maps it: Open()
+// takes O(1) and queries run directly on the page cache.
+// Nodes of a published version are never changed: insert copies the
+// published nodes of its path (copy on write), newer nodes are changed in
+// place. Publish() flushes nodes, then writes root into the older of two
+// header slots with a checksum, so a crash leaves at least one complete
+// version and readers never see a half-built tree. The file only grows,
+// nodes of old versions are not reused. One writer per file: Create() and
+// a writable Open() hold an exclusive flock() until Close(), any number of
+// readers may map the file next to it.
+class PersistentAdt {
+  static_assert(std::is_trivially_copyable_v<T>,
+                "PersistentAdt stores keys as raw bytes");
+  using Index = std::uint32_t; // node number, 0 - no node
+  static constexpr std::size_t kMaxStack = 64;
+  static constexpr std::uint64_t kMagic = 0x5453525041544441ull; // ADTAPRST
+  static constexpr std::uint32_t kVersion = 1;
+  // header slots share the first page, nodes start after it
+  static constexpr std::size_t kDataOffset = 4096;
+  // file grows by at least this many bytes
+  static constexpr std::size_t kMinGrowth = 1 << 20;
+
+  struct Node {
+    Index link[2];
+    std::uint32_t count; // items in subtree
+    signed char balance;
+    T key;
+  };
+
+  struct Header {
+    std::uint64_t magic;
+    std::uint32_t version;
+    std::uint32_t key_size;
+    std::uint64_t seq;   // publication number, the larger valid one wins
+    std::uint64_t nodes; // allocated nodes
+    std::uint64_t items;
+    std::uint64_t root;     // Index, wide to leave no padding
+    std::uint64_t checksum; // FNV-1a of fields above
+  };
+
+  using IndexStack = InlineStack<Index, kMaxStack>;
+
+public:
+  static constexpr std::size_t kDefaultMaxBytes = std::size_t{1} << 32;
+
+  // Forward iterator, keeps path from root.
+  class Iterator {
+    const PersistentAdt *ptr_ = nullptr;
+    IndexStack stack_;
+
+    Iterator(const PersistentAdt *p, const IndexStack &stack)
+        : ptr_(p), stack_(stack) {}
+
+  public:
+    using iterator_category = std::forward_iterator_tag;
+    using value_type = T;
+    using difference_type = std::ptrdiff_t;
+    using pointer = const T *;
+    using reference = const T &;
+
+    friend class PersistentAdt;
+
+    Iterator() = default;
+
+    reference operator*() const { return ptr_->At(stack_.back())->key; }
+    pointer operator->() const { return &ptr_->At(stack_.back())->key; }
+
+    bool operator==(const Iterator &rhs) const {
+      return ptr_ == rhs.ptr_ && stack_ == rhs.stack_;
+    }
+
+    Iterator &operator++();
+    Iterator operator++(int) {
+      Iterator retval = *this;
+      ++(*this);
+      return retval;
+    }
+  };
+
+  using iterator = Iterator;
+
+  PersistentAdt() = default;
+  PersistentAdt(const PersistentAdt &) = delete;
+  PersistentAdt &operator=(const PersistentAdt &) = delete;
+  ~PersistentAdt() { Close(); }
+
+  // Create empty tree in file at path (truncated), the file may grow up to
+  // max_bytes. The empty tree is published. false if another writer holds
+  // the file.
+  bool Create(const std::string &path,
+              std::size_t max_bytes = kDefaultMaxBytes);
+  // Open the latest published version. writable - continue inserting, nodes
+  // inserted after the last Publish() of a crashed writer are dropped; false
+  // if another writer holds the file. Headers whose root or node count do
+  // not fit the file are skipped.
+  bool Open(const std::string &path, bool writable = false,
+            std::size_t max_bytes = kDefaultMaxBytes);
+  // Reader: switch to the latest published version, iterators are
+  // invalidated
+  bool Refresh();
+  // Unpublished inserts are dropped
+  void Close();
+  bool IsOpen() const { return nullptr != base_; }
+
+  // false if key is present, tree is read-only or file is full
+  bool insert(const T &key);
+  // make all inserts visible to readers and durable
+  bool Publish();
+  // number of the current published version
+  std::uint64_t Version() const { return seq_; }
+
+  std::size_t size() const { return items_; }
+  // bytes of file used by nodes of all versions
+  std::size_t FileBytes() const {
+    return kDataOffset + nodes_ * sizeof(Node);
+  }
+  bool contains(const T &key) const;
+  // number of elements less than v
+  std::size_t rank(const T &v) const { return Rank<false>(v); }
+  // count items in range
+  int CountByRange(const T &first, const T &second) const;
+  // find first element not less than v
+  Iterator lower_bound(const T &v) const { return Bound<false>(v); }
+  // find first element greater than v
+  Iterator upper_bound(const T &v) const { return Bound<true>(v); }
+  Iterator begin() const;
+  Iterator end() const { return Iterator(this, IndexStack()); }
+
+private:
+  int fd_ = -1;
+  char *base_ = nullptr;
+  std::size_t mapped_ = 0;    // length of mapping
+  std::size_t file_size_ = 0; // current length of file
+  bool writable_ = false;
+  Index root_ = 0;
+  std::uint64_t items_ = 0;
+  std::uint64_t nodes_ = 0;     // allocated nodes
+  std::uint64_t published_ = 0; // nodes up to this one are immutable
+  std::uint64_t seq_ = 0;
+
+  // i must be an allocated node; links are read from the file, so a broken
+  // one is caught here in debug builds
+  Node *At(Index i) const {
+    assert(i >= 1 && i <= nodes_);
+    return reinterpret_cast<Node *>(base_ + kDataOffset) + (i - 1);
+  }
+  Header *Slot(std::uint64_t seq) const {
+    return reinterpret_cast<Header *>(base_) + seq % 2;
+  }
+  static std::uint64_t Checksum(const Header &h) {
+    return Fnv1a(&h, offsetof(Header, checksum));
+  }
+  std::uint32_t Count(Index i) const { return i ? At(i)->count : 0; }
+  void Recount(Node *p) const {
+    p->count = 1 + Count(p->link[0]) + Count(p->link[1]);
+  }
+  // map length bytes of fd_
+  bool Map(std::size_t length);
+  // pick the valid header with the larger seq
+  bool ReadHeader();
+  // make file large enough for n nodes
+  bool Reserve(std::uint64_t n);
+  Index NewNode(const Node &node) {
+    *At(static_cast<Index>(++nodes_)) = node;
+    return static_cast<Index>(nodes_);
+  }
+  template <bool kInclusive> std::size_t Rank(const T &v) const;
+  template <bool kStrict> Iterator Bound(const T &v) const;
+};
+
+template <class T>
+bool PersistentAdt<T>::Create(const std::string &path,
+                              std::size_t max_bytes) {
+  Close();
+  fd_ = open(path.c_str(), O_RDWR | O_CREAT, 0644);
+  writable_ = true;
+  // truncate only under the lock, a running writer keeps its file
+  if (fd_ < 0 || flock(fd_, LOCK_EX | LOCK_NB) != 0 ||
+      ftruncate(fd_, 0) != 0 || ftruncate(fd_, kDataOffset) != 0 ||
+      !Map(std::max(max_bytes, kDataOffset))) {
+    Close();
+    return false;
+  }
+  file_size_ = kDataOffset;
+  return Publish();
+}
+
+template <class T>
+bool PersistentAdt<T>::Open(const std::string &path, bool writable,
+                            std::size_t max_bytes) {
+  Close();
+  fd_ = open(path.c_str(), writable ? O_RDWR : O_RDONLY);
+  writable_ = writable;
+  struct stat st;
+  if (fd_ < 0 || (writable && flock(fd_, LOCK_EX | LOCK_NB) != 0) ||
+      fstat(fd_, &st) != 0) {
+    Close();
+    return false;
+  }
+  file_size_ = static_cast<std::size_t>(st.st_size);
+  if (file_size_ < kDataOffset ||
+      !Map(writable ? std::max(max_bytes, file_size_) : file_size_) ||
+      !ReadHeader()) {
+    Close();
+    return false;
+  }
+  return true;
+}
+
+template <class T> bool PersistentAdt<T>::Refresh() {
+  if (writable_ || !IsOpen()) {
+    return IsOpen();
+  }
+  struct stat st;
+  if (fstat(fd_, &st) != 0) {
+    return false;
+  }
+  std::size_t size = static_cast<std::size_t>(st.st_size);
+  if (size != mapped_) {
+    munmap(base_, mapped_);
+    base_ = nullptr;
+    file_size_ = size;
+    if (!Map(size)) {
+      Close();
+      return false;
+    }
+  }
+  return ReadHeader();
+}
+
+template <class T> void PersistentAdt<T>::Close() {
+  if (nullptr != base_) {
+    munmap(base_, mapped_);
+  }
+  if (fd_ >= 0) {
+    close(fd_);
+  }
+  fd_ = -1;
+  base_ = nullptr;
+  mapped_ = 0;
+  file_size_ = 0;
+  root_ = 0;
+  items_ = 0;
+  nodes_ = 0;
+  published_ = 0;
+  seq_ = 0;
+}
+
+template <class T> bool PersistentAdt<T>::Map(std::size_t length) {
+  int prot = writable_ ? PROT_READ | PROT_WRITE : PROT_READ;
+  void *p = mmap(nullptr, length, prot, MAP_SHARED, fd_, 0);
+  if (p == MAP_FAILED) {
+    return false;
+  }
+  base_ = static_cast<char *>(p);
+  mapped_ = length;
+  return true;
+}
+
+template <class T> bool PersistentAdt<T>::ReadHeader() {
+  const Header *best = nullptr;
+  for (std::uint64_t i = 0; i < 2; ++i) {
+    Header h;
+    std::memcpy(&h, Slot(i), sizeof(h));
+    if (h.magic == kMagic && h.version == kVersion &&
+        h.key_size == sizeof(T) && h.checksum == Checksum(h) &&
+        h.nodes <= UINT32_MAX && h.root <= h.nodes && h.items <= h.nodes &&
+        kDataOffset + h.nodes * sizeof(Node) <= file_size_ &&
+        (nullptr == best || best->seq < h.seq)) {
+      best = Slot(i);
+    }
+  }
+  if (nullptr == best) {
+    return false;
+  }
+  Header h;
+  std::memcpy(&h, best, sizeof(h));
+  std::atomic_thread_fence(std::memory_order_acquire);
+  seq_ = h.seq;
+  nodes_ = h.nodes;
+  published_ = h.nodes;
+  items_ = h.items;
+  root_ = static_cast<Index>(h.root);
+  return true;
+}
+
+template <class T> bool PersistentAdt<T>::Reserve(std::uint64_t n) {
+  std::size_t need = kDataOffset + n * sizeof(Node);
+  if (need <= file_size_) {
+    return true;
+  }
+  std::size_t size =
+      std::min(mapped_, std::max(need, file_size_ + std::max(file_size_,
+                                                             kMinGrowth)));
+  if (need > size || ftruncate(fd_, static_cast<off_t>(size)) != 0) {
+    return false;
+  }
+  file_size_ = size;
+  return true;
+}
+
+// Published nodes of the path are copied first, so the rebalancing below
+// only touches nodes of the new version.
+template <class T> bool PersistentAdt<T>::insert(const T &key) {
+  if (!writable_) {
+    return false;
+  }
+  // Step 1 : Search new node position
+  IndexStack path;
+  InlineStack<unsigned char, kMaxStack> dirs;
+  for (Index p = root_; p != 0;) {
+    auto cmp = key <=> At(p)->key;
+    if (cmp == 0) {
+      return false;
+    }
+    path.push_back(p);
+    dirs.push_back(cmp > 0);
+    p = At(p)->link[cmp > 0];
+  }
+  // parent link of node at depth k
+  auto link = [this, &path, &dirs](std::size_t k) -> Index & {
+    return k == 0 ? root_ : At(path[k - 1])->link[dirs[k - 1]];
+  };
+  if (path.size() + 1 >= kMaxStack ||
+      nodes_ + path.size() + 1 > UINT32_MAX ||
+      !Reserve(nodes_ + path.size() + 1)) {
+    return false;
+  }
+  // Step 2 : Copy published nodes of path
+  for (std::size_t k = 0; k < path.size(); ++k) {
+    if (path[k] <= published_) {
+      Index copy = NewNode(*At(path[k]));
+      link(k) = copy;
+      path[k] = copy;
+    }
+  }
+  // Step 3 : Insert, update counts and balance factors below the last
+  // unbalanced node
+  Index n = NewNode(Node{{0, 0}, 1, 0, key});
+  link(path.size()) = n;
+  ++items_;
+  if (path.empty()) {
+    return true;
+  }
+  std::size_t iy = 0;
+  for (std::size_t k = 0; k < path.size(); ++k) {
+    ++At(path[k])->count;
+    if (At(path[k])->balance != 0) {
+      iy = k;
+    }
+  }
+  for (std::size_t k = iy; k < path.size(); ++k) {
+    At(path[k])->balance += dirs[k] ? 1 : -1;
+  }
+  // Step 4 : Rebalance at y, x and w are on the new path
+  Node *y = At(path[iy]);
+  const int d = dirs[iy];
+  const signed char sign = d ? 1 : -1; // balance of y grew by sign
+  if (y->balance != 2 * sign) {
+    return true;
+  }
+  Index ix = y->link[d];
+  Node *x = At(ix);
+  Index iw;
+  if (x->balance == sign) {
+    // rotate at y
+    iw = ix;
+    y->link[d] = x->link[!d];
+    x->link[!d] = path[iy];
+    x->balance = 0;
+    y->balance = 0;
+    Recount(y);
+    Recount(x);
+  } else {
+    // rotate at x than at y
+    iw = x->link[!d];
+    Node *w = At(iw);
+    x->link[!d] = w->link[d];
+    w->link[d] = ix;
+    y->link[d] = w->link[!d];
+    w->link[!d] = path[iy];
+    if (w->balance == sign) {
+      x->balance = 0;
+      y->balance = -sign;
+    } else if (w->balance == 0) {
+      x->balance = 0;
+      y->balance = 0;
+    } else {
+      x->balance = sign;
+      y->balance = 0;
+    }
+    w->balance = 0;
+    Recount(x);
+    Recount(y);
+    Recount(w);
+  }
+  link(iy) = iw;
+  return true;
+}
+
+// Nodes reach the file before the header that points to them.
+template <class T> bool PersistentAdt<T>::Publish() {
+  if (!writable_) {
+    return false;
+  }
+  const std::size_t page = static_cast<std::size_t>(sysconf(_SC_PAGESIZE));
+  std::size_t first = (kDataOffset + published_ * sizeof(Node)) / page * page;
+  std::size_t last = kDataOffset + nodes_ * sizeof(Node);
+  if (last > first && msync(base_ + first, last - first, MS_SYNC) != 0) {
+    return false;
+  }
+  Header h{kMagic, kVersion, sizeof(T), seq_ + 1, nodes_, items_, root_, 0};
+  h.checksum = Checksum(h);
+  std::atomic_thread_fence(std::memory_order_release);
+  std::memcpy(Slot(h.seq), &h, sizeof(h));
+  if (msync(base_, kDataOffset, MS_SYNC) != 0) {
+    return false;
+  }
+  seq_ = h.seq;
+  published_ = nodes_;
+  return true;
+}
+
+template <class T> bool PersistentAdt<T>::contains(const T &key) const {
+  for (Index p = root_; p != 0;) {
+    auto cmp = key <=> At(p)->key;
+    if (cmp == 0) {
+      return true;
+    }
+    p = At(p)->link[cmp > 0];
+  }
+  return false;
+}
+
+template <class T>
+template <bool kInclusive>
+std::size_t PersistentAdt<T>::Rank(const T &v) const {
+  std::size_t result = 0;
+  for (Index p = root_; p != 0;) {
+    const Node *node = At(p);
+    bool right = kInclusive ? !(v < node->key) : node->key < v;
+    if (right) {
+      result += Count(node->link[0]) + 1;
+    }
+    p = node->link[right];
+  }
+  return result;
+}
+
+template <class T>
+int PersistentAdt<T>::CountByRange(const T &first, const T &second) const {
+  if (second < first) {
+    return 0;
+  }
+  return static_cast<int>(Rank<true>(second) - Rank<false>(first));
+}
+
+// Path to the last node where the search went left is the answer.
+template <class T>
+template <bool kStrict>
+typename PersistentAdt<T>::Iterator
+PersistentAdt<T>::Bound(const T &v) const {
+  IndexStack stack;
+  std::size_t depth = 0; // path length to the answer
+  for (Index p = root_; p != 0;) {
+    const Node *node = At(p);
+    stack.push_back(p);
+    bool right = kStrict ? !(v < node->key) : node->key < v;
+    if (!right) {
+      depth = stack.size();
+    }
+    p = node->link[right];
+  }
+  stack.resize(depth);
+  return Iterator(this, stack);
+}
+
+template <class T>
+typename PersistentAdt<T>::Iterator PersistentAdt<T>::begin() const {
+  IndexStack stack;
+  for (Index p = root_; p != 0; p = At(p)->link[0]) {
+    stack.push_back(p);
+  }
+  return Iterator(this, stack);
+}
+
+template <class T>
+typename PersistentAdt<T>::Iterator &PersistentAdt<T>::Iterator::operator++() {
+  if (stack_.empty()) {
+    return *this;
+  }
+  // try to move right, then to the smallest node
+  Index p = ptr_->At(stack_.back())->link[1];
+  if (p != 0) {
+    for (; p != 0; p = ptr_->At(p)->link[0]) {
+      stack_.push_back(p);
+    }
+    return *this;
+  }
+  // try to move up
+  p = stack_.back();
+  stack_.pop_back();
+  while (!stack_.empty() && ptr_->At(stack_.back())->link[1] == p) {
+    p = stack_.back();
+    stack_.pop_back();
+  }
+  return *this;
+}
+
+} // namespace adt
+#endif
@@ -0,0 +1,445 @@
+#pragma once
+#if defined(__linux__)
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <cerrno>
+#include <charconv>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "simple_adt.h"
+
+namespace adt {
+
+template <class T>
+// QueryServer - keeps one Adt<T> resident and answers the range_query text
+// protocol over a Unix domain socket: "k key" inserts, "q first second" is
+// answered with the count and a space, "h n b0 ... bn" with the counts of n
+// buckets [b0, b1), ..., end of input with a newline. Every
+// worker runs its own epoll loop; the listening socket is registered in all
+// of them with EPOLLEXCLUSIVE, so one worker wakes per new client and serves
+// it until it leaves. Pipelined requests are parsed from one read and
+// answered in order with one write. Runs of queries hold the tree lock shared,
+// so clients are answered in parallel; runs of inserts hold it exclusively.
+class QueryServer {
+  static constexpr std::size_t kReadSize = 64 * 1024;
+  static constexpr int kMaxEvents = 64;
+  static constexpr std::size_t kMaxBuckets = 1 << 20;
+  // unparsed input of one command, a longer one drops the client
+  static constexpr std::size_t kMaxPending = kReadSize;
+
+public:
+  QueryServer() = default;
+  QueryServer(const QueryServer &) = delete;
+  QueryServer &operator=(const QueryServer &) = delete;
+  ~QueryServer() { Stop(); }
+
+  // listen on socket file path, an existing file is replaced
+  bool Listen(const std::string &path);
+  // serve by threads workers (0 - hardware concurrency)
+  bool Start(unsigned threads = 0);
+  // stop workers, drop clients and remove socket file
+  void Stop();
+
+  // tree to fill before Start() and to read after Stop()
+  Adt<T> &Tree() { return tree_; }
+  // clients accepted so far
+  std::size_t Clients() const { return clients_; }
+  // k and q commands served so far
+  std::size_t Requests() const { return requests_; }
+
+private:
+  struct Client {
+    std::string in;   // unparsed input
+    std::string out;  // answers not written yet
+    std::size_t sent = 0;
+    bool eof = false; // client finished sending or broke protocol
+    // h command whose boundaries are still being read
+    bool histogram = false;
+    std::size_t buckets = 0;
+    std::vector<T> boundaries;
+  };
+
+  Adt<T> tree_;
+  std::shared_mutex tree_lock_;
+  std::string path_;
+  int listen_fd_ = -1;
+  int stop_fd_ = -1; // eventfd, readable when workers must exit
+  std::vector<std::thread> workers_;
+  std::atomic<std::size_t> clients_ = 0;
+  std::atomic<std::size_t> requests_ = 0;
+
+  static bool IsSpace(char ch) {
+    return std::isspace(static_cast<unsigned char>(ch)) != 0;
+  }
+  static std::size_t SkipSpace(std::string_view in, std::size_t pos) {
+    while (pos < in.size() && IsSpace(in[pos])) {
+      ++pos;
+    }
+    return pos;
+  }
+  void Worker(int epoll_fd);
+  void Accept(int epoll_fd, std::unordered_map<int, Client> &clients);
+  // answer complete commands of c.in, false - client must be dropped
+  bool Serve(Client &c);
+  // write pending answers, false - client is gone
+  static bool Flush(int fd, Client &c);
+  void AnswerQueries(std::vector<std::pair<T, T>> &queries, std::string &out);
+  void InsertKeys(std::vector<T> &keys);
+  void AnswerHistogram(const std::vector<T> &boundaries, std::string &out);
+};
+
+template <class T> bool QueryServer<T>::Listen(const std::string &path) {
+  Stop();
+  sockaddr_un addr{};
+  if (path.size() >= sizeof(addr.sun_path)) {
+    return false;
+  }
+  addr.sun_family = AF_UNIX;
+  std::memcpy(addr.sun_path, path.c_str(), path.size() + 1);
+  listen_fd_ = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if (listen_fd_ < 0) {
+    return false;
+  }
+  unlink(path.c_str());
+  if (bind(listen_fd_, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) !=
+          0 ||
+      listen(listen_fd_, SOMAXCONN) != 0) {
+    close(listen_fd_);
+    listen_fd_ = -1;
+    return false;
+  }
+  path_ = path;
+  return true;
+}
+
+template <class T> bool QueryServer<T>::Start(unsigned threads) {
+  if (listen_fd_ < 0 || !workers_.empty()) {
+    return false;
+  }
+  if (threads == 0) {
+    threads = std::max(1u, std::thread::hardware_concurrency());
+  }
+  stop_fd_ = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+  if (stop_fd_ < 0) {
+    return false;
+  }
+  tree_.RefreshTags(); // queries must not write deferred tags
+#if defined(EPOLLEXCLUSIVE)
+  const std::uint32_t kListenEvents = EPOLLIN | EPOLLEXCLUSIVE;
+#else
+  const std::uint32_t kListenEvents = EPOLLIN;
+#endif
+  for (unsigned i = 0; i < threads; ++i) {
+    int epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    epoll_event listen_event{kListenEvents, {}};
+    listen_event.data.fd = listen_fd_;
+    epoll_event stop_event{EPOLLIN, {}};
+    stop_event.data.fd = stop_fd_;
+    if (epoll_fd < 0 ||
+        epoll_ctl(epoll_fd, EPOLL_CTL_ADD, listen_fd_, &listen_event) != 0 ||
+        epoll_ctl(epoll_fd, EPOLL_CTL_ADD, stop_fd_, &stop_event) != 0) {
+      if (epoll_fd >= 0) {
+        close(epoll_fd);
+      }
+      Stop();
+      return false;
+    }
+    workers_.emplace_back(&QueryServer::Worker, this, epoll_fd);
+  }
+  return true;
+}
+
+template <class T> void QueryServer<T>::Stop() {
+  if (stop_fd_ >= 0) {
+    std::uint64_t one = 1;
+    [[maybe_unused]] auto written = write(stop_fd_, &one, sizeof(one));
+  }
+  for (auto &worker : workers_) {
+    worker.join();
+  }
+  workers_.clear();
+  if (stop_fd_ >= 0) {
+    close(stop_fd_);
+    stop_fd_ = -1;
+  }
+  if (listen_fd_ >= 0) {
+    close(listen_fd_);
+    listen_fd_ = -1;
+    unlink(path_.c_str());
+  }
+}
+
+// Level-triggered loop. A client with unwritten answers is only polled for
+// EPOLLOUT, so a client that does not read its answers can not make the
+// server buffer without bound.
+template <class T> void QueryServer<T>::Worker(int epoll_fd) {
+  std::unordered_map<int, Client> clients;
+  epoll_event events[kMaxEvents];
+  auto drop = [epoll_fd, &clients](int fd) {
+    epoll_ctl(epoll_fd, EPOLL_CTL_DEL, fd, nullptr);
+    close(fd);
+    clients.erase(fd);
+  };
+  for (bool running = true; running;) {
+    int ready = epoll_wait(epoll_fd, events, kMaxEvents, -1);
+    for (int i = 0; i < ready; ++i) {
+      int fd = events[i].data.fd;
+      if (fd == stop_fd_) {
+        running = false; // eventfd is not read, so every worker sees it
+        continue;
+      }
+      if (fd == listen_fd_) {
+        Accept(epoll_fd, clients);
+        continue;
+      }
+      Client &c = clients[fd];
+      if (c.out.size() == c.sent) {
+        char buffer[kReadSize];
+        ssize_t got = read(fd, buffer, sizeof(buffer));
+        if (got < 0 && errno == EAGAIN) {
+          continue;
+        }
+        if (got <= 0) {
+          c.eof = true;
+        } else {
+          c.in.append(buffer, static_cast<std::size_t>(got));
+        }
+        if (!Serve(c)) {
+          drop(fd);
+          continue;
+        }
+      }
+      if (!Flush(fd, c)) {
+        drop(fd);
+      } else if (c.out.size() != c.sent) {
+        epoll_event event{EPOLLOUT, {}};
+        event.data.fd = fd;
+        epoll_ctl(epoll_fd, EPOLL_CTL_MOD, fd, &event);
+      } else if (c.eof) {
+        drop(fd);
+      } else if (events[i].events & EPOLLOUT) {
+        epoll_event event{EPOLLIN, {}};
+        event.data.fd = fd;
+        epoll_ctl(epoll_fd, EPOLL_CTL_MOD, fd, &event);
+      }
+    }
+  }
+  for (auto &[fd, c] : clients) {
+    close(fd);
+  }
+  close(epoll_fd);
+}
+
+template <class T>
+void QueryServer<T>::Accept(int epoll_fd,
+                            std::unordered_map<int, Client> &clients) {
+  for (;;) {
+    int fd = accept4(listen_fd_, nullptr, nullptr,
+                     SOCK_NONBLOCK | SOCK_CLOEXEC);
+    if (fd < 0) {
+      return; // EAGAIN - another worker took the client
+    }
+    epoll_event event{EPOLLIN, {}};
+    event.data.fd = fd;
+    if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &event) != 0) {
+      close(fd);
+      continue;
+    }
+    clients[fd] = Client{};
+    ++clients_;
+  }
+}
+
+// Commands are parsed like ProcessInputStream() reads them: whitespace
+// separated, unknown command characters are skipped. A command is complete
+// when its last number is followed by whitespace or by the end of input.
+// Boundaries of an h command are kept in the client as they arrive, so a
+// long one is parsed once and only a partial number waits in c.in.
+template <class T> bool QueryServer<T>::Serve(Client &c) {
+  std::string_view in = c.in;
+  std::size_t pos = 0;
+  auto number = [&in, &pos, &c](auto &value) {
+    pos = SkipSpace(in, pos);
+    std::size_t end = pos;
+    while (end < in.size() && !IsSpace(in[end])) {
+      ++end;
+    }
+    if (end == pos || (end == in.size() && !c.eof)) {
+      return std::errc::resource_unavailable_try_again;
+    }
+    auto [ptr, ec] = std::from_chars(in.data() + pos, in.data() + end, value);
+    pos = end;
+    return ptr == in.data() + end ? ec : std::errc::invalid_argument;
+  };
+  std::vector<std::pair<T, T>> queries;
+  std::vector<T> keys;
+  std::size_t done = 0; // end of last complete command or h boundary
+  bool ok = true;
+  while (ok) {
+    std::errc ec{};
+    if (c.histogram) {
+      while (ec == std::errc{} && c.boundaries.size() <= c.buckets) {
+        T b{};
+        ec = number(b);
+        if (ec == std::errc{} && !c.boundaries.empty() &&
+            b < c.boundaries.back()) {
+          ec = std::errc::invalid_argument;
+        }
+        if (ec == std::errc{}) {
+          c.boundaries.push_back(b);
+          done = pos;
+        }
+      }
+      if (ec == std::errc{}) {
+        c.histogram = false;
+        InsertKeys(keys);
+        AnswerQueries(queries, c.out);
+        AnswerHistogram(c.boundaries, c.out);
+      }
+    } else {
+      pos = SkipSpace(in, pos);
+      if (pos == in.size()) {
+        done = pos;
+        break;
+      }
+      char command = in[pos++];
+      if (command == 'k') {
+        T key{};
+        ec = number(key);
+        if (ec == std::errc{}) {
+          AnswerQueries(queries, c.out);
+          keys.push_back(key);
+        }
+      } else if (command == 'q') {
+        T first{};
+        T second{};
+        ec = number(first);
+        if (ec == std::errc{}) {
+          ec = number(second);
+        }
+        if (ec == std::errc{} && second < first) {
+          ec = std::errc::invalid_argument;
+        }
+        if (ec == std::errc{}) {
+          InsertKeys(keys);
+          queries.emplace_back(first, second);
+        }
+      } else if (command == 'h') {
+        std::size_t buckets = 0;
+        ec = number(buckets);
+        if (ec == std::errc{} && buckets > kMaxBuckets) {
+          ec = std::errc::invalid_argument;
+        }
+        if (ec == std::errc{}) {
+          c.histogram = true;
+          c.buckets = buckets;
+          c.boundaries.clear();
+        }
+      }
+    }
+    if (ec == std::errc::resource_unavailable_try_again) {
+      break;
+    }
+    ok = ec == std::errc{};
+    done = pos;
+  }
+  InsertKeys(keys);
+  AnswerQueries(queries, c.out);
+  c.in.erase(0, done);
+  if (!ok || c.in.size() > kMaxPending) {
+    c.eof = true; // answer what was valid, then drop the client
+    c.in.clear();
+  } else if (c.eof) {
+    c.out += '\n';
+    c.in.clear();
+  }
+  return !c.out.empty() || !c.eof;
+}
+
+template <class T> bool QueryServer<T>::Flush(int fd, Client &c) {
+  while (c.sent < c.out.size()) {
+    ssize_t put = send(fd, c.out.data() + c.sent, c.out.size() - c.sent,
+                       MSG_NOSIGNAL);
+    if (put < 0) {
+      return errno == EAGAIN;
+    }
+    c.sent += static_cast<std::size_t>(put);
+  }
+  c.out.clear();
+  c.sent = 0;
+  return true;
+}
+
+template <class T>
+void QueryServer<T>::AnswerQueries(std::vector<std::pair<T, T>> &queries,
+                                   std::string &out) {
+  if (queries.empty()) {
+    return;
+  }
+  std::vector<int> counts;
+  {
+    std::shared_lock lock(tree_lock_);
+    counts = tree_.count_many(queries);
+  }
+  char text[16];
+  for (int count : counts) {
+    auto end = std::to_chars(text, text + sizeof(text), count).ptr;
+    out.append(text, end);
+    out += ' ';
+  }
+  requests_ += queries.size();
+  queries.clear();
+}
+
+template <class T>
+void QueryServer<T>::AnswerHistogram(const std::vector<T> &boundaries,
+                                     std::string &out) {
+  std::vector<std::size_t> counts;
+  {
+    std::shared_lock lock(tree_lock_);
+    counts = tree_.Histogram(boundaries);
+  }
+  char text[24];
+  for (std::size_t count : counts) {
+    auto end = std::to_chars(text, text + sizeof(text), count).ptr;
+    out.append(text, end);
+    out += ' ';
+  }
+  ++requests_;
+}
+
+template <class T> void QueryServer<T>::InsertKeys(std::vector<T> &keys) {
+  if (keys.empty()) {
+    return;
+  }
+  {
+    std::unique_lock lock(tree_lock_);
+    for (const auto &key : keys) {
+      tree_.insert(key);
+    }
+    tree_.RefreshTags();
+  }
+  requests_ += keys.size();
+  keys.clear();
+}
+
+} // namespace adt
+#endif
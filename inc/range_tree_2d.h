@@ -0,0 +1,254 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <compare>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <thread>
+#include <vector>
+
+#include "simple_adt.h"
+
+namespace adt {
+
+template <class T> struct Point {
+  T x;
+  T y;
+  auto operator<=>(const Point &) const = default;
+};
+
+template <class T>
+// RangeTree2D - counts points in rectangles [x1, x2] x [y1, y2]. The primary
+// level is an Adt<Point<T>> in multiset mode: its shape is copied into an
+// array and Tag bounds give the x range of every subtree. Every node keeps,
+// for each position of its y-sorted points, the matching position among the
+// points of its left child (fractional cascading), so after one binary search
+// at the root a query costs O(1) per visited node, O(log N) in total.
+// Points inserted after a build wait in a pending buffer that queries scan;
+// the tree is rebuilt when the buffer outgrows sqrt(N).
+class RangeTree2D {
+  using Tree = Adt<Point<T>>;
+  using NodePtr = typename Tree::NodePtr;
+  using Index = std::uint32_t;
+  static constexpr Index kNone = std::numeric_limits<Index>::max();
+  static constexpr std::size_t kMinPending = 64;
+  // max depth of the explicit query stack
+  static constexpr std::size_t kMaxStack = 128;
+
+  struct Node {
+    Point<T> point;
+    Index copies; // multiplicity of point
+    Index left;   // child indices, kNone - no child
+    Index right;
+    T x_min; // x range of subtree
+    T x_max;
+    Index own_pos;       // first position of point.y in subtree y order
+    std::size_t cascade; // offset of this node in left_pos_
+  };
+
+public:
+  RangeTree2D() { primary_.SetMultiset(true); }
+  // bulk build, secondary arrays of subtrees are merged by up to threads
+  // threads (0 - hardware concurrency)
+  explicit RangeTree2D(std::vector<Point<T>> points, unsigned threads = 0)
+      : RangeTree2D() {
+    Build(std::move(points), threads);
+  }
+
+  // replace content with points
+  void Build(std::vector<Point<T>> points, unsigned threads = 0);
+  // add one point, it is counted immediately
+  void insert(const Point<T> &p);
+  // rebuild static part with all points
+  void Rebuild(unsigned threads = 0);
+
+  std::size_t size() const { return primary_.size(); }
+  // points inserted after the last build
+  std::size_t PendingSize() const { return pending_.size(); }
+  // bytes used by static part
+  std::size_t MemoryBytes() const {
+    return nodes_.capacity() * sizeof(Node) +
+           ys_.capacity() * sizeof(T) + left_pos_.capacity() * sizeof(Index);
+  }
+  // number of points in [x1, x2] x [y1, y2]
+  std::size_t CountByRect(const T &x1, const T &x2, const T &y1,
+                          const T &y2) const;
+
+private:
+  Tree primary_;
+  std::vector<Node> nodes_;     // primary shape in preorder
+  std::vector<T> ys_;           // y of all built points, sorted
+  std::vector<Index> left_pos_; // cascading positions of all nodes
+  std::vector<Point<T>> pending_;
+
+  // copy shape of primary_ into nodes_ and assign cascade offsets
+  void Flatten();
+  // sorted y of subtree v, fills left_pos_ of its nodes
+  std::vector<T> Cascade(Index v, unsigned threads);
+};
+
+template <class T>
+void RangeTree2D<T>::Build(std::vector<Point<T>> points, unsigned threads) {
+  // sorted input keeps primary_ inserts on the finger path
+  std::sort(points.begin(), points.end());
+  primary_.Clear();
+  for (const auto &p : points) {
+    primary_.insert(p);
+  }
+  Rebuild(threads);
+}
+
+template <class T> void RangeTree2D<T>::insert(const Point<T> &p) {
+  primary_.insert(p);
+  pending_.push_back(p);
+  auto limit = static_cast<std::size_t>(
+      std::sqrt(static_cast<double>(primary_.size())));
+  if (pending_.size() > std::max(limit, kMinPending)) {
+    Rebuild();
+  }
+}
+
+template <class T> void RangeTree2D<T>::Rebuild(unsigned threads) {
+  if (threads == 0) {
+    threads = std::max(1u, std::thread::hardware_concurrency());
+  }
+  pending_.clear();
+  Flatten();
+  ys_ = nodes_.empty() ? std::vector<T>() : Cascade(0, threads);
+}
+
+template <class T> void RangeTree2D<T>::Flatten() {
+  primary_.RefreshTags();
+  nodes_.clear();
+  nodes_.reserve(primary_.nodes_);
+  std::size_t offset = 0;
+  struct Pending {
+    NodePtr node;
+    Index parent; // kNone - root
+    bool right;   // node is right child of parent
+  };
+  InlineStack<Pending, kMaxStack> stack;
+  if (nullptr != primary_.root_) {
+    stack.push_back({primary_.root_, kNone, false});
+  }
+  while (!stack.empty()) {
+    auto [p, parent, right] = stack.back();
+    stack.pop_back();
+    auto v = static_cast<Index>(nodes_.size());
+    if (parent != kNone) {
+      (right ? nodes_[parent].right : nodes_[parent].left) = v;
+    }
+    nodes_.push_back({p->avl_data_, p->avl_count_, kNone, kNone,
+                      p->tag_.bound_[0]->avl_data_.x,
+                      p->tag_.bound_[1]->avl_data_.x, 0, offset});
+    offset += p->tag_.count_ + 1;
+    if (nullptr != p->avl_link_[1]) {
+      stack.push_back({p->avl_link_[1], v, true});
+    }
+    if (nullptr != p->avl_link_[0]) {
+      stack.push_back({p->avl_link_[0], v, false});
+    }
+  }
+  left_pos_.assign(offset, 0);
+}
+
+// Children are merged first; with more than one thread the left subtree is
+// built by a new thread, and each side gets half of the budget.
+template <class T>
+std::vector<T> RangeTree2D<T>::Cascade(Index v, unsigned threads) {
+  Node &node = nodes_[v];
+  std::vector<T> left;
+  std::vector<T> right;
+  if (threads > 1 && node.left != kNone && node.right != kNone) {
+    std::thread worker([this, &left, &node, threads] {
+      left = Cascade(node.left, threads / 2);
+    });
+    right = Cascade(node.right, threads - threads / 2);
+    worker.join();
+  } else {
+    if (node.left != kNone) {
+      left = Cascade(node.left, 1);
+    }
+    if (node.right != kNone) {
+      right = Cascade(node.right, 1);
+    }
+  }
+  std::vector<T> ys(left.size() + right.size() + node.copies);
+  auto out = std::merge(left.begin(), left.end(), right.begin(), right.end(),
+                        ys.begin());
+  std::fill(out, ys.end(), node.point.y);
+  std::inplace_merge(ys.begin(), out, ys.end());
+  node.own_pos = static_cast<Index>(
+      std::lower_bound(ys.begin(), ys.end(), node.point.y) - ys.begin());
+  // left_pos_[i] - number of left items less than ys[i]
+  Index *pos = left_pos_.data() + node.cascade;
+  std::size_t l = 0;
+  for (std::size_t i = 0; i < ys.size(); ++i) {
+    while (l < left.size() && left[l] < ys[i]) {
+      ++l;
+    }
+    pos[i] = static_cast<Index>(l);
+  }
+  pos[ys.size()] = static_cast<Index>(left.size());
+  return ys;
+}
+
+// Positions lo, hi bound the query y range among points of a node. Positions
+// of right child follow from the left ones: own copies of a node lie before
+// every position greater than own_pos.
+template <class T>
+std::size_t RangeTree2D<T>::CountByRect(const T &x1, const T &x2, const T &y1,
+                                        const T &y2) const {
+  if (x2 < x1 || y2 < y1) {
+    return 0;
+  }
+  std::size_t result = 0;
+  for (const auto &p : pending_) {
+    result += x1 <= p.x && p.x <= x2 && y1 <= p.y && p.y <= y2;
+  }
+  if (nodes_.empty()) {
+    return result;
+  }
+  struct Frame {
+    Index v;
+    Index lo;
+    Index hi;
+  };
+  InlineStack<Frame, kMaxStack> stack;
+  stack.push_back(
+      {0,
+       static_cast<Index>(std::lower_bound(ys_.begin(), ys_.end(), y1) -
+                          ys_.begin()),
+       static_cast<Index>(std::upper_bound(ys_.begin(), ys_.end(), y2) -
+                          ys_.begin())});
+  while (!stack.empty()) {
+    auto [v, lo, hi] = stack.back();
+    stack.pop_back();
+    const Node &node = nodes_[v];
+    if (lo >= hi || node.x_max < x1 || x2 < node.x_min) {
+      continue;
+    }
+    if (!(node.x_min < x1) && !(x2 < node.x_max)) { // whole subtree in x
+      result += hi - lo;
+      continue;
+    }
+    const Point<T> &p = node.point;
+    if (x1 <= p.x && p.x <= x2 && y1 <= p.y && p.y <= y2) {
+      result += node.copies;
+    }
+    const Index *pos = left_pos_.data() + node.cascade;
+    if (node.left != kNone) {
+      stack.push_back({node.left, pos[lo], pos[hi]});
+    }
+    if (node.right != kNone) {
+      auto right = [&node, pos](Index i) {
+        return i - pos[i] - (i > node.own_pos ? node.copies : 0);
+      };
+      stack.push_back({node.right, right(lo), right(hi)});
+    }
+  }
+  return result;
+}
+
+} // namespace adt
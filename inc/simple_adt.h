@@ -1,55 +1,164 @@
 #pragma once
 #include <algorithm>
+#include <bit>
 #include <cassert>
 #include <compare>
+#include <cstdint>
+#include <functional> // less
 #include <cstddef>
+#include <cstring> // memcpy
 #include <ios>      // boolalpha
 #include <iostream> //
 #include <iterator> //
+#include <limits>
 #include <memory>
+#include <span>
+#include <type_traits>
 #include <utility>
 #include <vector>
 
+#if defined(__GLIBC__)
+#include <malloc.h> // malloc_trim
+#endif
+
+#include "frozen_adt.h"
+
 #define my_debug
 
 namespace adt {
 
-template <class T> bool Intersect(T str1, T end1, T str2, T end2) {
-  T str_max = std::max(str1, str2);
-  T end_min = std::min(end1, end2);
+template <class T>
+bool Intersect(const T &str1, const T &end1, const T &str2, const T &end2) {
+  const T &str_max = std::max(str1, str2);
+  const T &end_min = std::min(end1, end2);
   return str_max <= end_min;
 }
+// Fixed-capacity stack stored inside of its owner. Paths in Adt are bounded by
+// tree height, so they never need heap memory.
+template <class T, std::size_t N> class InlineStack {
+  static_assert(std::is_trivially_copyable_v<T>);
+  T data_[N];
+  std::size_t size_ = 0;
+
+public:
+  using value_type = T;
+  using const_iterator = const T *;
+  using const_reverse_iterator = std::reverse_iterator<const_iterator>;
+
+  InlineStack() {}
+  // only used part of storage is copied
+  InlineStack(const InlineStack &other) : size_(other.size_) {
+    std::copy_n(other.data_, size_, data_);
+  }
+  InlineStack &operator=(const InlineStack &other) {
+    size_ = other.size_;
+    std::copy_n(other.data_, size_, data_);
+    return *this;
+  }
+  bool operator==(const InlineStack &rhs) const {
+    return std::equal(begin(), end(), rhs.begin(), rhs.end());
+  }
+
+  std::size_t size() const { return size_; }
+  bool empty() const { return size_ == 0; }
+  void clear() { size_ = 0; }
+  void resize(std::size_t n) {
+    assert(n <= N);
+    for (; size_ < n; ++size_) {
+      data_[size_] = T{};
+    }
+    size_ = n;
+  }
+  void push_back(const T &t) {
+    assert(size_ < N);
+    data_[size_++] = t;
+  }
+  void emplace_back(const T &t) { push_back(t); }
+  void pop_back() { --size_; }
+  T &back() { return data_[size_ - 1]; }
+  const T &back() const { return data_[size_ - 1]; }
+  T &operator[](std::size_t i) { return data_[i]; }
+  const T &operator[](std::size_t i) const { return data_[i]; }
+  const_iterator begin() const { return data_; }
+  const_iterator end() const { return data_ + size_; }
+  const_reverse_iterator crbegin() const {
+    return const_reverse_iterator(end());
+  }
+  const_reverse_iterator crend() const {
+    return const_reverse_iterator(begin());
+  }
+};
+
+// FNV-1a hash of n bytes at p continuing from hash, checksum of snapshots
+constexpr std::uint64_t kFnvOffset = 14695981039346656037ull;
+inline std::uint64_t Fnv1a(const void *p, std::size_t n,
+                           std::uint64_t hash = kFnvOffset) {
+  const unsigned char *bytes = static_cast<const unsigned char *>(p);
+  for (std::size_t i = 0; i < n; ++i) {
+    hash = (hash ^ bytes[i]) * 1099511628211ull;
+  }
+  return hash;
+}
+
+// Extra summary kept in Tag of every node. Specialize it for a key type to
+// augment the tree: Update folds the node key with summaries of its children
+// (nullptr - no child). The empty default takes no space.
+template <class T> struct AdtTagExtra {
+  void Update(const T &, const AdtTagExtra *, const AdtTagExtra *) {}
+};
+
+template <class T> class IntervalAdt;
+template <class T> class RangeTree2D;
+class StringAdt;
+
 template <class T>
 // ADT -  Abstract Data Table
 class Adt {
   static constexpr std::size_t kMaxStack = 64;
-  static constexpr std::size_t kLeft = 0;
-  static constexpr std::size_t kRight = 1;
-  static constexpr std::size_t kLeaf = 2;
+  // number of descents advanced in lock-step by batched lookups
+  static constexpr std::size_t kLanes = 16;
+  // count_many() walks the tree once when ranges * kSortedRatio >= size();
+  // smaller batches gain more from overlapped cache misses of descents
+  static constexpr std::size_t kSortedRatio = 8;
 
   struct AvlNode;
 
   using NodePtr = AvlNode *;
-  using NodePtrStack = std::vector<NodePtr>;
-  using TraceNode = std::pair<NodePtr, int>;
-  using TraceNodeStack = std::vector<TraceNode>;
-  using DirectionStack = std::vector<int>;
+  using NodePtrStack = InlineStack<NodePtr, kMaxStack>;
+  using IndexStack = InlineStack<int, kMaxStack>;
 
   using reference = T &;
 
+  // ShiftFrom() needs keys that can be added; other key types keep no shift
+  // state at all
+  static constexpr bool kShiftable =
+      std::is_arithmetic_v<T> && !std::is_same_v<T, bool>;
+  struct NoShift {};
+  using Shift = std::conditional_t<kShiftable, T, NoShift>;
+  // Nodes with the lowest and the highest key of a subtree. Arithmetic keys
+  // are kept by value instead, without pending shifts of the node and its
+  // ancestors: such a bound stays valid when shifts below are pushed down,
+  // and range counts read it without visiting the bound node.
+  using Bound = std::conditional_t<kShiftable, T, NodePtr>;
+
   struct Tag {
-    NodePtr bound_[2] = {nullptr, nullptr}; // child range bounds
-    std::size_t count_ = 0;                 // child counter
+    Bound bound_[2] = {};   // child range bounds
+    std::size_t count_ = 0; // items in subtree
+    [[no_unique_address]] AdtTagExtra<T> extra_;
     void Update(NodePtr node);
   };
 
   struct AvlNode {
     NodePtr avl_link_[2]; // subtrees
     signed char avl_balance_ = 0;
+    bool tag_dirty_ = false; // tag_ must be recomputed (deferred tags mode)
+    std::uint32_t avl_count_ = 1; // multiplicity of avl_data_ (multiset mode)
     T avl_data_;
+    // added to every key of the subtree, avl_data_ included (ShiftFrom)
+    [[no_unique_address]] Shift avl_shift_{};
     Tag tag_;
     AvlNode(T data, AvlNode *left = nullptr, AvlNode *right = nullptr)
-        : avl_link_{left, right}, avl_data_(data) {}
+        : avl_link_{left, right}, avl_data_(std::move(data)) {}
     void Update() { tag_.Update(this); }
   };
 
@@ -57,22 +166,16 @@ public:
   class Iterator {
     const Adt *ptr_ = nullptr;
     NodePtrStack stack_;
-
-    void ReserveStackCapacity(std::size_t cap = kMaxStack) {
-      stack_.reserve(cap);
-    }
+    std::uint32_t dup_ = 0; // copy of stack_.back() key (multiset mode)
 
     Iterator() = delete;
 
     explicit Iterator(const Adt *p) : ptr_(p) {}
 
-    Iterator(const Adt *p, NodePtrStack &&stack)
-        : ptr_(p), stack_(std::move(stack)) {}
+    Iterator(const Adt *p, const NodePtrStack &stack)
+        : ptr_(p), stack_(stack) {}
 
-    Iterator(const Adt *p, NodePtr ptr) : ptr_(p) {
-      ReserveStackCapacity();
-      stack_.push_back(ptr);
-    }
+    Iterator(const Adt *p, NodePtr ptr) : ptr_(p) { stack_.push_back(ptr); }
 
   public:
     using iterator_category = std::bidirectional_iterator_tag;
@@ -92,7 +195,7 @@ public:
       if (ptr_ != nullptr) {
         return result;
       }
-      result.reserve(kMaxStack);
+      result.reserve(stack_.size());
       for (const auto p : stack_) {
         result.emplace_back(p->avl_data_);
       }
@@ -100,14 +203,26 @@ public:
     }
 
     bool static is_equal(const Iterator &lhs, const Iterator &rhs) {
-      return lhs.ptr_ == rhs.ptr_ && lhs.stack_ == rhs.stack_;
+      return lhs.ptr_ == rhs.ptr_ && lhs.dup_ == rhs.dup_ &&
+             lhs.stack_ == rhs.stack_;
     }
 
     bool operator==(const Iterator &rhs) const { return is_equal(*this, rhs); }
 
     Iterator &operator++() {
+      if (!stack_.empty() && dup_ + 1 < stack_.back()->avl_count_) {
+        ++dup_; // next copy of the same key
+        return *this;
+      }
+      return NextNode();
+    }
+
+  private:
+    // move to the first copy of the next key
+    Iterator &NextNode() {
       // actual increment takes place here
       NodePtr p = nullptr;
+      dup_ = 0;
       if (stack_.empty()) {
         return *this;
       }
@@ -116,6 +231,7 @@ public:
         p = stack_.back()->avl_link_[1];
         // and now move to left node (smallest)
         while (p != nullptr) {
+          PushShift(p);
           stack_.emplace_back(p);
           p = p->avl_link_[0];
         }
@@ -133,6 +249,7 @@ public:
       return *this; // return new value by reference
     }
 
+  public:
     Iterator operator++(int) {
       Iterator retval = *this;
       ++(*this);
@@ -145,14 +262,20 @@ public:
         *this = ptr_->pre_end();
         return *this;
       }
+      if (dup_ > 0) {
+        --dup_;
+        return *this;
+      }
       // try to move left
       if (stack_.back()->avl_link_[0] != nullptr) {
         p = stack_.back()->avl_link_[0];
         // and now move right to bigest child
         while (p != nullptr) {
+          PushShift(p);
           stack_.emplace_back(p);
           p = p->avl_link_[1];
         }
+        dup_ = stack_.back()->avl_count_ - 1;
         return *this;
       }
 
@@ -163,6 +286,9 @@ public:
         p = stack_.back();
         stack_.pop_back();
       }
+      if (!stack_.empty()) {
+        dup_ = stack_.back()->avl_count_ - 1;
+      }
       return *this;
     }
 
@@ -180,6 +306,7 @@ public:
 
 public:
   Adt() {}
+  // number of items, copies of keys included
   std::size_t size() const;
   // Inserts element(s) into the container, if the container doesn't already
   // contain an element with an equivalent key.
@@ -190,10 +317,17 @@ public:
   // Inserts element(s) into the container, if the container doesn't already
   // contain an element with an equivalent key.
   InsertResult insert(const T &t);
-  // Removes the element (if one exists) with the key equivalent to key.
+  // Inserts element using hint iterator as a starting point of the search.
+  InsertResult insert(const Iterator &hint, const T &t);
+  // Removes the element (one copy in multiset mode) with the key equivalent
+  // to key, returns iterator to the next item. Iterators to other items are
+  // invalidated.
   Iterator Erase(const T &t);
-  // Removes the element at pos.
+  // Removes the element at pos, pos and the result point to the next item.
   Iterator Erase(Iterator &pos);
+  // Erase(key) without building the result iterator, returns number of
+  // removed items (0 or 1)
+  std::size_t erase(const T &t);
   // find node equal key , if not found = return end()
   Iterator find(const T &key) const;
   // clear Atd
@@ -206,8 +340,87 @@ public:
   std::vector<T> GetInorderVector() const;
   // get vector of avl_balance for all nodes in inorder
   std::vector<int> GetInorderAvlBalanceVector() const;
+  // immutable pointer-free snapshot for read-only workloads
+  FrozenAdt<T> Freeze() const { return FrozenAdt<T>(GetInorderVector()); }
+  // bytes used by nodes
+  std::size_t MemoryBytes() const { return nodes_ * sizeof(AvlNode); }
+  // In multiset mode inserting an existing key increments the multiplicity
+  // of its node: one descent, no allocation. Counts, rank, select and
+  // iterators see every copy. Switching the mode off keeps stored copies.
+  // A key holds at most UINT32_MAX copies, insert of one more returns false.
+  void SetMultiset(bool multiset) { multiset_ = multiset; }
+  bool Multiset() const { return multiset_; }
+  // number of copies of key
+  std::size_t count(const T &key) const;
+  // Move all nodes into one contiguous block in depth-first (preorder) order,
+  // so that a descent walks forward in memory and left children share cache
+  // lines with parents. Shape and balance factors are kept, tags are rebuilt
+  // in the same O(N) pass. release_memory - return freed heap pages to the OS.
+  void Compact(bool release_memory = false);
+  // Binary snapshot: versioned header, nodes in preorder with keys, balance
+  // and child bits, FNV-1a checksum. Keys are stored as raw bytes in native
+  // byte order, so T must be trivially copyable. Loading places nodes into one
+  // block (see Compact()) in a single pass without comparisons or rotations.
+  bool SaveSnapshot(std::ostream &os) const;
+  // Snapshot of a balanced tree of sorted keys, equal keys are one node with
+  // their count: a copy of the keys is enough to write a snapshot later or on
+  // another thread. false if a key repeats more than UINT32_MAX times.
+  static bool SaveSnapshot(std::ostream &os, std::span<const T> sorted,
+                           bool multiset);
+  // Replace content with snapshot read from is to its end. On error (bad
+  // checksum, version or key size, broken shape or balance factors) return
+  // false and keep the tree unchanged.
+  bool LoadSnapshot(std::istream &is);
+  // Same for snapshot bytes already in memory, e.g. a memory-mapped file.
+  bool LoadSnapshot(std::span<const char> data);
   // count items in range
-  int CountByRange(T first, T second) const;
+  int CountByRange(const T &first, const T &second) const;
+  // Batched lookups: descents for several keys advance in lock-step and
+  // prefetch next nodes, so cache misses of different keys overlap.
+  // find() for every key
+  std::vector<Iterator> find_many(std::span<const T> keys) const;
+  // lower_bound() for every key
+  std::vector<Iterator> lower_bound_many(std::span<const T> keys) const;
+  // CountByRange() for every range. A batch that is large relative to
+  // size() is answered by count_many_sorted(), a smaller one by interleaved
+  // descents.
+  std::vector<int> count_many(std::span<const std::pair<T, T>> ranges) const;
+  // CountByRange() for every range by one walk: sorted range ends are split
+  // between subtrees top-down, so a node shared by many descents is visited
+  // once. O(Q log Q + min(N, Q log(N / Q))) for Q ranges.
+  std::vector<int>
+  count_many_sorted(std::span<const std::pair<T, T>> ranges) const;
+  // Counts of buckets [b0, b1), [b1, b2), ... for boundaries b0 <= b1 <= ...
+  // by one walk like count_many_sorted(), O(B + B log(N / B)) for B buckets.
+  // Empty result if boundaries decrease.
+  std::vector<std::size_t> Histogram(std::span<const T> boundaries) const;
+  // call f(item) for every item in range in ascending order
+  template <class F>
+  void for_each_in_range(const T &first, const T &second, F f) const;
+  // append items in range to out
+  void copy_range(const T &first, const T &second, std::vector<T> &out) const;
+  // number of elements less than v
+  std::size_t rank(const T &v) const;
+  // k-th smallest element (0-based), if k >= size() = return end()
+  Iterator select(std::size_t k) const;
+  // In deferred tags mode probe only marks the touched path dirty; counts and
+  // bounds are recomputed on the first query that needs them.
+  void SetDeferredTags(bool deferred);
+  bool DeferredTags() const { return deferred_tags_; }
+  // recompute tags of all dirty subtrees in one bottom-up pass, then apply
+  // shifts left pending by ShiftFrom() (O(N) once after shifts): const calls
+  // do not write to the tree afterwards and may run concurrently
+  void RefreshTags() const;
+  // Add delta >= 0 to every key not less than key in O(log N): the shift of
+  // whole subtrees stays pending in their roots and is pushed down to the
+  // children by the next descent that enters them, so all lookups, bounds and
+  // iterators see shifted keys. Needs an arithmetic key type. Iterators are
+  // invalidated. Lookups push pending shifts into the nodes they pass, so
+  // even const calls write to the tree until RefreshTags() applies them:
+  // call it before reading from several threads.
+  // false - negative delta or a shifted key would overflow, nothing is
+  // changed.
+  bool ShiftFrom(const T &key, T delta);
   // find first element not less than v
   Iterator lower_bound(const T &v) const;
   // find first element greater than v
@@ -215,31 +428,76 @@ public:
   // get last element v
   Iterator pre_end() const {
     NodePtrStack result;
-    result.reserve(kMaxStack);
     NodePtr p = root_;
     while (nullptr != p) {
+      PushShift(p);
       result.emplace_back(p);
       p = p->avl_link_[1];
     }
-    return Iterator(this, std::move(result));
+    auto last = Iterator(this, result);
+    if (!result.empty()) {
+      last.dup_ = result.back()->avl_count_ - 1;
+    }
+    return last;
   }
 
   Iterator begin() const {
     NodePtrStack result;
-    result.reserve(kMaxStack);
     NodePtr p = root_;
     while (nullptr != p) {
+      PushShift(p);
       result.emplace_back(p);
       p = p->avl_link_[0];
     }
-    return Iterator(this, std::move(result));
+    return Iterator(this, result);
   }
   Iterator end() const { return Iterator(this); }
   ~Adt() { Clear(); }
 
 private:
+  // walk nodes and tags of Adt<Interval<U>>, Adt<Point<U>> and
+  // Adt<StringKey>
+  template <class U> friend class IntervalAdt;
+  template <class U> friend class RangeTree2D;
+  friend class StringAdt;
+
   AvlNode *root_ = nullptr;
-  std::size_t size_ = 0ul;
+  std::size_t size_ = 0ul;  // items
+  std::size_t nodes_ = 0ul; // distinct keys
+  bool multiset_ = false;
+  bool deferred_tags_ = false;
+  mutable bool tags_dirty_ = false;
+  mutable bool shifts_pending_ = false; // ShiftFrom() since RefreshTags()
+  // Last insertion path. finger_lower_/finger_upper_ keep, for every node of
+  // the path, index of the nearest ancestor bounding its subtree keys from
+  // below/above (-1 - unbounded).
+  NodePtrStack finger_;
+  IndexStack finger_lower_;
+  IndexStack finger_upper_;
+  // Nodes placed by Compact(). They are destroyed one by one, but memory is
+  // freed as a whole by the next Compact() or Clear().
+  AvlNode *slab_ = nullptr;
+  std::size_t slab_size_ = 0;
+
+  static constexpr std::uint32_t kSnapshotVersion = 1;
+  // bytes written to stream at once by SaveSnapshot
+  static constexpr std::size_t kSnapshotChunk = 1 << 16;
+  // snapshot record: flags byte, key, avl_count_ if kHasCount
+  enum SnapshotFlags : unsigned char {
+    kHasLeft = 1,
+    kHasRight = 2,
+    kBalanceShift = 2, // two bits of avl_balance_ + 1
+    kHasCount = 16,
+  };
+  struct SnapshotHeader {
+    char magic[4];
+    std::uint32_t version;
+    std::uint32_t key_size;
+    std::uint32_t multiset;
+    std::uint64_t nodes;
+    std::uint64_t items;
+  };
+  class SnapshotWriter;
 
 private:
   // In-order traversing tree
@@ -250,15 +508,71 @@ private:
   template <class O> void PostorderTraverse(NodePtr p, O o);
   // Update tags
   void UpdateTags(const NodePtrStack &stack);
+  // Update tag of one node or mark it dirty in deferred tags mode
+  void UpdateNode(NodePtr p);
+  // number of elements in subtree
+  static std::size_t Count(NodePtr p) { return p ? p->tag_.count_ : 0; }
+  // Apply pending shift of p to its key and tag, pass it on to the children.
+  // Every descent calls it on entering a node, so keys of visited nodes and
+  // their ancestors are exact.
+  static void PushShift(NodePtr p) {
+    if constexpr (kShiftable) {
+      const T delta = p->avl_shift_;
+      if (delta != T{}) {
+        p->avl_data_ += delta;
+        p->tag_.bound_[0] += delta;
+        p->tag_.bound_[1] += delta;
+        for (NodePtr child : p->avl_link_) {
+          if (nullptr != child) {
+            child->avl_shift_ += delta;
+          }
+        }
+        p->avl_shift_ = T{};
+      }
+    }
+  }
+  // key of the lowest (0) or highest (1) item of subtree p, p is pushed
+  static const T &BoundKey(NodePtr p, int i) {
+    if constexpr (kShiftable) {
+      return p->tag_.bound_[i];
+    } else {
+      return p->tag_.bound_[i]->avl_data_;
+    }
+  }
+  static void Prefetch(const AvlNode *p) {
+#if defined(__GNUC__)
+    __builtin_prefetch(p);
+#endif
+  }
+  // Run n descents from root, kLanes at a time. step(i, p) handles node p of
+  // descent i and returns next node, nullptr - descent finished.
+  template <class Step> void Interleave(std::size_t n, Step step) const;
+  // Ranks of n sorted keys by one walk from root. left(i, p) - key i belongs
+  // to the left subtree of p, it must hold for a prefix of keys; out(i, rank)
+  // receives the number of items to the left of key i.
+  template <class Left, class Out>
+  void SplitWalk(std::size_t n, Left left, Out out) const;
+  // number of finger nodes to keep before searching position of data
+  std::size_t FingerDepth(const T &data) const;
+  void PushFinger(NodePtr p);
+  void PopFinger(std::size_t depth);
+  void SetFinger(const NodePtrStack &path);
   // get begin() iterator from root node
   void GetFirstItem(NodePtr root, NodePtrStack &result);
+  static bool InBlock(const AvlNode *p, const AvlNode *block, std::size_t n) {
+    std::less<const AvlNode *> less;
+    return nullptr != block && !less(p, block) && less(p, block + n);
+  }
+  // destroy node, free its memory unless it lives in the slab
+  void DeleteNode(NodePtr p);
+  void FreeSlab();
 
-  void DumpTraceNodeStack(std::ostream &os, TraceNodeStack &tns);
 }; // class Adt
 
 template <class T> std::size_t Adt<T>::size() const { return size_; }
 // save tree to .dot file
 template <class T> void Adt<T>::save_dot(std::ostream &os, const Adt &tree) {
+  tree.RefreshTags();
   os << "digraph Groove{\n";
   os << "  node [shape = record,height = .1];\n";
   // print nodes
@@ -271,11 +585,7 @@ template <class T> void Adt<T>::save_dot(std::ostream &os, const Adt &tree) {
        << "\\n"
        << p->tag_.count_ << "\\n [";
     for (int i = 0; i < 2; ++i) {
-      if (p->tag_.bound_[i] == nullptr) {
-        os << " - ";
-      } else {
-        os << " " << p->tag_.bound_[i]->avl_data_ << " ";
-      }
+      os << " " << BoundKey(p, i) << " ";
       if (i == 0) {
         os << " ; ";
       }
@@ -307,7 +617,7 @@ template <class T> std::vector<T> Adt<T>::GetInorderVector() const {
     if (nullptr == p) {
       return;
     }
-    result.emplace_back(p->avl_data_);
+    result.insert(result.end(), p->avl_count_, p->avl_data_);
   });
   return result;
 }
@@ -315,7 +625,7 @@ template <class T> std::vector<T> Adt<T>::GetInorderVector() const {
 // get items vector in preorder traverse
 template <class T> std::vector<T> Adt<T>::GetPreorderVector() const {
   std::vector<T> result;
-  result.reserve(size());
+  result.reserve(nodes_);
   PreorderTraverse(root_, [&result](const NodePtr p) {
     if (nullptr == p) {
       return;
@@ -342,36 +652,25 @@ template <class T> std::vector<int> Adt<T>::GetInorderAvlBalanceVector() const {
 template <class T>
 template <class O>
 void Adt<T>::PostorderTraverse(typename Adt<T>::NodePtr node, O o) {
-  NodePtr p;
-  std::size_t dir;
-  TraceNodeStack stack;
-  stack.reserve(kMaxStack * 3);
-  p = node;
-  if (nullptr == node) {
-    return;
-  }
-  stack.emplace_back(p, kLeaf);  // check own node
-  stack.emplace_back(p, kRight); // check right link
-  stack.emplace_back(p, kLeft);  // check left link
-
-  while (!stack.empty()) {
-    TraceNode tp = stack.back();
-    p = tp.first;
-    dir = tp.second;
-    stack.pop_back();
+  NodePtrStack stack; // one entry per level
+  NodePtr last = nullptr;
+  NodePtr p = node;
+  while (nullptr != p || !stack.empty()) {
+    if (nullptr != p) { // check left link
+      stack.push_back(p);
+      p = p->avl_link_[0];
+      continue;
+    }
+    NodePtr top = stack.back();
+    if (nullptr != top->avl_link_[1] && last != top->avl_link_[1]) {
+      p = top->avl_link_[1]; // check right link
+    } else {                 // check own node
 #ifdef my_debug_1
-    std::cerr << "Current node:" << p->avl_data_ << " direction :" << dir
-              << "\n";
+      std::cerr << "Current node:" << top->avl_data_ << "\n";
 #endif
-    if (kLeaf == dir) {
-      o(p);
-    } else {
-      if (nullptr != p->avl_link_[dir]) {
-        p = p->avl_link_[dir];
-        stack.emplace_back(p, kLeaf);  // check own node
-        stack.emplace_back(p, kRight); // check right link
-        stack.emplace_back(p, kLeft);  // check left link
-      }
+      o(top);
+      last = top;
+      stack.pop_back();
     }
   }
 }
@@ -380,37 +679,22 @@ void Adt<T>::PostorderTraverse(typename Adt<T>::NodePtr node, O o) {
 template <class T>
 template <class O>
 void Adt<T>::PreorderTraverse(typename Adt<T>::NodePtr node, O o) const {
-  NodePtr p;
-  std::size_t dir;
-  TraceNodeStack stack;
-  stack.reserve(kMaxStack * 3);
-  p = node;
-  if (nullptr == node) {
-    return;
-  }
-  stack.emplace_back(p, kRight); // check right link
-  stack.emplace_back(p, kLeft);  // check left link
-  stack.emplace_back(p, kLeaf);  // check own node
-
-  while (!stack.empty()) {
-    TraceNode tp = stack.back();
-    p = tp.first;
-    dir = tp.second;
-    stack.pop_back();
+  NodePtrStack stack; // right links to check, one per level
+  NodePtr p = node;
+  while (nullptr != p || !stack.empty()) {
+    if (nullptr == p) {
+      p = stack.back();
+      stack.pop_back();
+    }
+    PushShift(p);
 #ifdef my_debug_1
-    std::cerr << "Current node:" << p->avl_data_ << " direction :" << dir
-              << "\n";
+    std::cerr << "Current node:" << p->avl_data_ << "\n";
 #endif
-    if (kLeaf == dir) {
-      o(p);
-    } else {
-      if (nullptr != p->avl_link_[dir]) {
-        p = p->avl_link_[dir];
-        stack.emplace_back(p, kRight); // check right link
-        stack.emplace_back(p, kLeft);  // check left link
-        stack.emplace_back(p, kLeaf);  // check own node
-      }
+    o(p); // check own node
+    if (nullptr != p->avl_link_[1]) {
+      stack.push_back(p->avl_link_[1]);
     }
+    p = p->avl_link_[0]; // check left link
   }
 }
 //
@@ -423,7 +707,7 @@ template <class T> void Adt<T>::Clear() {
   for (p = root_; nullptr != p; p = q) {
     if (nullptr == p->avl_link_[0]) { // we have only right child
       q = p->avl_link_[1];
-      delete p;
+      DeleteNode(p);
     } else {               // rotate right
       q = p->avl_link_[0]; // new root
       p->avl_link_[0] = q->avl_link_[1];
@@ -431,84 +715,383 @@ template <class T> void Adt<T>::Clear() {
     }
   }
   size_ = 0;
+  nodes_ = 0;
   root_ = nullptr;
+  tags_dirty_ = false;
+  shifts_pending_ = false;
+  PopFinger(0);
+  FreeSlab();
 }
 
-// In-order traverse and free nodes
-template <class T>
-template <class O>
-void Adt<T>::InorderTraverse(typename Adt<T>::NodePtr node, O o) const {
-  NodePtr p;
-  std::size_t dir;
-  TraceNodeStack stack;
-  stack.reserve(kMaxStack * 3);
-  p = node;
-  if (nullptr == node) {
-    return;
+template <class T> void Adt<T>::DeleteNode(NodePtr p) {
+  if (InBlock(p, slab_, slab_size_)) {
+    std::destroy_at(p);
+  } else {
+    delete p;
   }
-  stack.emplace_back(p, kRight); // check right link
-  stack.emplace_back(p, kLeaf);  // check own node
-  stack.emplace_back(p, kLeft);  // check left link
+}
+
+template <class T> void Adt<T>::FreeSlab() {
+  if (nullptr != slab_) {
+    std::allocator<AvlNode>().deallocate(slab_, slab_size_);
+  }
+  slab_ = nullptr;
+  slab_size_ = 0;
+}
 
+// Preorder copy: a node is placed before its subtrees, so walking the new
+// block backwards visits children before parents and rebuilds tags.
+// Old nodes are released as soon as they are copied.
+template <class T> void Adt<T>::Compact(bool release_memory) {
+  AvlNode *old_slab = slab_;
+  std::size_t old_slab_size = slab_size_;
+  slab_ = nullptr;
+  slab_size_ = 0;
+  AvlNode *block =
+      nodes_ == 0 ? nullptr : std::allocator<AvlNode>().allocate(nodes_);
+  // Step 1 : copy nodes in preorder, stack keeps pending right subtrees
+  std::size_t next = 0;
+  struct Pending {
+    NodePtr node;
+    NodePtr *link; // where to store the copy
+  };
+  InlineStack<Pending, kMaxStack> stack;
+  if (nullptr != root_) {
+    stack.push_back({root_, &root_});
+  }
   while (!stack.empty()) {
-    TraceNode tp = stack.back();
-    p = tp.first;
-    dir = tp.second;
+    auto [p, link] = stack.back();
     stack.pop_back();
-#ifdef my_debug_1
-    std::cerr << "Current node:" << p->avl_data_ << " direction :" << dir
-              << "\n";
-#endif
-    if (kLeaf == dir) {
-      o(p);
+    PushShift(p);
+    NodePtr q = std::construct_at(block + next++, std::move(p->avl_data_));
+    q->avl_balance_ = p->avl_balance_;
+    q->avl_count_ = p->avl_count_;
+    *link = q;
+    if (nullptr != p->avl_link_[1]) {
+      stack.push_back({p->avl_link_[1], &q->avl_link_[1]});
+    }
+    if (nullptr != p->avl_link_[0]) {
+      stack.push_back({p->avl_link_[0], &q->avl_link_[0]});
+    }
+    if (InBlock(p, old_slab, old_slab_size)) {
+      std::destroy_at(p);
     } else {
-      if (nullptr != p->avl_link_[dir]) {
-        p = p->avl_link_[dir];
-        stack.emplace_back(p, kRight); // check right link
-        stack.emplace_back(p, kLeaf);  // check own node
-        stack.emplace_back(p, kLeft);  // check left link
+      delete p;
+    }
+  }
+  assert(next == nodes_);
+  if (nullptr != old_slab) {
+    std::allocator<AvlNode>().deallocate(old_slab, old_slab_size);
+  }
+  slab_ = block;
+  slab_size_ = nodes_;
+  // Step 2 : rebuild tags bottom-up, pending deferred updates included
+  for (std::size_t i = nodes_; i > 0; --i) {
+    block[i - 1].Update();
+  }
+  tags_dirty_ = false;
+  shifts_pending_ = false; // the copy pushed them all
+  PopFinger(0); // finger pointed to old nodes
+#if defined(__GLIBC__)
+  if (release_memory) {
+    malloc_trim(0);
+  }
+#else
+  (void)release_memory;
+#endif
+}
+
+// Snapshot bytes go to the stream in chunks, the checksum follows them.
+template <class T> class Adt<T>::SnapshotWriter {
+public:
+  SnapshotWriter(std::ostream &os, const SnapshotHeader &header) : os_(os) {
+    buffer_.reserve(kSnapshotChunk + sizeof(SnapshotHeader) + sizeof(T) + 8);
+    Put(&header, sizeof(header));
+  }
+  void Node(const T &key, bool left, bool right, int balance,
+            std::uint32_t count) {
+    unsigned char flags = static_cast<unsigned char>(
+        (left ? kHasLeft : 0) | (right ? kHasRight : 0) |
+        (balance + 1) << kBalanceShift | (count > 1 ? kHasCount : 0));
+    Put(&flags, 1);
+    Put(&key, sizeof(T));
+    if (count > 1) {
+      Put(&count, sizeof(count));
+    }
+    if (buffer_.size() >= kSnapshotChunk) {
+      Flush();
+    }
+  }
+  bool Finish() {
+    Flush();
+    os_.write(reinterpret_cast<const char *>(&hash_), sizeof(hash_));
+    return static_cast<bool>(os_);
+  }
+
+private:
+  std::ostream &os_;
+  std::vector<char> buffer_;
+  std::uint64_t hash_ = kFnvOffset;
+
+  void Put(const void *p, std::size_t n) {
+    std::size_t old = buffer_.size();
+    buffer_.resize(old + n);
+    std::memcpy(buffer_.data() + old, p, n);
+  }
+  void Flush() {
+    hash_ = Fnv1a(buffer_.data(), buffer_.size(), hash_);
+    os_.write(buffer_.data(), static_cast<std::streamsize>(buffer_.size()));
+    buffer_.clear();
+  }
+};
+
+template <class T> bool Adt<T>::SaveSnapshot(std::ostream &os) const {
+  static_assert(std::is_trivially_copyable_v<T>,
+                "snapshot stores keys as raw bytes");
+  SnapshotWriter writer(os, {{'A', 'D', 'T', 'S'}, kSnapshotVersion,
+                             sizeof(T), multiset_, nodes_, size_});
+  PreorderTraverse(root_, [&writer](const NodePtr p) {
+    writer.Node(p->avl_data_, nullptr != p->avl_link_[0],
+                nullptr != p->avl_link_[1], p->avl_balance_, p->avl_count_);
+  });
+  return writer.Finish();
+}
+
+// Node of keys [lo, hi) is the middle one, so its left subtree has as many
+// nodes as the right one or one more, and the height of n nodes is
+// bit_width(n).
+template <class T>
+bool Adt<T>::SaveSnapshot(std::ostream &os, std::span<const T> sorted,
+                          bool multiset) {
+  static_assert(std::is_trivially_copyable_v<T>,
+                "snapshot stores keys as raw bytes");
+  // Step 1 : Runs of equal keys
+  std::vector<std::size_t> runs; // first key of every run, then the end
+  for (std::size_t i = 0; i < sorted.size(); ++i) {
+    if (i == 0 || sorted[i - 1] < sorted[i]) {
+      if (!runs.empty() && i - runs.back() > UINT32_MAX) {
+        return false;
+      }
+      runs.push_back(i);
+    }
+  }
+  if (!runs.empty() && sorted.size() - runs.back() > UINT32_MAX) {
+    return false;
+  }
+  const std::size_t nodes = runs.size();
+  runs.push_back(sorted.size());
+  // Step 2 : Nodes in preorder
+  SnapshotWriter writer(os, {{'A', 'D', 'T', 'S'}, kSnapshotVersion,
+                             sizeof(T), multiset, nodes, sorted.size()});
+  struct Range {
+    std::size_t lo; // runs [lo, hi) of a subtree
+    std::size_t hi;
+  };
+  InlineStack<Range, kMaxStack + 1> stack;
+  if (nodes > 0) {
+    stack.push_back({0, nodes});
+  }
+  while (!stack.empty()) {
+    auto [lo, hi] = stack.back();
+    stack.pop_back();
+    std::size_t mid = lo + (hi - lo) / 2;
+    int balance = static_cast<int>(std::bit_width(hi - mid - 1)) -
+                  static_cast<int>(std::bit_width(mid - lo));
+    writer.Node(sorted[runs[mid]], lo < mid, mid + 1 < hi, balance,
+                static_cast<std::uint32_t>(runs[mid + 1] - runs[mid]));
+    if (mid + 1 < hi) {
+      stack.push_back({mid + 1, hi});
+    }
+    if (lo < mid) {
+      stack.push_back({lo, mid});
+    }
+  }
+  return writer.Finish();
+}
+
+template <class T> bool Adt<T>::LoadSnapshot(std::istream &is) {
+  std::vector<char> data;
+  while (is) {
+    std::size_t old = data.size();
+    data.resize(old + kSnapshotChunk);
+    is.read(data.data() + old, kSnapshotChunk);
+    data.resize(old + static_cast<std::size_t>(is.gcount()));
+  }
+  return LoadSnapshot(std::span<const char>(data));
+}
+
+// Records come in preorder, so a stack of links waiting for their subtree
+// places every node, and walking the block backwards rebuilds tags as in
+// Compact().
+template <class T> bool Adt<T>::LoadSnapshot(std::span<const char> data) {
+  static_assert(std::is_trivially_copyable_v<T>,
+                "snapshot stores keys as raw bytes");
+  // Step 1 : Check header and checksum
+  SnapshotHeader header;
+  std::uint64_t hash;
+  if (data.size() < sizeof(header) + sizeof(hash)) {
+    return false;
+  }
+  const std::size_t body = data.size() - sizeof(hash);
+  std::memcpy(&hash, data.data() + body, sizeof(hash));
+  std::memcpy(&header, data.data(), sizeof(header));
+  if (std::memcmp(header.magic, "ADTS", 4) != 0 ||
+      header.version != kSnapshotVersion || header.key_size != sizeof(T) ||
+      header.nodes > body / (1 + sizeof(T)) || header.nodes > header.items ||
+      hash != Fnv1a(data.data(), body)) {
+    return false;
+  }
+  // Step 2 : Place nodes
+  const std::size_t nodes = header.nodes;
+  AvlNode *block =
+      nodes == 0 ? nullptr : std::allocator<AvlNode>().allocate(nodes);
+  NodePtr root = nullptr;
+  InlineStack<NodePtr *, kMaxStack> links;
+  if (nodes > 0) {
+    links.push_back(&root);
+  }
+  std::size_t next = 0;
+  std::size_t items = 0;
+  std::size_t pos = sizeof(header);
+  bool ok = true;
+  while (ok && next < nodes) {
+    ok = !links.empty() && pos + 1 + sizeof(T) <= body;
+    if (!ok) {
+      break;
+    }
+    unsigned char flags = static_cast<unsigned char>(data[pos++]);
+    T key;
+    std::memcpy(&key, data.data() + pos, sizeof(T));
+    pos += sizeof(T);
+    std::uint32_t count = 1;
+    if (flags & kHasCount) {
+      ok = pos + sizeof(count) <= body;
+      if (!ok) {
+        break;
       }
+      std::memcpy(&count, data.data() + pos, sizeof(count));
+      pos += sizeof(count);
+    }
+    int balance = (flags >> kBalanceShift & 3) - 1;
+    ok = count > 0 && balance <= 1 && links.size() + 1 < kMaxStack;
+    if (!ok) {
+      break;
     }
+    NodePtr q = std::construct_at(block + next++, key);
+    q->avl_balance_ = static_cast<signed char>(balance);
+    q->avl_count_ = count;
+    items += count;
+    *links.back() = q;
+    links.pop_back();
+    if (flags & kHasRight) {
+      links.push_back(&q->avl_link_[1]);
+    }
+    if (flags & kHasLeft) {
+      links.push_back(&q->avl_link_[0]);
+    }
+  }
+  ok = ok && links.empty() && pos == body && items == header.items;
+  // Step 3 : Check balance factors against subtree heights; children follow
+  // their parent in the block, so a backward walk meets them first. Every
+  // descent keeps its path in an InlineStack of kMaxStack entries.
+  if (ok) {
+    std::vector<unsigned char> height(nodes);
+    auto height_of = [block, &height](NodePtr p) {
+      return nullptr == p ? 0 : static_cast<int>(height[p - block]);
+    };
+    for (std::size_t i = nodes; ok && i > 0; --i) {
+      const AvlNode &q = block[i - 1];
+      int left = height_of(q.avl_link_[0]);
+      int right = height_of(q.avl_link_[1]);
+      int h = 1 + std::max(left, right);
+      height[i - 1] = static_cast<unsigned char>(h);
+      ok = right - left == q.avl_balance_ &&
+           h < static_cast<int>(kMaxStack);
+    }
+  }
+  if (!ok) {
+    std::destroy_n(block, next);
+    if (nullptr != block) {
+      std::allocator<AvlNode>().deallocate(block, nodes);
+    }
+    return false;
   }
+  // Step 4 : Replace content, rebuild tags bottom-up
+  Clear();
+  root_ = root;
+  slab_ = block;
+  slab_size_ = nodes;
+  size_ = items;
+  nodes_ = nodes;
+  multiset_ = header.multiset != 0;
+  for (std::size_t i = nodes; i > 0; --i) {
+    block[i - 1].Update();
+  }
+  return true;
 }
 
+// In-order traverse and free nodes
 template <class T>
-void Adt<T>::DumpTraceNodeStack(std::ostream &os,
-                                typename Adt<T>::TraceNodeStack &tns) {
-  for (const auto &p : tns) {
-    os << "Node data:" << p.first->avl_data_ << " direction:" << p.second
-       << "\n";
+template <class O>
+void Adt<T>::InorderTraverse(typename Adt<T>::NodePtr node, O o) const {
+  NodePtrStack stack; // one entry per level
+  NodePtr p = node;
+  while (nullptr != p || !stack.empty()) {
+    for (; nullptr != p; p = p->avl_link_[0]) { // check left links
+      PushShift(p);
+      stack.push_back(p);
+    }
+    p = stack.back();
+    stack.pop_back();
+#ifdef my_debug_1
+    std::cerr << "Current node:" << p->avl_data_ << "\n";
+#endif
+    o(p);                // check own node
+    p = p->avl_link_[1]; // check right link
   }
 }
 
 template <class T> void Adt<T>::Tag::Update(NodePtr node) {
   if (nullptr == node) {
     count_ = 0;
-    bound_[0] = nullptr;
-    bound_[1] = nullptr;
+    bound_[0] = {};
+    bound_[1] = {};
+    extra_ = {};
     return;
   }
 #ifdef my_debug_1
   std::cerr << __FUNCTION__ << " node: " << node->avl_data_ << " count_"
             << count_ << "  ";
 #endif
-  count_ = 1;
+  count_ = node->avl_count_;
+  const AdtTagExtra<T> *extra[2] = {nullptr, nullptr};
   for (int i = 0; i < 2; ++i) {
     if (node->avl_link_[i] != nullptr) {
-      bound_[i] = node->avl_link_[i]->tag_.bound_[i];
+      if constexpr (kShiftable) {
+        bound_[i] =
+            node->avl_link_[i]->tag_.bound_[i] + node->avl_link_[i]->avl_shift_;
+      } else {
+        bound_[i] = node->avl_link_[i]->tag_.bound_[i];
+      }
       count_ += node->avl_link_[i]->tag_.count_;
+      extra[i] = &node->avl_link_[i]->tag_.extra_;
 #ifdef my_debug_1
       std::cerr << " dir:" << i << " data:" << node->avl_link_[i]->avl_data_
                 << " "
                 << " count:" << node->avl_link_[i]->tag_.count_ << " ";
 #endif
     } else {
-      bound_[i] = node;
+      if constexpr (kShiftable) {
+        bound_[i] = node->avl_data_;
+      } else {
+        bound_[i] = node;
+      }
 #ifdef my_debug_1
       std::cerr << " dir:" << i << " data:" << node->avl_data_ << " null ";
 #endif
     }
   }
+  extra_.Update(node->avl_data_, extra[0], extra[1]);
 #ifdef my_debug_1
   std::cerr << "final  count_" << count_ << "  "
             << "\n";
@@ -517,66 +1100,199 @@ template <class T> void Adt<T>::Tag::Update(NodePtr node) {
 
 // Update Tags in nodes from stack
 template <class T> void Adt<T>::UpdateTags(const NodePtrStack &stack) {
+  if (deferred_tags_) {
+    // ancestors of a dirty node are dirty already
+    for (auto it = stack.crbegin(); it != stack.crend() && !(*it)->tag_dirty_;
+         ++it) {
+      (*it)->tag_dirty_ = true;
+      tags_dirty_ = true;
+    }
+    return;
+  }
   std::for_each(stack.crbegin(), stack.crend(), [](NodePtr p) { p->Update(); });
 }
+
+// Update tag of one node or mark it dirty in deferred tags mode
+template <class T> void Adt<T>::UpdateNode(NodePtr p) {
+  if (deferred_tags_) {
+    p->tag_dirty_ = true;
+    tags_dirty_ = true;
+    return;
+  }
+  p->Update();
+}
+
+template <class T> void Adt<T>::SetDeferredTags(bool deferred) {
+  if (!deferred) {
+    RefreshTags();
+  }
+  deferred_tags_ = deferred;
+}
+
+// Every dirty node has dirty ancestors, so clean subtrees are skipped entirely
+// and each dirty node is updated once after both of its children. Pending
+// shifts may sit below any node, so applying them visits the whole tree.
+template <class T> void Adt<T>::RefreshTags() const {
+  if (shifts_pending_) {
+    NodePtrStack stack;
+    if (nullptr != root_) {
+      stack.push_back(root_);
+    }
+    while (!stack.empty()) {
+      NodePtr p = stack.back();
+      stack.pop_back();
+      PushShift(p);
+      for (NodePtr child : p->avl_link_) {
+        if (nullptr != child) {
+          stack.push_back(child);
+        }
+      }
+    }
+    shifts_pending_ = false;
+  }
+  if (!tags_dirty_) {
+    return;
+  }
+  auto dirty = [](NodePtr p) {
+    return nullptr != p && p->tag_dirty_ ? p : nullptr;
+  };
+  NodePtrStack stack; // post-order walk over dirty nodes
+  NodePtr last = nullptr;
+  NodePtr p = dirty(root_);
+  while (nullptr != p || !stack.empty()) {
+    if (nullptr != p) {
+      stack.push_back(p);
+      p = dirty(p->avl_link_[0]);
+      continue;
+    }
+    NodePtr top = stack.back();
+    NodePtr right = dirty(top->avl_link_[1]);
+    if (nullptr != right && last != right) {
+      p = right;
+    } else { // update own node after children
+      top->Update();
+      top->tag_dirty_ = false;
+      last = top;
+      stack.pop_back();
+    }
+  }
+  tags_dirty_ = false;
+}
+
+// Number of finger nodes whose subtree key range may contain data: climbs from
+// the last insertion point through the nearest bounding ancestors only.
+template <class T> std::size_t Adt<T>::FingerDepth(const T &data) const {
+  int i = static_cast<int>(finger_.size()) - 1;
+  while (i >= 0) {
+    int lower = finger_lower_[i];
+    int upper = finger_upper_[i];
+    if (lower >= 0 && (data <=> finger_[lower]->avl_data_) <= 0) {
+      i = lower;
+    } else if (upper >= 0 && (data <=> finger_[upper]->avl_data_) >= 0) {
+      i = upper;
+    } else {
+      break;
+    }
+  }
+  return i + 1;
+}
+
+// Append child of finger_.back() (or root) to finger
+template <class T> void Adt<T>::PushFinger(NodePtr p) {
+  int lower = -1;
+  int upper = -1;
+  if (!finger_.empty()) {
+    int parent = static_cast<int>(finger_.size()) - 1;
+    if (finger_.back()->avl_link_[1] == p) {
+      lower = parent;
+      upper = finger_upper_[parent];
+    } else {
+      lower = finger_lower_[parent];
+      upper = parent;
+    }
+  }
+  finger_.push_back(p);
+  finger_lower_.push_back(lower);
+  finger_upper_.push_back(upper);
+}
+
+template <class T> void Adt<T>::PopFinger(std::size_t depth) {
+  finger_.resize(depth);
+  finger_lower_.resize(depth);
+  finger_upper_.resize(depth);
+}
+
+template <class T> void Adt<T>::SetFinger(const NodePtrStack &path) {
+  PopFinger(0);
+  for (NodePtr p : path) {
+    PushFinger(p);
+  }
+}
+
 // probe inserts element into the container, if the container doesn't already
 // contain an element with an equivalent key.
 template <class T> typename Adt<T>::InsertResult Adt<T>::probe(const T &data) {
-  NodePtr p, q; // Iterator and parent
-  NodePtr y, z; // Top node to update and parent
+  NodePtr p;    // Iterator
+  NodePtr y;    // Top node to update
   NodePtr n;    // new node
   NodePtr w;    // root of rebalanced tree
-  DirectionStack da;
-  da.reserve(kMaxStack);
-
-  NodePtrStack stack;
   int dir = 0;
-  AvlNode dummy(T{}, root_);
-  z = &dummy;
-  y = root_;
 
 #ifdef my_debug_1
   std::cerr << __FUNCTION__ << " data: " << data << "\n";
 #endif
-  // Step 1 : Search new node position
-  for (q = z, p = y; nullptr != p; q = p, p = p->avl_link_[dir]) {
+  // Step 1 : Search new node position starting from the lowest finger node
+  // whose subtree can contain data
+  std::size_t depth = FingerDepth(data);
+  p = depth == 0 ? root_ : finger_[depth - 1];
+  PopFinger(depth == 0 ? 0 : depth - 1);
+  for (; nullptr != p; p = p->avl_link_[dir]) {
+    PushShift(p);
+    PushFinger(p);
     auto cmp = data <=> p->avl_data_;
-    stack.push_back(p);
     if (cmp == 0) {
-      // false - item was not inserted
-      return std::make_pair(Iterator(this, std::move(stack)), false);
-    }
-    if (p->avl_balance_ !=
-        0) { // Keep information about last node need to rebalance
-      z = q;
-      y = p;
-      da.resize(0);
+      auto result = Iterator(this, NodePtrStack(finger_));
+      if (!multiset_ || p->avl_count_ == UINT32_MAX) {
+        // false - item was not inserted
+        return std::make_pair(result, false);
+      }
+      // one more copy, shape is not changed
+      result.dup_ = p->avl_count_++;
+      ++size_;
+      UpdateTags(finger_);
+      return std::make_pair(result, true);
     }
     dir = cmp > 0;
-    da.push_back(dir);
   }
   // Step 2 : Insert
   n = new AvlNode(data);
-  n->Update();
+  UpdateNode(n);
   ++size_;
-  q->avl_link_[dir] = n;
+  ++nodes_;
 
-  if (nullptr == y) { // Tree was empty
-    root_ = dummy.avl_link_[0];
+  if (finger_.empty()) { // Tree was empty
+    root_ = n;
+    PushFinger(n);
     // true - new item was inserted
     return std::make_pair(Iterator(this, root_), true);
   }
+  finger_.back()->avl_link_[dir] = n;
+  UpdateTags(finger_);
 
-  UpdateTags(stack);
-  stack.push_back(n);
+  // Keep information about last node need to rebalance
+  std::size_t iy = finger_.size() - 1;
+  while (iy > 0 && finger_[iy]->avl_balance_ == 0) {
+    --iy;
+  }
+  y = finger_[iy];
+  PushFinger(n);
 
   // Step 3 : Update balance factor
-  int k = 0;
-  for (p = y; p != n; p = p->avl_link_[da[k]], ++k) {
-    if (da[k] == 0) {
-      --(p->avl_balance_);
+  for (std::size_t k = iy; k + 1 < finger_.size(); ++k) {
+    if (finger_[k]->avl_link_[0] == finger_[k + 1]) {
+      --(finger_[k]->avl_balance_);
     } else {
-      ++(p->avl_balance_);
+      ++(finger_[k]->avl_balance_);
     }
   }
 
@@ -591,8 +1307,8 @@ template <class T> typename Adt<T>::InsertResult Adt<T>::probe(const T &data) {
       y->avl_link_[0] = x->avl_link_[1];
       x->avl_link_[1] = y;
       x->avl_balance_ = y->avl_balance_ = 0;
-      y->Update();
-      w->Update();
+      UpdateNode(y);
+      UpdateNode(w);
     } else {
       // rotate left at x than right at y
       assert(x->avl_balance_ == +1);
@@ -602,9 +1318,9 @@ template <class T> typename Adt<T>::InsertResult Adt<T>::probe(const T &data) {
       y->avl_link_[0] = w->avl_link_[1];
       w->avl_link_[1] = y;
 
-      x->Update();
-      y->Update();
-      w->Update();
+      UpdateNode(x);
+      UpdateNode(y);
+      UpdateNode(w);
       if (w->avl_balance_ == -1) {
         // Test rotate 2
         x->avl_balance_ = 0;
@@ -637,8 +1353,8 @@ template <class T> typename Adt<T>::InsertResult Adt<T>::probe(const T &data) {
       x->avl_balance_ = 0;
       y->avl_balance_ = 0;
 
-      y->Update();
-      w->Update();
+      UpdateNode(y);
+      UpdateNode(w);
     } else {
       // rotate right at x then left at y
       assert(x->avl_balance_ == -1);
@@ -648,9 +1364,9 @@ template <class T> typename Adt<T>::InsertResult Adt<T>::probe(const T &data) {
       y->avl_link_[1] = w->avl_link_[0];
       w->avl_link_[0] = y;
 
-      x->Update();
-      y->Update();
-      w->Update();
+      UpdateNode(x);
+      UpdateNode(y);
+      UpdateNode(w);
       if (w->avl_balance_ == 1) {
         // Test rotate 6
         x->avl_balance_ = 0;
@@ -668,28 +1384,24 @@ template <class T> typename Adt<T>::InsertResult Adt<T>::probe(const T &data) {
       }
       w->avl_balance_ = 0;
     }
-  } else { // no need to rebalance tree . stack contains all nodes to inserted
+  } else { // no need to rebalance tree . finger contains all nodes to inserted
            // node
-    root_ = dummy.avl_link_[0];
     // true - inserted
-    return std::make_pair(Iterator(this, std::move(stack)), true);
+    return std::make_pair(Iterator(this, NodePtrStack(finger_)), true);
   }
-  // connect rebalanced tree to parent node z
-  z->avl_link_[y != z->avl_link_[0]] = w;
-  root_ = dummy.avl_link_[0];
-
-  // Step 5  erase last items in stack
-  if (z != &dummy) {
-    while (!stack.empty() && stack.back() != z) {
-      stack.pop_back();
-    }
+  // connect rebalanced tree to parent node of y
+  if (iy == 0) {
+    root_ = w;
+  } else {
+    NodePtr z = finger_[iy - 1];
+    z->avl_link_[y != z->avl_link_[0]] = w;
   }
-  assert(z == &dummy || stack.back() == z);
 
-  // Add required nodes to iterator
+  // Step 5  erase nodes below parent of y from finger and add rebalanced path
+  PopFinger(iy);
   p = w;
   while (nullptr != p) {
-    stack.push_back(p);
+    PushFinger(p);
     auto cmp = data <=> p->avl_data_;
     if (cmp == 0) {
       p = nullptr;
@@ -699,7 +1411,7 @@ template <class T> typename Adt<T>::InsertResult Adt<T>::probe(const T &data) {
     }
   }
   // true - intem inserted
-  return std::make_pair(Iterator(this, std::move(stack)), true);
+  return std::make_pair(Iterator(this, NodePtrStack(finger_)), true);
 }
 
 // Inserts element into the container, if the container doesn't already contain
@@ -708,12 +1420,189 @@ template <class T> typename Adt<T>::InsertResult Adt<T>::insert(const T &data) {
   return probe(data);
 }
 
+// Inserts element as close as possible to the position just prior to hint;
+// end() keeps the last insertion path, so sorted appends stay cheap.
+template <class T>
+typename Adt<T>::InsertResult Adt<T>::insert(const Iterator &hint,
+                                             const T &data) {
+  if (hint.ptr_ == this && !hint.stack_.empty() && hint.stack_ != finger_) {
+    SetFinger(hint.stack_);
+  }
+  return probe(data);
+}
+
+// erase follows avl_delete of libavl: the path to the node is kept with link
+// directions, a node with two children is replaced by its successor, then
+// balance factors are fixed bottom-up until a subtree keeps its height.
+template <class T> std::size_t Adt<T>::erase(const T &data) {
+  NodePtrStack path;                          // path[k] - node at depth k
+  InlineStack<unsigned char, kMaxStack> dirs; // dirs[k] - link from path[k]
+  // parent link of node at depth k
+  auto link = [this, &path, &dirs](std::size_t k) -> NodePtr & {
+    return k == 0 ? root_ : path[k - 1]->avl_link_[dirs[k - 1]];
+  };
+  // Step 1 : Search node
+  NodePtr p = root_;
+  while (nullptr != p) {
+    PushShift(p);
+    auto cmp = data <=> p->avl_data_;
+    if (cmp == 0) {
+      break;
+    }
+    path.push_back(p);
+    dirs.push_back(cmp > 0);
+    p = p->avl_link_[cmp > 0];
+  }
+  if (nullptr == p) {
+    return 0;
+  }
+  --size_;
+  if (p->avl_count_ > 1) { // one copy less, shape is not changed
+    --p->avl_count_;
+    path.push_back(p);
+    UpdateTags(path);
+    return 1;
+  }
+  // Step 2 : Unlink node, its successor takes its place
+  const std::size_t k = path.size(); // depth of p
+  std::size_t top = k; // smallest depth whose node was replaced
+  if (nullptr == p->avl_link_[1]) {
+    link(k) = p->avl_link_[0];
+  } else if (nullptr == p->avl_link_[1]->avl_link_[0]) {
+    NodePtr r = p->avl_link_[1];
+    PushShift(r); // r takes subtrees whose shifts are applied
+    r->avl_link_[0] = p->avl_link_[0];
+    r->avl_balance_ = p->avl_balance_;
+    link(k) = r;
+    path.push_back(r);
+    dirs.push_back(1);
+  } else {
+    path.push_back(p); // replaced by successor below
+    dirs.push_back(1);
+    NodePtr r = p->avl_link_[1];
+    PushShift(r);
+    NodePtr s = r->avl_link_[0];
+    for (;;) {
+      PushShift(s);
+      path.push_back(r);
+      dirs.push_back(0);
+      if (nullptr == s->avl_link_[0]) {
+        break;
+      }
+      r = s;
+      s = r->avl_link_[0];
+    }
+    s->avl_link_[0] = p->avl_link_[0];
+    r->avl_link_[0] = s->avl_link_[1];
+    s->avl_link_[1] = p->avl_link_[1];
+    s->avl_balance_ = p->avl_balance_;
+    link(k) = s;
+    path[k] = s;
+  }
+  DeleteNode(p);
+  --nodes_;
+  // Step 3 : Update tags of the whole path, a moved successor may have been
+  // clean below dirty nodes
+  std::for_each(path.crbegin(), path.crend(), [this](NodePtr q) {
+    UpdateNode(q);
+  });
+  // Step 4 : Rebalance, dirs[i] is the side of path[i] that became lower.
+  // Rotations keep the key set of a subtree, so tags above stay valid.
+  for (std::size_t i = path.size(); i-- > 0;) {
+    NodePtr y = path[i];
+    const int d = dirs[i];
+    const signed char sign = d == 0 ? 1 : -1; // balance moves away from d
+    y->avl_balance_ += sign;
+    if (y->avl_balance_ == sign) {
+      break; // height of y is not changed
+    }
+    if (y->avl_balance_ == 0) {
+      continue; // y became lower
+    }
+    NodePtr x = y->avl_link_[!d];
+    PushShift(x); // rotated nodes must not carry shifts of their subtrees
+    top = std::min(top, i);
+    if (x->avl_balance_ == -sign) {
+      // rotate at x than at y
+      NodePtr w = x->avl_link_[d];
+      PushShift(w);
+      x->avl_link_[d] = w->avl_link_[!d];
+      w->avl_link_[!d] = x;
+      y->avl_link_[!d] = w->avl_link_[d];
+      w->avl_link_[d] = y;
+      if (w->avl_balance_ == sign) {
+        x->avl_balance_ = 0;
+        y->avl_balance_ = -sign;
+      } else if (w->avl_balance_ == 0) {
+        x->avl_balance_ = 0;
+        y->avl_balance_ = 0;
+      } else {
+        x->avl_balance_ = sign;
+        y->avl_balance_ = 0;
+      }
+      w->avl_balance_ = 0;
+      UpdateNode(x);
+      UpdateNode(y);
+      UpdateNode(w);
+      link(i) = w;
+    } else {
+      // rotate at y
+      y->avl_link_[!d] = x->avl_link_[d];
+      x->avl_link_[d] = y;
+      link(i) = x;
+      bool same_height = x->avl_balance_ == 0;
+      x->avl_balance_ = same_height ? -sign : 0;
+      y->avl_balance_ = same_height ? sign : 0;
+      UpdateNode(y);
+      UpdateNode(x);
+      if (same_height) {
+        break;
+      }
+    }
+  }
+  // Step 5 : Finger nodes below top may have moved, drop them unless the
+  // finger leaves the erase path above top
+  std::size_t same = 0;
+  while (same < finger_.size() && same < top && finger_[same] == path[same]) {
+    ++same;
+  }
+  if (same == top && same < finger_.size()) {
+    PopFinger(top);
+  }
+  return 1;
+}
+
+template <class T> typename Adt<T>::Iterator Adt<T>::Erase(const T &data) {
+  return erase(data) == 0 ? end() : lower_bound(data);
+}
+
+// Removes the element at pos, pos is moved to the next item.
+template <class T>
+typename Adt<T>::Iterator Adt<T>::Erase(Iterator &pos) {
+  if (pos.ptr_ != this || pos.stack_.empty()) {
+    return end();
+  }
+  const T data = pos.stack_.back()->avl_data_;
+  const std::uint32_t dup = pos.dup_;
+  pos = Erase(data);
+  if (dup > 0 && !pos.stack_.empty() &&
+      (data <=> pos.stack_.back()->avl_data_) == 0) {
+    // copies before the erased one are kept
+    if (dup < pos.stack_.back()->avl_count_) {
+      pos.dup_ = dup;
+    } else {
+      pos.NextNode();
+    }
+  }
+  return pos;
+}
+
 // find node equal key , if not found = return end()
 template <class T> typename Adt<T>::Iterator Adt<T>::find(const T &data) const {
   NodePtrStack stack;
-  stack.reserve(kMaxStack);
 
   for (NodePtr p = root_; p != nullptr;) {
+    PushShift(p);
     auto cmp = data <=> p->avl_data_;
     stack.push_back(p);
     if (cmp < 0) {
@@ -721,14 +1610,15 @@ template <class T> typename Adt<T>::Iterator Adt<T>::find(const T &data) const {
     } else if (cmp > 0) {
       p = p->avl_link_[1];
     } else {
-      return {this, std::move(stack)};
+      return {this, stack};
     }
   }
   return end();
 }
 
 // count items in range
-template <class T> int Adt<T>::CountByRange(T first, T second) const {
+template <class T>
+int Adt<T>::CountByRange(const T &first, const T &second) const {
 #ifdef my_debug_1
   std::cerr << __FUNCTION__ << " first:" << first << " , "
             << "second:" << second << "\n";
@@ -739,31 +1629,30 @@ template <class T> int Adt<T>::CountByRange(T first, T second) const {
   if (size() == 0) {
     return 0;
   }
+  RefreshTags();
 
   NodePtr p;
   int result = 0;
   NodePtrStack stack;
-  stack.reserve(kMaxStack * 3);
   p = root_;
-  T n_first;
-  T n_second;
 
   stack.emplace_back(p); // check child node
 
   while (!stack.empty()) {
     p = stack.back();
     stack.pop_back();
+    PushShift(p);
 #ifdef my_debug_1
     std::cerr << "Current node:" << p->avl_data_ << "\n";
 #endif
-    n_first = p->tag_.bound_[0]->avl_data_;
-    n_second = p->tag_.bound_[1]->avl_data_;
+    const T &n_first = BoundKey(p, 0);
+    const T &n_second = BoundKey(p, 1);
 
     if (first <= n_first && n_second <= second) {
       result += p->tag_.count_;
     } else if (Intersect(first, second, n_first, n_second)) {
       if (first <= p->avl_data_ && p->avl_data_ <= second) {
-        ++result;
+        result += p->avl_count_;
       }
       for (int i = 0; i < 2; ++i) {
         if (nullptr != p->avl_link_[i])
@@ -774,6 +1663,392 @@ template <class T> int Adt<T>::CountByRange(T first, T second) const {
 
   return result;
 }
+
+// In-order walk of range with path kept in a local inline stack. Subtrees
+// outside of the range are cut by Tag bounds, subtrees inside of it are walked
+// without comparisons.
+template <class T>
+template <class F>
+void Adt<T>::for_each_in_range(const T &first, const T &second, F f) const {
+  if (first > second || nullptr == root_) {
+    return;
+  }
+  RefreshTags();
+  PushShift(root_);
+  if (BoundKey(root_, 1) < first || second < BoundKey(root_, 0)) {
+    return;
+  }
+  NodePtrStack stack;
+  NodePtr p = root_;
+  // Step 1 : path to the first item not less than first
+  while (nullptr != p) {
+    PushShift(p);
+    if (p->avl_data_ < first) {
+      p = p->avl_link_[1];
+    } else {
+      stack.push_back(p);
+      p = p->avl_link_[0];
+    }
+  }
+  // Step 2 : items from stack and their right subtrees
+  while (!stack.empty()) {
+    p = stack.back();
+    stack.pop_back();
+    if (second < p->avl_data_) {
+      return;
+    }
+    for (std::uint32_t i = 0; i < p->avl_count_; ++i) {
+      f(p->avl_data_);
+    }
+    p = p->avl_link_[1];
+    if (nullptr == p) {
+      continue;
+    }
+    PushShift(p);
+    if (!(second < BoundKey(p, 1))) { // whole subtree in range
+      std::size_t bottom = stack.size();
+      while (true) {
+        for (; nullptr != p; p = p->avl_link_[0]) {
+          PushShift(p);
+          stack.push_back(p);
+        }
+        if (stack.size() == bottom) {
+          break;
+        }
+        p = stack.back();
+        stack.pop_back();
+        for (std::uint32_t i = 0; i < p->avl_count_; ++i) {
+          f(p->avl_data_);
+        }
+        p = p->avl_link_[1];
+      }
+    } else if (!(second < BoundKey(p, 0))) {
+      for (; nullptr != p; p = p->avl_link_[0]) {
+        PushShift(p);
+        stack.push_back(p);
+      }
+    }
+  }
+}
+
+template <class T>
+void Adt<T>::copy_range(const T &first, const T &second,
+                        std::vector<T> &out) const {
+  if (first > second) {
+    return;
+  }
+  out.reserve(out.size() + CountByRange(first, second));
+  for_each_in_range(first, second, [&out](const T &v) { out.push_back(v); });
+}
+
+// number of elements less than v
+template <class T> std::size_t Adt<T>::rank(const T &v) const {
+  RefreshTags();
+  std::size_t result = 0;
+  for (NodePtr p = root_; p != nullptr;) {
+    PushShift(p);
+    auto cmp = v <=> p->avl_data_;
+    if (cmp <= 0) {
+      p = p->avl_link_[0];
+    } else {
+      result += Count(p->avl_link_[0]) + p->avl_count_;
+      p = p->avl_link_[1];
+    }
+  }
+  return result;
+}
+
+// Keys not less than key form a suffix, so one descent splits them: a shifted
+// node takes its right subtree along as a pending shift of the child and the
+// descent turns left, otherwise it turns right.
+template <class T> bool Adt<T>::ShiftFrom(const T &key, T delta) {
+  static_assert(kShiftable, "ShiftFrom needs an arithmetic key type");
+  if (delta < T{}) {
+    return false;
+  }
+  // the highest key is shifted unless it is below key, it must still fit
+  NodePtr last = root_;
+  for (NodePtr p = root_; nullptr != p; p = p->avl_link_[1]) {
+    PushShift(p);
+    last = p;
+  }
+  if (nullptr != last && !(last->avl_data_ < key) &&
+      last->avl_data_ > std::numeric_limits<T>::max() - delta) {
+    return false;
+  }
+  NodePtrStack path;
+  for (NodePtr p = root_; nullptr != p && delta != T{};) {
+    PushShift(p);
+    path.push_back(p);
+    if (p->avl_data_ < key) {
+      p = p->avl_link_[1];
+    } else {
+      p->avl_data_ += delta;
+      if (nullptr != p->avl_link_[1]) {
+        p->avl_link_[1]->avl_shift_ += delta;
+      }
+      p = p->avl_link_[0];
+    }
+  }
+  UpdateTags(path);
+  PopFinger(0); // bounds of finger nodes may have moved
+  shifts_pending_ = shifts_pending_ || !path.empty();
+  return true;
+}
+
+template <class T> std::size_t Adt<T>::count(const T &key) const {
+  for (NodePtr p = root_; p != nullptr;) {
+    PushShift(p);
+    auto cmp = key <=> p->avl_data_;
+    if (cmp == 0) {
+      return p->avl_count_;
+    }
+    p = p->avl_link_[cmp > 0];
+  }
+  return 0;
+}
+
+// k-th smallest element (0-based), if k >= size() = return end()
+template <class T>
+typename Adt<T>::Iterator Adt<T>::select(std::size_t k) const {
+  if (k >= size()) {
+    return end();
+  }
+  RefreshTags();
+  NodePtrStack stack;
+  for (NodePtr p = root_; p != nullptr;) {
+    PushShift(p);
+    std::size_t left = Count(p->avl_link_[0]);
+    stack.push_back(p);
+    if (k < left) {
+      p = p->avl_link_[0];
+    } else if (k < left + p->avl_count_) {
+      break;
+    } else {
+      k -= left + p->avl_count_;
+      p = p->avl_link_[1];
+    }
+  }
+  auto result = Iterator(this, stack);
+  result.dup_ =
+      static_cast<std::uint32_t>(k - Count(stack.back()->avl_link_[0]));
+  return result;
+}
+
+template <class T>
+template <class Step>
+void Adt<T>::Interleave(std::size_t n, Step step) const {
+  if (nullptr == root_) {
+    return;
+  }
+  NodePtr node[kLanes];
+  std::size_t index[kLanes];
+  std::size_t next = 0;
+  std::size_t active = 0;
+  for (; active < kLanes && next < n; ++active, ++next) {
+    node[active] = root_;
+    index[active] = next;
+  }
+  while (active > 0) {
+    for (std::size_t lane = 0; lane < active;) {
+      PushShift(node[lane]);
+      NodePtr p = step(index[lane], node[lane]);
+      if (nullptr != p) {
+        Prefetch(p);
+        node[lane++] = p;
+      } else if (next < n) { // start next descent in this lane
+        node[lane] = root_;
+        index[lane++] = next++;
+      } else { // move last lane here
+        --active;
+        node[lane] = node[active];
+        index[lane] = index[active];
+      }
+    }
+  }
+}
+
+template <class T>
+std::vector<typename Adt<T>::Iterator>
+Adt<T>::find_many(std::span<const T> keys) const {
+  std::vector<Iterator> result(keys.size(), end());
+  Interleave(keys.size(), [&keys, &result](std::size_t i, NodePtr p) {
+    NodePtrStack &stack = result[i].stack_;
+    stack.push_back(p);
+    auto cmp = keys[i] <=> p->avl_data_;
+    if (cmp == 0) {
+      return static_cast<NodePtr>(nullptr);
+    }
+    p = p->avl_link_[cmp > 0];
+    if (nullptr == p) {
+      stack.clear(); // not found = end()
+    }
+    return p;
+  });
+  return result;
+}
+
+template <class T>
+std::vector<typename Adt<T>::Iterator>
+Adt<T>::lower_bound_many(std::span<const T> keys) const {
+  std::vector<Iterator> result(keys.size(), end());
+  std::vector<signed char> greater(keys.size(), 0); // last cmp > 0
+  Interleave(keys.size(),
+             [&keys, &result, &greater](std::size_t i, NodePtr p) {
+               NodePtrStack &stack = result[i].stack_;
+               stack.push_back(p);
+               auto cmp = keys[i] <=> p->avl_data_;
+               greater[i] = cmp > 0;
+               if (cmp == 0) {
+                 return static_cast<NodePtr>(nullptr);
+               }
+               return p->avl_link_[cmp > 0];
+             });
+  for (std::size_t i = 0; i < keys.size(); ++i) {
+    if (greater[i]) {
+      result[i].NextNode();
+    }
+  }
+  return result;
+}
+
+// Every range is answered as rank(second, inclusive) - rank(first), the two
+// descents run in separate lanes.
+template <class T>
+std::vector<int>
+Adt<T>::count_many(std::span<const std::pair<T, T>> ranges) const {
+  if (ranges.size() * kSortedRatio >= size()) {
+    return count_many_sorted(ranges);
+  }
+  RefreshTags();
+  std::vector<std::size_t> ranks(ranges.size() * 2, 0);
+  Interleave(ranks.size(), [&ranges, &ranks](std::size_t i, NodePtr p) {
+    const auto &range = ranges[i / 2];
+    bool upper = i % 2 == 1;
+    auto cmp = (upper ? range.second : range.first) <=> p->avl_data_;
+    if (cmp < 0 || (cmp == 0 && !upper)) {
+      return p->avl_link_[0];
+    }
+    ranks[i] += Count(p->avl_link_[0]) + p->avl_count_;
+    return p->avl_link_[1];
+  });
+  std::vector<int> result(ranges.size(), 0);
+  for (std::size_t i = 0; i < ranges.size(); ++i) {
+    if (ranges[i].first <= ranges[i].second) {
+      result[i] = static_cast<int>(ranks[2 * i + 1] - ranks[2 * i]);
+    }
+  }
+  return result;
+}
+
+// A frame holds the keys of one subtree; the keys that belong to the left
+// subtree of its root form a prefix, so a frame is split with one binary
+// search and the rest gain the rank of the root. Subtrees without keys are
+// never entered, their size comes from Tag::count_.
+template <class T>
+template <class Left, class Out>
+void Adt<T>::SplitWalk(std::size_t n, Left left, Out out) const {
+  RefreshTags();
+  struct Frame {
+    NodePtr p;
+    std::size_t first; // keys [first, last) are in subtree p
+    std::size_t last;
+    std::size_t base; // rank of subtree p
+  };
+  InlineStack<Frame, kMaxStack + 1> stack;
+  if (n > 0) {
+    stack.push_back({root_, 0, n, 0});
+  }
+  while (!stack.empty()) {
+    auto [p, first, last, base] = stack.back();
+    stack.pop_back();
+    if (nullptr == p) {
+      for (std::size_t i = first; i < last; ++i) {
+        out(i, base);
+      }
+      continue;
+    }
+    PushShift(p);
+    std::size_t lo = first;
+    std::size_t hi = last;
+    while (lo < hi) { // first key not in the left subtree
+      std::size_t mid = lo + (hi - lo) / 2;
+      if (left(mid, p)) {
+        lo = mid + 1;
+      } else {
+        hi = mid;
+      }
+    }
+    if (lo < last) {
+      stack.push_back({p->avl_link_[1], lo, last,
+                       base + Count(p->avl_link_[0]) + p->avl_count_});
+    }
+    if (first < lo) {
+      stack.push_back({p->avl_link_[0], first, lo, base});
+    }
+  }
+}
+
+// Range ends are sorted by key, a lower end before an upper end of the same
+// key: a lower end equal to a node key goes left, an upper one goes right.
+template <class T>
+std::vector<int>
+Adt<T>::count_many_sorted(std::span<const std::pair<T, T>> ranges) const {
+  struct End {
+    T key;
+    std::size_t slot; // 2 * range + (1 for upper end)
+  };
+  std::vector<End> ends;
+  ends.reserve(ranges.size() * 2);
+  for (std::size_t i = 0; i < ranges.size(); ++i) {
+    ends.push_back({ranges[i].first, 2 * i});
+    ends.push_back({ranges[i].second, 2 * i + 1});
+  }
+  std::sort(ends.begin(), ends.end(), [](const End &a, const End &b) {
+    auto cmp = a.key <=> b.key;
+    return cmp < 0 || (cmp == 0 && (a.slot & 1) < (b.slot & 1));
+  });
+  std::vector<std::size_t> ranks(ends.size(), 0);
+  SplitWalk(
+      ends.size(),
+      [&ends](std::size_t i, NodePtr p) {
+        auto cmp = ends[i].key <=> p->avl_data_;
+        return cmp < 0 || (cmp == 0 && (ends[i].slot & 1) == 0);
+      },
+      [&ends, &ranks](std::size_t i, std::size_t rank) {
+        ranks[ends[i].slot] = rank;
+      });
+  std::vector<int> result(ranges.size(), 0);
+  for (std::size_t i = 0; i < ranges.size(); ++i) {
+    if (ranges[i].first <= ranges[i].second) {
+      result[i] = static_cast<int>(ranks[2 * i + 1] - ranks[2 * i]);
+    }
+  }
+  return result;
+}
+
+template <class T>
+std::vector<std::size_t>
+Adt<T>::Histogram(std::span<const T> boundaries) const {
+  std::vector<std::size_t> result;
+  if (boundaries.size() < 2 ||
+      !std::is_sorted(boundaries.begin(), boundaries.end())) {
+    return result;
+  }
+  std::vector<std::size_t> ranks(boundaries.size(), 0);
+  SplitWalk(
+      boundaries.size(),
+      [&boundaries](std::size_t i, NodePtr p) {
+        return !(p->avl_data_ < boundaries[i]);
+      },
+      [&ranks](std::size_t i, std::size_t rank) { ranks[i] = rank; });
+  result.resize(boundaries.size() - 1);
+  for (std::size_t i = 0; i < result.size(); ++i) {
+    result[i] = ranks[i + 1] - ranks[i];
+  }
+  return result;
+}
+
 // lower_bound element not less than v , if not found = return end()
 template <class T>
 typename Adt<T>::Iterator Adt<T>::lower_bound(const T &v) const {
@@ -781,12 +2056,12 @@ typename Adt<T>::Iterator Adt<T>::lower_bound(const T &v) const {
     return end();
   }
   NodePtrStack stack;
-  stack.reserve(kMaxStack);
   std::strong_ordering cmp = std::strong_ordering::equivalent;
 
   int dir = 0;
 
   for (NodePtr p = root_; p != nullptr;) {
+    PushShift(p);
     cmp = v <=> p->avl_data_;
     stack.push_back(p);
     if (0 == cmp) {
@@ -796,9 +2071,9 @@ typename Adt<T>::Iterator Adt<T>::lower_bound(const T &v) const {
     p = p->avl_link_[dir];
   }
 
-  auto result = Iterator(this, std::move(stack));
+  auto result = Iterator(this, stack);
   if (cmp > 0) {
-    ++result;
+    result.NextNode();
   }
   return result;
 }
@@ -810,12 +2085,12 @@ typename Adt<T>::Iterator Adt<T>::upper_bound(const T &v) const {
     return end();
   }
   NodePtrStack stack;
-  stack.reserve(kMaxStack);
   std::strong_ordering cmp = std::strong_ordering::equivalent;
 
   int dir = 0;
 
   for (NodePtr p = root_; p != nullptr;) {
+    PushShift(p);
     cmp = v <=> p->avl_data_;
     stack.push_back(p);
     if (0 == cmp) {
@@ -825,9 +2100,9 @@ typename Adt<T>::Iterator Adt<T>::upper_bound(const T &v) const {
     p = p->avl_link_[dir];
   }
 
-  auto result = Iterator(this, std::move(stack));
+  auto result = Iterator(this, stack);
   if (cmp >= 0) {
-    ++result;
+    result.NextNode();
   }
   return result;
 }
@@ -0,0 +1,91 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+namespace adt {
+
+template <class T>
+// SpscRing - bounded queue between one producer thread and one consumer
+// thread. tail_ is written only by the producer and head_ only by the
+// consumer, so push and pop take no lock: an acquire load of the other index
+// and a release store of the own one. Each side also caches the last index it
+// saw of the other side and reloads it only when the ring looks full/empty,
+// which keeps the two cache lines from bouncing on every call. Blocking
+// push()/pop() spin shortly, then sleep in std::atomic::wait.
+class SpscRing {
+  static constexpr std::size_t kLine = 64;
+  static constexpr int kSpins = 64;
+
+public:
+  // capacity is rounded up to a power of two
+  explicit SpscRing(std::size_t capacity)
+      : slots_(std::bit_ceil(std::max<std::size_t>(capacity, 1))),
+        mask_(slots_.size() - 1) {}
+  SpscRing(const SpscRing &) = delete;
+  SpscRing &operator=(const SpscRing &) = delete;
+
+  std::size_t Capacity() const { return slots_.size(); }
+
+  // producer: false if ring is full, value is moved only on success
+  bool try_push(T &value) {
+    std::size_t tail = tail_.load(std::memory_order_relaxed);
+    if (tail - head_cache_ == slots_.size()) {
+      head_cache_ = head_.load(std::memory_order_acquire);
+      if (tail - head_cache_ == slots_.size()) {
+        return false;
+      }
+    }
+    slots_[tail & mask_] = std::move(value);
+    tail_.store(tail + 1, std::memory_order_release);
+    tail_.notify_one();
+    return true;
+  }
+  // consumer: false if ring is empty
+  bool try_pop(T &value) {
+    std::size_t head = head_.load(std::memory_order_relaxed);
+    if (head == tail_cache_) {
+      tail_cache_ = tail_.load(std::memory_order_acquire);
+      if (head == tail_cache_) {
+        return false;
+      }
+    }
+    value = std::move(slots_[head & mask_]);
+    head_.store(head + 1, std::memory_order_release);
+    head_.notify_one();
+    return true;
+  }
+  // producer: wait while ring is full
+  void push(T value) {
+    for (int spin = 0; !try_push(value); ++spin) {
+      if (spin >= kSpins) {
+        head_.wait(tail_.load(std::memory_order_relaxed) - slots_.size(),
+                   std::memory_order_acquire);
+      }
+    }
+  }
+  // consumer: wait while ring is empty
+  T pop() {
+    T value;
+    for (int spin = 0; !try_pop(value); ++spin) {
+      if (spin >= kSpins) {
+        tail_.wait(head_.load(std::memory_order_relaxed),
+                   std::memory_order_acquire);
+      }
+    }
+    return value;
+  }
+
+private:
+  std::vector<T> slots_;
+  std::size_t mask_;
+  alignas(kLine) std::atomic<std::size_t> head_ = 0; // next slot to pop
+  std::size_t tail_cache_ = 0;                       // consumer's view of tail_
+  alignas(kLine) std::atomic<std::size_t> tail_ = 0; // next slot to push
+  std::size_t head_cache_ = 0;                       // producer's view of head_
+};
+
+} // namespace adt
@@ -0,0 +1,212 @@
+#pragma once
+#include <algorithm>
+#include <bit>
+#include <cassert>
+#include <compare>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <utility>
+
+#include "simple_adt.h"
+
+namespace adt {
+
+// StringKey - string key of Adt. Keys up to kInline bytes live inside of the
+// node; a longer key keeps its first kPrefix bytes there next to the pointer
+// to its heap copy. Comparison starts with the prefix loaded as one
+// big-endian word, so keys that differ in it are ordered without a call or a
+// heap access. Borrow() builds a lookup key that points to the caller's bytes
+// instead of copying them; copies of any key own their bytes.
+class StringKey {
+public:
+  static constexpr std::size_t kPrefix = 8;
+  static constexpr std::size_t kInline = 28;
+
+  StringKey() = default;
+  explicit StringKey(std::string_view s) { Assign(s, false); }
+  // key valid while s is, no allocation
+  static StringKey Borrow(std::string_view s) {
+    StringKey key;
+    key.Assign(s, true);
+    return key;
+  }
+  StringKey(const StringKey &other) : StringKey(other.view()) {}
+  StringKey(StringKey &&other) noexcept { swap(other); }
+  StringKey &operator=(StringKey other) noexcept {
+    swap(other);
+    return *this;
+  }
+  ~StringKey() {
+    if (size() > kInline && 0 == (size_ & kBorrowed)) {
+      delete[] Heap();
+    }
+  }
+  void swap(StringKey &other) noexcept {
+    std::swap(bytes_, other.bytes_);
+    std::swap(size_, other.size_);
+  }
+
+  std::size_t size() const { return size_ & ~kBorrowed; }
+  const char *data() const { return size() <= kInline ? bytes_ : Heap(); }
+  std::string_view view() const { return {data(), size()}; }
+  std::string str() const { return std::string(view()); }
+
+  friend bool operator==(const StringKey &a, const StringKey &b) {
+    return a.size() == b.size() && a.Prefix() == b.Prefix() &&
+           a.view() == b.view();
+  }
+  // Prefixes are zero padded: a shorter key that matches the other one up
+  // to its end has the smaller or the same word, equal words leave the
+  // decision to the whole keys.
+  friend std::strong_ordering operator<=>(const StringKey &a,
+                                          const StringKey &b) {
+    std::uint64_t x = a.Prefix();
+    std::uint64_t y = b.Prefix();
+    if (x != y) {
+      return x <=> y;
+    }
+    return a.view() <=> b.view();
+  }
+
+private:
+  // size_ flag: heap bytes belong to the caller of Borrow()
+  static constexpr std::uint32_t kBorrowed = 1u << 31;
+
+  // short key, or prefix and heap pointer of a long one; unused bytes are 0
+  char bytes_[kInline] = {};
+  std::uint32_t size_ = 0;
+
+  void Assign(std::string_view s, bool borrow) {
+    assert(s.size() < kBorrowed);
+    size_ = static_cast<std::uint32_t>(s.size());
+    if (s.size() <= kInline) {
+      std::copy(s.begin(), s.end(), bytes_);
+      return;
+    }
+    std::memcpy(bytes_, s.data(), kPrefix);
+    const char *heap = s.data();
+    if (borrow) {
+      size_ |= kBorrowed;
+    } else {
+      char *copy = new char[s.size()];
+      std::memcpy(copy, s.data(), s.size());
+      heap = copy;
+    }
+    std::memcpy(bytes_ + kPrefix, &heap, sizeof(heap));
+  }
+  const char *Heap() const {
+    const char *heap;
+    std::memcpy(&heap, bytes_ + kPrefix, sizeof(heap));
+    return heap;
+  }
+  std::uint64_t Prefix() const {
+    std::uint64_t word;
+    std::memcpy(&word, bytes_, sizeof(word));
+    if constexpr (std::endian::native == std::endian::little) {
+#if defined(__GNUC__)
+      word = __builtin_bswap64(word);
+#else
+      std::uint64_t swapped = 0;
+      for (std::size_t i = 0; i < sizeof(word); ++i, word >>= 8) {
+        swapped = swapped << 8 | (word & 0xff);
+      }
+      word = swapped;
+#endif
+    }
+    return word;
+  }
+};
+
+// StringAdt - Adt of StringKey with std::string_view lookups. Query keys are
+// borrowed, so lookups and counts never allocate. Ranges are counted by two
+// rank descents, one comparison per node, instead of Adt::CountByRange that
+// also compares keys of Tag bound nodes; CountByPrefix is a range count.
+class StringAdt {
+  using NodePtr = Adt<StringKey>::NodePtr;
+
+public:
+  using Tree = Adt<StringKey>;
+
+  // number of keys
+  std::size_t size() const { return tree_.size(); }
+  // false if key is already stored (set mode)
+  bool insert(std::string_view key) {
+    return tree_.insert(StringKey::Borrow(key)).second;
+  }
+  // removes one copy of key, returns number of removed keys (0 or 1)
+  std::size_t erase(std::string_view key) {
+    return tree_.erase(StringKey::Borrow(key));
+  }
+  bool contains(std::string_view key) const { return count(key) > 0; }
+  // number of copies of key
+  std::size_t count(std::string_view key) const {
+    return tree_.count(StringKey::Borrow(key));
+  }
+  // number of keys less than key
+  std::size_t rank(std::string_view key) const {
+    return tree_.rank(StringKey::Borrow(key));
+  }
+  // number of keys in [first, second]
+  int CountByRange(std::string_view first, std::string_view second) const {
+    if (second < first) {
+      return 0;
+    }
+    return static_cast<int>(UpTo(second) - rank(first));
+  }
+  // number of keys starting with prefix
+  std::size_t CountByPrefix(std::string_view prefix) const;
+  // call f(std::string_view) for every key in [first, second] in order
+  template <class F>
+  void for_each_in_range(std::string_view first, std::string_view second,
+                         F f) const {
+    tree_.for_each_in_range(StringKey::Borrow(first),
+                            StringKey::Borrow(second),
+                            [&f](const StringKey &key) { f(key.view()); });
+  }
+  void SetMultiset(bool multiset) { tree_.SetMultiset(multiset); }
+  void Clear() { tree_.Clear(); }
+  Tree &Base() { return tree_; }
+  const Tree &Base() const { return tree_; }
+
+private:
+  Tree tree_;
+
+  // number of keys not greater than key
+  std::size_t UpTo(std::string_view key) const;
+};
+
+inline std::size_t StringAdt::UpTo(std::string_view key) const {
+  const StringKey bound = StringKey::Borrow(key);
+  tree_.RefreshTags();
+  std::size_t result = 0;
+  for (NodePtr p = tree_.root_; nullptr != p;) {
+    if (bound < p->avl_data_) {
+      p = p->avl_link_[0];
+    } else {
+      result += Tree::Count(p->avl_link_[0]) + p->avl_count_;
+      p = p->avl_link_[1];
+    }
+  }
+  return result;
+}
+
+// Keys with the prefix are [prefix, end) where end is the prefix with its
+// last byte below 0xff incremented and the following bytes dropped; without
+// such a byte every key from prefix on matches.
+inline std::size_t StringAdt::CountByPrefix(std::string_view prefix) const {
+  std::size_t first = rank(prefix);
+  std::string end(prefix);
+  while (!end.empty() && static_cast<unsigned char>(end.back()) == 0xff) {
+    end.pop_back();
+  }
+  if (end.empty()) {
+    return size() - first;
+  }
+  end.back() = static_cast<char>(static_cast<unsigned char>(end.back()) + 1);
+  return rank(end) - first;
+}
+
+} // namespace adt
@@ -0,0 +1,403 @@
+#pragma once
+#if defined(__unix__)
+#include <algorithm>
+#include <charconv>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <span>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "simple_adt.h"
+
+namespace adt {
+
+template <class T>
+// WriteAheadLog - append-only log of keys with group commit: keys are
+// buffered and written as one batch with one fdatasync per GroupSize() keys.
+// A batch is {count, checksum, keys}; replay stops at the first torn or
+// corrupted batch, so a crash loses at most the uncommitted keys.
+class WriteAheadLog {
+  static_assert(std::is_trivially_copyable_v<T>,
+                "WriteAheadLog stores keys as raw bytes");
+
+  struct BatchHeader {
+    std::uint64_t count;
+    std::uint64_t checksum; // FNV-1a of count and keys
+  };
+
+public:
+  WriteAheadLog() = default;
+  WriteAheadLog(const WriteAheadLog &) = delete;
+  WriteAheadLog &operator=(const WriteAheadLog &) = delete;
+  ~WriteAheadLog() { Close(); }
+
+  // open log at path for appending, create it if needed
+  bool Open(const std::string &path, std::size_t group_size);
+  // commit pending keys and close
+  bool Close();
+  bool IsOpen() const { return fd_ >= 0; }
+  // buffer key, commit when the group is full
+  bool Append(const T &key) {
+    if (failed_) {
+      return false;
+    }
+    batch_.push_back(key);
+    return batch_.size() < group_size_ || Commit();
+  }
+  // Write pending keys as one batch and wait for the disk. On a write error
+  // the log is cut back to the end of the last batch and the keys stay
+  // pending for the next call. If that is not possible, or the disk did not
+  // confirm a written batch, the log fails: Append() and Commit() return false
+  // until the next Open().
+  bool Commit();
+  bool Failed() const { return failed_; }
+  std::size_t GroupSize() const { return group_size_; }
+  // number of fdatasync calls
+  std::size_t Syncs() const { return syncs_; }
+  // call f(key) for every committed key of log at path, return their number
+  template <class F> static std::size_t Replay(const std::string &path, F f);
+
+private:
+  int fd_ = -1;
+  std::size_t group_size_ = 1;
+  std::size_t syncs_ = 0;
+  bool failed_ = false;
+  std::vector<T> batch_;
+  std::vector<char> buffer_;
+
+  static std::uint64_t Checksum(std::uint64_t count, const void *keys) {
+    return Fnv1a(keys, count * sizeof(T), Fnv1a(&count, sizeof(count)));
+  }
+};
+
+template <class T>
+bool WriteAheadLog<T>::Open(const std::string &path, std::size_t group_size) {
+  Close();
+  group_size_ = std::max<std::size_t>(group_size, 1);
+  failed_ = false;
+  batch_.reserve(group_size_);
+  fd_ = open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+  return fd_ >= 0;
+}
+
+template <class T> bool WriteAheadLog<T>::Close() {
+  bool ok = Commit();
+  if (fd_ >= 0) {
+    ok = close(fd_) == 0 && ok;
+  }
+  fd_ = -1;
+  batch_.clear();
+  return ok;
+}
+
+// A batch after a torn one is never replayed, so a partly written batch must
+// not stay in front of the next one.
+template <class T> bool WriteAheadLog<T>::Commit() {
+  if (failed_) {
+    return false;
+  }
+  if (batch_.empty()) {
+    return true;
+  }
+  if (fd_ < 0) {
+    return false;
+  }
+  BatchHeader header{batch_.size(), Checksum(batch_.size(), batch_.data())};
+  buffer_.resize(sizeof(header) + batch_.size() * sizeof(T));
+  std::memcpy(buffer_.data(), &header, sizeof(header));
+  std::memcpy(buffer_.data() + sizeof(header), batch_.data(),
+              batch_.size() * sizeof(T));
+  const off_t end = lseek(fd_, 0, SEEK_END);
+  for (std::size_t done = 0; done < buffer_.size();) {
+    ssize_t n = write(fd_, buffer_.data() + done, buffer_.size() - done);
+    if (n < 0) {
+      failed_ = end < 0 || ftruncate(fd_, end) != 0;
+      return false;
+    }
+    done += static_cast<std::size_t>(n);
+  }
+  ++syncs_;
+  if (fdatasync(fd_) != 0) {
+    failed_ = true; // written pages may be lost, the retry can not know
+    return false;
+  }
+  batch_.clear();
+  return true;
+}
+
+template <class T>
+template <class F>
+std::size_t WriteAheadLog<T>::Replay(const std::string &path, F f) {
+  std::ifstream in(path, std::ios::binary);
+  std::vector<char> data((std::istreambuf_iterator<char>(in)),
+                         std::istreambuf_iterator<char>());
+  std::size_t keys = 0;
+  BatchHeader header;
+  for (std::size_t pos = 0; pos + sizeof(header) <= data.size();) {
+    std::memcpy(&header, data.data() + pos, sizeof(header));
+    pos += sizeof(header);
+    if (header.count > (data.size() - pos) / sizeof(T) ||
+        header.checksum != Checksum(header.count, data.data() + pos)) {
+      break; // torn tail
+    }
+    for (std::uint64_t i = 0; i < header.count; ++i, pos += sizeof(T)) {
+      T key;
+      std::memcpy(&key, data.data() + pos, sizeof(T));
+      f(key);
+    }
+    keys += header.count;
+  }
+  return keys;
+}
+
+template <class T>
+// DurableAdt - Adt whose inserts survive restarts. Every new key goes to the
+// current log (wal.N) with group commit. A checkpoint switches to log N + 1,
+// copies the keys of the tree and leaves the rest to a background thread: it
+// serializes the copy, the snapshot becomes checkpoint.N by an atomic
+// rename, then older checkpoints and logs up to N are removed. Open() loads
+// the latest checkpoint and replays the logs after it. Ingest still stalls
+// for the O(N) key copy, and the copy holds sizeof(T) bytes per key until
+// the checkpoint is written; the snapshot is streamed to the file.
+class DurableAdt {
+public:
+  struct Options {
+    std::size_t group_commit = 256; // keys per fdatasync
+    // new keys between checkpoints, 0 - never
+    std::size_t checkpoint_every = 0;
+  };
+
+  DurableAdt() = default;
+  DurableAdt(const DurableAdt &) = delete;
+  DurableAdt &operator=(const DurableAdt &) = delete;
+  ~DurableAdt() { Close(); }
+
+  // recover tree from directory dir (created if needed) and start a new log
+  bool Open(const std::string &dir, Options options);
+  // commit log, wait for checkpoint writer
+  bool Close();
+  // insert key, log it if it is new
+  bool insert(const T &key);
+  // make all inserted keys durable
+  bool Commit() { return wal_.Commit(); }
+  // start background checkpoint of current tree
+  bool Checkpoint();
+  // wait for background checkpoint, false if it failed (reported once)
+  bool WaitCheckpoint();
+
+  std::size_t size() const { return tree_.size(); }
+  // keys replayed from logs by Open()
+  std::size_t ReplayedKeys() const { return replayed_; }
+  std::size_t Syncs() const { return wal_.Syncs(); }
+  // count items in range
+  int CountByRange(const T &first, const T &second) const {
+    return tree_.CountByRange(first, second);
+  }
+  // CountByRange() for every range
+  std::vector<int> count_many(std::span<const std::pair<T, T>> ranges) const {
+    return tree_.count_many(ranges);
+  }
+  const Adt<T> &Tree() const { return tree_; }
+
+private:
+  Adt<T> tree_;
+  WriteAheadLog<T> wal_;
+  std::filesystem::path dir_;
+  Options options_;
+  std::uint64_t log_seq_ = 0; // number of current log
+  std::size_t since_checkpoint_ = 0;
+  std::size_t replayed_ = 0;
+  std::thread writer_;
+  bool writer_ok_ = true;
+
+  std::filesystem::path FilePath(const char *prefix, std::uint64_t seq) const {
+    char name[32];
+    std::snprintf(name, sizeof(name), "%s.%010llu", prefix,
+                  static_cast<unsigned long long>(seq));
+    return dir_ / name;
+  }
+  // number of file named prefix.number, 0 - other file
+  static std::uint64_t FileSeq(const std::filesystem::path &path,
+                               const std::string &prefix);
+  // write checkpoint.covered and drop files it replaces
+  bool WriteCheckpoint(std::uint64_t covered, const std::vector<T> &keys,
+                       bool multiset);
+  bool SyncDir() const;
+};
+
+template <class T>
+std::uint64_t DurableAdt<T>::FileSeq(const std::filesystem::path &path,
+                                     const std::string &prefix) {
+  std::string name = path.filename().string();
+  if (name.size() <= prefix.size() + 1 || !name.starts_with(prefix + ".")) {
+    return 0;
+  }
+  // digits only, a number past 64 bits is some other file as well
+  const char *first = name.data() + prefix.size() + 1;
+  const char *last = name.data() + name.size();
+  std::uint64_t seq = 0;
+  auto [ptr, ec] = std::from_chars(first, last, seq);
+  return ec == std::errc{} && ptr == last ? seq : 0;
+}
+
+template <class T> bool DurableAdt<T>::SyncDir() const {
+  int fd = open(dir_.c_str(), O_RDONLY | O_DIRECTORY);
+  bool ok = fd >= 0 && fsync(fd) == 0;
+  if (fd >= 0) {
+    close(fd);
+  }
+  return ok;
+}
+
+template <class T>
+bool DurableAdt<T>::Open(const std::string &dir, Options options) {
+  Close();
+  dir_ = dir;
+  options_ = options;
+  writer_ok_ = true;
+  std::error_code error;
+  std::filesystem::create_directories(dir_, error);
+  if (error) {
+    return false;
+  }
+  std::vector<std::uint64_t> checkpoints;
+  std::vector<std::uint64_t> logs;
+  for (const auto &entry : std::filesystem::directory_iterator(dir_, error)) {
+    if (auto seq = FileSeq(entry.path(), "checkpoint")) {
+      checkpoints.push_back(seq);
+    } else if (auto seq = FileSeq(entry.path(), "wal")) {
+      logs.push_back(seq);
+    }
+  }
+  // Step 1 : Load the latest readable checkpoint
+  std::sort(checkpoints.rbegin(), checkpoints.rend());
+  std::uint64_t covered = 0;
+  tree_.Clear();
+  for (auto seq : checkpoints) {
+    std::ifstream in(FilePath("checkpoint", seq), std::ios::binary);
+    if (in && tree_.LoadSnapshot(in)) {
+      covered = seq;
+      break;
+    }
+  }
+  // Step 2 : Replay logs written after it
+  std::sort(logs.begin(), logs.end());
+  replayed_ = 0;
+  for (auto seq : logs) {
+    if (seq > covered) {
+      replayed_ += WriteAheadLog<T>::Replay(
+          FilePath("wal", seq), [this](const T &key) { tree_.insert(key); });
+    }
+  }
+  // Step 3 : New log after all existing ones, a torn tail is never extended
+  log_seq_ = std::max(covered, logs.empty() ? 0 : logs.back()) + 1;
+  since_checkpoint_ = 0;
+  return wal_.Open(FilePath("wal", log_seq_), options_.group_commit) &&
+         SyncDir();
+}
+
+template <class T> bool DurableAdt<T>::Close() {
+  bool ok = WaitCheckpoint();
+  return wal_.Close() && ok;
+}
+
+template <class T> bool DurableAdt<T>::insert(const T &key) {
+  if (!tree_.insert(key).second) {
+    return true; // nothing to log
+  }
+  if (!wal_.Append(key)) {
+    return false;
+  }
+  if (options_.checkpoint_every != 0 &&
+      ++since_checkpoint_ >= options_.checkpoint_every) {
+    return Checkpoint();
+  }
+  return true;
+}
+
+// The writer never touches the tree: the foreground copies its keys in
+// order, one sequential pass, and the writer builds the snapshot of a
+// balanced tree of them.
+template <class T> bool DurableAdt<T>::Checkpoint() {
+  if (!wal_.IsOpen()) {
+    return false;
+  }
+  if (!WaitCheckpoint()) {
+    // the previous checkpoint failed, the next one is due after another
+    // checkpoint_every keys; its logs are kept, so nothing is lost
+    since_checkpoint_ = 0;
+    return false;
+  }
+  std::uint64_t covered = log_seq_;
+  if (!wal_.Close() ||
+      !wal_.Open(FilePath("wal", ++log_seq_), options_.group_commit)) {
+    return false;
+  }
+  since_checkpoint_ = 0;
+  writer_ = std::thread([this, covered, multiset = tree_.Multiset(),
+                         keys = tree_.GetInorderVector()] {
+    writer_ok_ = WriteCheckpoint(covered, keys, multiset);
+  });
+  return true;
+}
+
+template <class T> bool DurableAdt<T>::WaitCheckpoint() {
+  if (writer_.joinable()) {
+    writer_.join();
+  }
+  bool ok = writer_ok_;
+  writer_ok_ = true; // a failure is reported once
+  return ok;
+}
+
+template <class T>
+bool DurableAdt<T>::WriteCheckpoint(std::uint64_t covered,
+                                    const std::vector<T> &keys,
+                                    bool multiset) {
+  // Step 1 : Durable temporary file, the snapshot is streamed into it
+  auto tmp = dir_ / "checkpoint.tmp";
+  bool ok = false;
+  {
+    std::ofstream out(tmp, std::ios::binary | std::ios::trunc);
+    ok = out && Adt<T>::SaveSnapshot(out, keys, multiset) && out.flush();
+  }
+  int fd = ok ? open(tmp.c_str(), O_WRONLY) : -1;
+  if (fd < 0) {
+    return false;
+  }
+  ok = fsync(fd) == 0;
+  ok = close(fd) == 0 && ok;
+  if (!ok) {
+    return false;
+  }
+  // Step 2 : Atomic rename, then files it replaces can go
+  std::error_code error;
+  std::filesystem::rename(tmp, FilePath("checkpoint", covered), error);
+  if (error || !SyncDir()) {
+    return false;
+  }
+  for (const auto &entry : std::filesystem::directory_iterator(dir_, error)) {
+    auto checkpoint = FileSeq(entry.path(), "checkpoint");
+    auto log = FileSeq(entry.path(), "wal");
+    if ((checkpoint != 0 && checkpoint < covered) ||
+        (log != 0 && log <= covered)) {
+      std::filesystem::remove(entry.path(), error);
+    }
+  }
+  return true;
+}
+
+} // namespace adt
+#endif
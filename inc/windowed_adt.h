@@ -0,0 +1,125 @@
+#pragma once
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <span>
+#include <utility>
+#include <vector>
+
+#include "simple_adt.h"
+
+namespace adt {
+
+template <class T>
+// WindowedAdt - multiset of the last Window() inserted keys and/or the keys
+// inserted during the last Ttl(). Every key is also kept in an insertion-order
+// ring; a key that falls out of the window is erased from the tree in
+// O(log N), so CountByRange always answers for the current window.
+class WindowedAdt {
+public:
+  using Clock = std::chrono::steady_clock;
+
+  // window - max number of keys (0 - unbounded), ttl - max age of a key
+  // (zero - unbounded)
+  explicit WindowedAdt(std::size_t window,
+                       Clock::duration ttl = Clock::duration::zero())
+      : window_(window), ttl_(ttl) {
+    tree_.SetMultiset(true);
+  }
+
+  // number of keys in window
+  std::size_t size() const { return tree_.size(); }
+  std::size_t Window() const { return window_; }
+  Clock::duration Ttl() const { return ttl_; }
+  // add key, evict keys that leave the window
+  void insert(const T &key) {
+    insert(key, ttl_ == Clock::duration::zero() ? Clock::time_point{}
+                                                : Clock::now());
+  }
+  // add key inserted at now (must not decrease between calls)
+  void insert(const T &key, Clock::time_point now);
+  // evict keys inserted before now - Ttl()
+  void Expire(Clock::time_point now);
+  // count items in range
+  int CountByRange(const T &first, const T &second) const {
+    return tree_.CountByRange(first, second);
+  }
+  // CountByRange() for every range
+  std::vector<int> count_many(std::span<const std::pair<T, T>> ranges) const {
+    return tree_.count_many(ranges);
+  }
+  // keys of current window
+  const Adt<T> &Tree() const { return tree_; }
+  void Clear() {
+    tree_.Clear();
+    ring_.clear();
+    head_ = 0;
+    count_ = 0;
+  }
+
+private:
+  struct Entry {
+    T key;
+    Clock::time_point stamp;
+  };
+
+  Adt<T> tree_;
+  std::vector<Entry> ring_; // grows up to window_ entries
+  std::size_t head_ = 0;    // oldest entry
+  std::size_t count_ = 0;   // entries in ring
+  std::size_t window_;
+  Clock::duration ttl_;
+
+  std::size_t Slot(std::size_t i) const {
+    i += head_;
+    return i < ring_.size() ? i : i - ring_.size();
+  }
+  void PopOldest() {
+    tree_.erase(ring_[head_].key);
+    head_ = Slot(1);
+    --count_;
+  }
+  // double ring capacity, entries are moved to the front in insertion order
+  void Grow();
+};
+
+template <class T>
+void WindowedAdt<T>::insert(const T &key, Clock::time_point now) {
+  if (ttl_ != Clock::duration::zero()) {
+    Expire(now);
+  }
+  if (window_ != 0 && count_ == window_) {
+    PopOldest();
+  }
+  if (count_ == ring_.size()) {
+    Grow();
+  }
+  ring_[Slot(count_)] = {key, now};
+  ++count_;
+  tree_.insert(key);
+}
+
+template <class T> void WindowedAdt<T>::Expire(Clock::time_point now) {
+  if (ttl_ == Clock::duration::zero()) {
+    return;
+  }
+  while (count_ > 0 && ring_[head_].stamp + ttl_ <= now) {
+    PopOldest();
+  }
+}
+
+template <class T> void WindowedAdt<T>::Grow() {
+  const std::size_t kMinCapacity = 16;
+  std::size_t capacity = std::max(kMinCapacity, 2 * ring_.size());
+  if (window_ != 0) {
+    capacity = std::min(capacity, window_);
+  }
+  std::vector<Entry> ring(capacity);
+  for (std::size_t i = 0; i < count_; ++i) {
+    ring[i] = std::move(ring_[Slot(i)]);
+  }
+  ring_ = std::move(ring);
+  head_ = 0;
+}
+
+} // namespace adt
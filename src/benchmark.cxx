@@ -0,0 +1,1016 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <filesystem>
+#include <iomanip>
+#include <iostream>
+#include <numeric>
+#include <random>
+#include <set>
+#include <span>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "btree_adt.h"
+#include "compressed_keys.h"
+#include "filtered_adt.h"
+#include "interval_adt.h"
+#include "key_sequences.h"
+#include "learned_index.h"
+#include "persistent_adt.h"
+#include "range_tree_2d.h"
+#include "simple_adt.h"
+#include "string_adt.h"
+#include "wal.h"
+#include "windowed_adt.h"
+
+namespace bench {
+using Clock = std::chrono::steady_clock;
+
+const int kFirst = 0;
+const int kLast = 1000000000;
+const std::size_t kDefaultSize = 1000000;
+
+// Keeps result alive so that measured loop is not optimized out
+volatile std::size_t sink = 0;
+
+template <class F> double MeasureNs(std::size_t ops, F f) {
+  auto start = Clock::now();
+  f();
+  std::chrono::duration<double, std::nano> elapsed = Clock::now() - start;
+  return ops == 0 ? 0.0 : elapsed.count() / ops;
+}
+
+void Report(std::string_view suite, std::string_view name, double ns_per_op) {
+  std::cout << std::left << std::setw(10) << suite << std::setw(36) << name
+            << std::right << std::setw(10) << std::fixed
+            << std::setprecision(1) << ns_per_op << " ns/op\n";
+}
+
+const char *OrderName(seq::Order order) {
+  switch (order) {
+  case seq::Order::kRandom:
+    return "random";
+  case seq::Order::kAscending:
+    return "ascending";
+  case seq::Order::kDescending:
+    return "descending";
+  case seq::Order::kJitter:
+    return "jitter";
+  }
+  return "";
+}
+
+// Insert n keys of each generator order
+void BenchInsert(std::size_t n) {
+  std::mt19937 gen(1);
+  for (auto order : {seq::Order::kRandom, seq::Order::kAscending,
+                     seq::Order::kDescending, seq::Order::kJitter}) {
+    auto keys = seq::MakeKeys(order, n, kFirst, kLast, gen);
+    std::string name = OrderName(order);
+    Report("insert", name + " Adt::insert", MeasureNs(n, [&keys] {
+             adt::Adt<int> t;
+             for (int a : keys) {
+               t.insert(a);
+             }
+             sink = t.size();
+           }));
+    Report("insert", name + " Adt::insert deferred", MeasureNs(n, [&keys] {
+             adt::Adt<int> t;
+             t.SetDeferredTags(true);
+             for (int a : keys) {
+               t.insert(a);
+             }
+             sink = t.size();
+           }));
+    Report("insert", name + " Adt::insert hint", MeasureNs(n, [&keys] {
+             adt::Adt<int> t;
+             auto it = t.end();
+             for (int a : keys) {
+               it = t.insert(it, a).first;
+             }
+             sink = t.size();
+           }));
+    Report("insert", name + " std::set::insert", MeasureNs(n, [&keys] {
+             std::set<int> t;
+             for (int a : keys) {
+               t.insert(a);
+             }
+             sink = t.size();
+           }));
+    Report("insert", name + " std::set::insert hint", MeasureNs(n, [&keys] {
+             std::set<int> t;
+             auto it = t.end();
+             for (int a : keys) {
+               it = t.insert(it, a);
+             }
+             sink = t.size();
+           }));
+  }
+}
+
+// Point and range lookups on a tree of n random keys, one by one and batched
+void BenchLookup(std::size_t n) {
+  std::mt19937 gen(2);
+  adt::Adt<int> t;
+  for (int a : seq::MakeKeys(seq::Order::kRandom, n, kFirst, kLast, gen)) {
+    t.insert(a);
+  }
+  auto keys = seq::MakeKeys(seq::Order::kRandom, n, kFirst, kLast, gen);
+  std::vector<std::pair<int, int>> ranges;
+  ranges.reserve(n);
+  for (int a : keys) {
+    ranges.emplace_back(a, a + (kLast - a) / 16);
+  }
+  const std::size_t batch = 4096;
+  Report("lookup", "Adt::find", MeasureNs(n, [&t, &keys] {
+           std::size_t found = 0;
+           for (int a : keys) {
+             found += t.find(a) != t.end();
+           }
+           sink = found;
+         }));
+  Report("lookup", "Adt::find_many", MeasureNs(n, [&t, &keys, batch] {
+           std::size_t found = 0;
+           for (std::size_t i = 0; i < keys.size(); i += batch) {
+             std::span<const int> run(keys.data() + i,
+                                      std::min(batch, keys.size() - i));
+             for (const auto &it : t.find_many(run)) {
+               found += it != t.end();
+             }
+           }
+           sink = found;
+         }));
+  Report("lookup", "Adt::lower_bound", MeasureNs(n, [&t, &keys] {
+           std::size_t found = 0;
+           for (int a : keys) {
+             found += t.lower_bound(a) != t.end();
+           }
+           sink = found;
+         }));
+  Report("lookup", "Adt::lower_bound_many", MeasureNs(n, [&t, &keys, batch] {
+           std::size_t found = 0;
+           for (std::size_t i = 0; i < keys.size(); i += batch) {
+             std::span<const int> run(keys.data() + i,
+                                      std::min(batch, keys.size() - i));
+             for (const auto &it : t.lower_bound_many(run)) {
+               found += it != t.end();
+             }
+           }
+           sink = found;
+         }));
+  Report("lookup", "Adt::CountByRange", MeasureNs(n, [&t, &ranges] {
+           std::size_t total = 0;
+           for (const auto &range : ranges) {
+             total += t.CountByRange(range.first, range.second);
+           }
+           sink = total;
+         }));
+  Report("lookup", "Adt::count_many", MeasureNs(n, [&t, &ranges, batch] {
+           std::size_t total = 0;
+           for (std::size_t i = 0; i < ranges.size(); i += batch) {
+             std::span<const std::pair<int, int>> run(
+                 ranges.data() + i, std::min(batch, ranges.size() - i));
+             for (int count : t.count_many(run)) {
+               total += count;
+             }
+           }
+           sink = total;
+         }));
+  Report("lookup", "Adt::count_many_sorted",
+         MeasureNs(n, [&t, &ranges, batch] {
+           std::size_t total = 0;
+           for (std::size_t i = 0; i < ranges.size(); i += batch) {
+             std::span<const std::pair<int, int>> run(
+                 ranges.data() + i, std::min(batch, ranges.size() - i));
+             for (int count : t.count_many_sorted(run)) {
+               total += count;
+             }
+           }
+           sink = total;
+         }));
+}
+
+// Enumerate keys of ranges of about 1% of a tree of n random keys
+void BenchRange(std::size_t n) {
+  std::mt19937 gen(3);
+  adt::Adt<int> t;
+  for (int a : seq::MakeKeys(seq::Order::kRandom, n, kFirst, kLast, gen)) {
+    t.insert(a);
+  }
+  const int width = kLast / 100;
+  auto starts = seq::MakeKeys(seq::Order::kRandom, 200, kFirst, kLast - width,
+                              gen);
+  std::size_t items = 0;
+  for (int a : starts) {
+    items += t.CountByRange(a, a + width);
+  }
+  Report("range", "lower_bound + iterator", MeasureNs(items, [&t, &starts] {
+           std::size_t total = 0;
+           for (int a : starts) {
+             for (auto it = t.lower_bound(a), end = t.end();
+                  it != end && *it <= a + width; ++it) {
+               total += *it & 1;
+             }
+           }
+           sink = total;
+         }));
+  Report("range", "for_each_in_range", MeasureNs(items, [&t, &starts] {
+           std::size_t total = 0;
+           for (int a : starts) {
+             t.for_each_in_range(a, a + width,
+                                 [&total](int v) { total += v & 1; });
+           }
+           sink = total;
+         }));
+  Report("range", "copy_range", MeasureNs(items, [&t, &starts] {
+           std::size_t total = 0;
+           for (int a : starts) {
+             std::vector<int> out;
+             t.copy_range(a, a + width, out);
+             total += out.size();
+           }
+           sink = total;
+         }));
+  // 1000 equal buckets over the key range, per histogram
+  std::vector<int> boundaries;
+  for (int b = kFirst; b <= kLast; b += (kLast - kFirst) / 1000) {
+    boundaries.push_back(b);
+  }
+  const std::size_t rounds = 100;
+  Report("range", "Histogram 1000 buckets", MeasureNs(rounds, [&] {
+           std::size_t total = 0;
+           for (std::size_t r = 0; r < rounds; ++r) {
+             total += t.Histogram(boundaries).back();
+           }
+           sink = total;
+         }));
+  Report("range", "CountByRange x 1000", MeasureNs(rounds, [&] {
+           std::size_t total = 0;
+           for (std::size_t r = 0; r < rounds; ++r) {
+             for (std::size_t i = 0; i + 1 < boundaries.size(); ++i) {
+               total += t.CountByRange(boundaries[i], boundaries[i + 1] - 1);
+             }
+           }
+           sink = total;
+         }));
+  // open a gap of 1 above random keys, then count with shifts pending below
+  const std::size_t shifts = 10000;
+  auto cuts = seq::MakeKeys(seq::Order::kRandom, shifts, kFirst, kLast, gen);
+  Report("range", "ShiftFrom", MeasureNs(shifts, [&t, &cuts] {
+           for (int a : cuts) {
+             t.ShiftFrom(a, 1);
+           }
+           sink = t.size();
+         }));
+  Report("range", "CountByRange after ShiftFrom", MeasureNs(shifts, [&] {
+           std::size_t total = 0;
+           for (int a : cuts) {
+             total += t.CountByRange(a, a + width);
+           }
+           sink = total;
+         }));
+}
+
+// Adt against its frozen Eytzinger snapshot on n random keys
+void BenchFrozen(std::size_t n) {
+  std::mt19937 gen(4);
+  adt::Adt<int> t;
+  for (int a : seq::MakeKeys(seq::Order::kRandom, n, kFirst, kLast, gen)) {
+    t.insert(a);
+  }
+  auto frozen = t.Freeze();
+  auto keys = seq::MakeKeys(seq::Order::kRandom, n, kFirst, kLast, gen);
+  std::cout << "frozen    memory Adt " << t.MemoryBytes() / n
+            << " bytes/key, FrozenAdt " << frozen.MemoryBytes() / n
+            << " bytes/key\n";
+  Report("frozen", "Adt::lower_bound", MeasureNs(n, [&t, &keys] {
+           std::size_t found = 0;
+           for (int a : keys) {
+             found += t.lower_bound(a) != t.end();
+           }
+           sink = found;
+         }));
+  Report("frozen", "FrozenAdt::lower_bound", MeasureNs(n, [&frozen, &keys] {
+           std::size_t found = 0;
+           for (int a : keys) {
+             found += frozen.lower_bound(a) != frozen.end();
+           }
+           sink = found;
+         }));
+  Report("frozen", "Adt::CountByRange", MeasureNs(n, [&t, &keys] {
+           std::size_t total = 0;
+           for (int a : keys) {
+             total += t.CountByRange(a, a + (kLast - a) / 16);
+           }
+           sink = total;
+         }));
+  Report("frozen", "FrozenAdt::CountByRange", MeasureNs(n, [&frozen, &keys] {
+           std::size_t total = 0;
+           for (int a : keys) {
+             total += frozen.CountByRange(a, a + (kLast - a) / 16);
+           }
+           sink = total;
+         }));
+}
+
+// Binary AVL tree against the wide-node B+ tree on n random keys
+void BenchBTree(std::size_t n) {
+  std::mt19937 gen(5);
+  auto keys = seq::MakeKeys(seq::Order::kRandom, n, kFirst, kLast, gen);
+  adt::Adt<int> t;
+  adt::BTreeAdt<int> b;
+  Report("btree", "Adt::insert", MeasureNs(n, [&t, &keys] {
+           for (int a : keys) {
+             t.insert(a);
+           }
+           sink = t.size();
+         }));
+  Report("btree", "BTreeAdt::insert", MeasureNs(n, [&b, &keys] {
+           for (int a : keys) {
+             b.insert(a);
+           }
+           sink = b.size();
+         }));
+  std::cout << "btree     height " << b.height() << ", memory Adt "
+            << t.MemoryBytes() / n << " bytes/key, BTreeAdt "
+            << b.MemoryBytes() / n << " bytes/key\n";
+  auto queries = seq::MakeKeys(seq::Order::kRandom, n, kFirst, kLast, gen);
+  Report("btree", "Adt::find", MeasureNs(n, [&t, &queries] {
+           std::size_t found = 0;
+           for (int a : queries) {
+             found += t.find(a) != t.end();
+           }
+           sink = found;
+         }));
+  Report("btree", "BTreeAdt::find", MeasureNs(n, [&b, &queries] {
+           std::size_t found = 0;
+           for (int a : queries) {
+             found += b.find(a) != b.end();
+           }
+           sink = found;
+         }));
+  Report("btree", "Adt::CountByRange", MeasureNs(n, [&t, &queries] {
+           std::size_t total = 0;
+           for (int a : queries) {
+             total += t.CountByRange(a, a + (kLast - a) / 16);
+           }
+           sink = total;
+         }));
+  Report("btree", "BTreeAdt::CountByRange", MeasureNs(n, [&b, &queries] {
+           std::size_t total = 0;
+           for (int a : queries) {
+             total += b.CountByRange(a, a + (kLast - a) / 16);
+           }
+           sink = total;
+         }));
+}
+
+// Lookups on a tree of n random keys before and after Compact()
+void BenchCompact(std::size_t n) {
+  std::mt19937 gen(6);
+  adt::Adt<int> t;
+  for (int a : seq::MakeKeys(seq::Order::kRandom, n, kFirst, kLast, gen)) {
+    t.insert(a);
+  }
+  auto keys = seq::MakeKeys(seq::Order::kRandom, n, kFirst, kLast, gen);
+  auto lookups = [&t, &keys] {
+    std::size_t total = 0;
+    for (int a : keys) {
+      total += t.CountByRange(a, a + (kLast - a) / 16);
+    }
+    sink = total;
+  };
+  Report("compact", "CountByRange scattered", MeasureNs(n, lookups));
+  Report("compact", "Adt::Compact", MeasureNs(n, [&t] { t.Compact(true); }));
+  Report("compact", "CountByRange compacted", MeasureNs(n, lookups));
+}
+
+// Range counts on n random keys: Adt, binary search and learned index
+void BenchLearned(std::size_t n) {
+  std::mt19937 gen(7);
+  adt::Adt<int> t;
+  for (int a : seq::MakeKeys(seq::Order::kRandom, n, kFirst, kLast, gen)) {
+    t.insert(a);
+  }
+  auto sorted = t.GetInorderVector();
+  adt::LearnedIndex<int> index(sorted);
+  std::cout << "learned   epsilon " << index.Epsilon() << ", max error "
+            << index.MaxError() << ", segments " << index.SegmentCount()
+            << ", model " << index.ModelBytes() << " bytes\n";
+  auto keys = seq::MakeKeys(seq::Order::kRandom, n, kFirst, kLast, gen);
+  Report("learned", "Adt::CountByRange", MeasureNs(n, [&t, &keys] {
+           std::size_t total = 0;
+           for (int a : keys) {
+             total += t.CountByRange(a, a + (kLast - a) / 16);
+           }
+           sink = total;
+         }));
+  Report("learned", "binary search count", MeasureNs(n, [&sorted, &keys] {
+           std::size_t total = 0;
+           for (int a : keys) {
+             total += std::upper_bound(sorted.begin(), sorted.end(),
+                                       a + (kLast - a) / 16) -
+                      std::lower_bound(sorted.begin(), sorted.end(), a);
+           }
+           sink = total;
+         }));
+  Report("learned", "LearnedIndex::CountByRange", MeasureNs(n, [&index, &keys] {
+           std::size_t total = 0;
+           for (int a : keys) {
+             total += index.CountByRange(a, a + (kLast - a) / 16);
+           }
+           sink = total;
+         }));
+}
+
+// Compressed store against Adt and plain sorted keys on n random keys
+void BenchCompressed(std::size_t n) {
+  std::mt19937 gen(8);
+  adt::Adt<int> t;
+  for (int a : seq::MakeKeys(seq::Order::kRandom, n, kFirst, kLast, gen)) {
+    t.insert(a);
+  }
+  auto sorted = t.GetInorderVector();
+  adt::CompressedKeys<int> packed(sorted);
+  std::vector<int> dense(n);
+  for (std::size_t i = 0; i < n; ++i) {
+    dense[i] = static_cast<int>(i + i / 10);
+  }
+  adt::CompressedKeys<int> packed_dense(dense);
+  std::vector<int> contiguous(n);
+  std::iota(contiguous.begin(), contiguous.end(), 0);
+  adt::CompressedKeys<int> packed_contiguous(contiguous);
+  std::cout << "compress  memory Adt " << t.MemoryBytes() / n
+            << " bytes/key, random keys "
+            << static_cast<double>(packed.MemoryBytes()) / n
+            << " bytes/key, dense ids "
+            << static_cast<double>(packed_dense.MemoryBytes()) / n
+            << " bytes/key, contiguous ids "
+            << static_cast<double>(packed_contiguous.MemoryBytes()) / n
+            << " bytes/key\n";
+  auto keys = seq::MakeKeys(seq::Order::kRandom, n, kFirst, kLast, gen);
+  Report("compress", "Adt::CountByRange", MeasureNs(n, [&t, &keys] {
+           std::size_t total = 0;
+           for (int a : keys) {
+             total += t.CountByRange(a, a + (kLast - a) / 16);
+           }
+           sink = total;
+         }));
+  Report("compress", "binary search count", MeasureNs(n, [&sorted, &keys] {
+           std::size_t total = 0;
+           for (int a : keys) {
+             total += std::upper_bound(sorted.begin(), sorted.end(),
+                                       a + (kLast - a) / 16) -
+                      std::lower_bound(sorted.begin(), sorted.end(), a);
+           }
+           sink = total;
+         }));
+  Report("compress", "CompressedKeys::CountByRange",
+         MeasureNs(n, [&packed, &keys] {
+           std::size_t total = 0;
+           for (int a : keys) {
+             total += packed.CountByRange(a, a + (kLast - a) / 16);
+           }
+           sink = total;
+         }));
+  std::size_t items = std::max<std::size_t>(n / 10, 1);
+  Report("compress", "CompressedKeys::for_each_in_range",
+         MeasureNs(items, [&packed, &sorted, items] {
+           std::size_t total = 0;
+           packed.for_each_in_range(sorted[0], sorted[items - 1],
+                                    [&total](int v) { total += v & 1; });
+           sink = total;
+         }));
+  Report("compress", "contiguous for_each_in_range",
+         MeasureNs(n, [&packed_contiguous, n] {
+           std::size_t total = 0;
+           packed_contiguous.for_each_in_range(
+               0, static_cast<int>(n - 1), [&total](int v) { total += v & 1; });
+           sink = total;
+         }));
+}
+
+// n samples of about 100 distinct values: multiset mode against std::multiset
+void BenchMultiset(std::size_t n) {
+  std::mt19937 gen(9);
+  std::uniform_int_distribution<> distrib(0, 99);
+  std::vector<int> samples(n);
+  for (auto &a : samples) {
+    a = distrib(gen) * 1000;
+  }
+  adt::Adt<int> t;
+  t.SetMultiset(true);
+  std::multiset<int> m;
+  Report("multiset", "Adt::insert multiset", MeasureNs(n, [&t, &samples] {
+           for (int a : samples) {
+             t.insert(a);
+           }
+           sink = t.size();
+         }));
+  Report("multiset", "std::multiset::insert", MeasureNs(n, [&m, &samples] {
+           for (int a : samples) {
+             m.insert(a);
+           }
+           sink = m.size();
+         }));
+  std::cout << "multiset  memory Adt " << t.MemoryBytes() << " bytes\n";
+  Report("multiset", "Adt::CountByRange", MeasureNs(n, [&t, &samples] {
+           std::size_t total = 0;
+           for (int a : samples) {
+             total += t.CountByRange(a, a + 10000);
+           }
+           sink = total;
+         }));
+}
+
+// Conflict checks against n random reservations: IntervalAdt and linear scan
+void BenchInterval(std::size_t n) {
+  std::mt19937 gen(10);
+  const int length = kLast / static_cast<int>(std::max<std::size_t>(n, 1));
+  std::uniform_int_distribution<> start(kFirst, kLast);
+  std::uniform_int_distribution<> width(0, 4 * length);
+  adt::IntervalAdt<int> t;
+  std::vector<adt::Interval<int>> all;
+  for (std::size_t i = 0; i < n; ++i) {
+    int a = start(gen);
+    int b = a + width(gen);
+    t.insert(a, b);
+    all.push_back({a, b});
+  }
+  std::vector<int> queries(std::min<std::size_t>(n, 10000));
+  for (auto &a : queries) {
+    a = start(gen);
+  }
+  std::size_t scans = std::min<std::size_t>(queries.size(), 100);
+  Report("interval", "linear scan count", MeasureNs(scans, [&] {
+           std::size_t total = 0;
+           for (std::size_t i = 0; i < scans; ++i) {
+             int a = queries[i];
+             for (const auto &v : all) {
+               total += v.first <= a + length && a <= v.second;
+             }
+           }
+           sink = total;
+         }));
+  Report("interval", "IntervalAdt::count_overlapping",
+         MeasureNs(queries.size(), [&t, &queries, length] {
+           std::size_t total = 0;
+           for (int a : queries) {
+             total += t.count_overlapping(a, a + length);
+           }
+           sink = total;
+         }));
+  Report("interval", "IntervalAdt::for_each_overlapping",
+         MeasureNs(queries.size(), [&t, &queries, length] {
+           std::size_t total = 0;
+           for (int a : queries) {
+             t.for_each_overlapping(
+                 a, a + length,
+                 [&total](const adt::Interval<int> &v) { total += v.first; });
+           }
+           sink = total;
+         }));
+}
+
+// Rectangle counts over n random points: RangeTree2D and linear scan
+void BenchRange2D(std::size_t n) {
+  std::mt19937 gen(11);
+  std::uniform_int_distribution<> coord(kFirst, kLast);
+  std::vector<adt::Point<int>> points(n);
+  for (auto &p : points) {
+    p = {coord(gen), coord(gen)};
+  }
+  adt::RangeTree2D<int> t;
+  for (unsigned threads : {1u, 4u}) {
+    Report("range2d",
+           "RangeTree2D::Build " + std::to_string(threads) + " threads",
+           MeasureNs(n, [&t, &points, threads] {
+             t.Build(points, threads);
+             sink = t.size();
+           }));
+  }
+  std::cout << "range2d   memory RangeTree2D " << t.MemoryBytes()
+            << " bytes\n";
+  const int side = kLast / 10;
+  std::vector<adt::Point<int>> corners(std::min<std::size_t>(n, 10000));
+  for (auto &c : corners) {
+    c = {coord(gen), coord(gen)};
+  }
+  std::size_t scans = std::min<std::size_t>(corners.size(), 100);
+  Report("range2d", "linear scan count", MeasureNs(scans, [&] {
+           std::size_t total = 0;
+           for (std::size_t i = 0; i < scans; ++i) {
+             const auto &c = corners[i];
+             for (const auto &p : points) {
+               total += c.x <= p.x && p.x <= c.x + side && c.y <= p.y &&
+                        p.y <= c.y + side;
+             }
+           }
+           sink = total;
+         }));
+  Report("range2d", "RangeTree2D::CountByRect",
+         MeasureNs(corners.size(), [&t, &corners, side] {
+           std::size_t total = 0;
+           for (const auto &c : corners) {
+             total += t.CountByRect(c.x, c.x + side, c.y, c.y + side);
+           }
+           sink = total;
+         }));
+}
+
+// Steady state of a window of n keys: every insert evicts the oldest key
+void BenchWindow(std::size_t n) {
+  std::mt19937 gen(12);
+  std::uniform_int_distribution<> key(kFirst, kLast);
+  std::vector<int> samples(2 * n);
+  for (auto &a : samples) {
+    a = key(gen);
+  }
+  adt::WindowedAdt<int> t(n);
+  for (std::size_t i = 0; i < n; ++i) {
+    t.insert(samples[i]);
+  }
+  Report("window", "WindowedAdt::insert with eviction",
+         MeasureNs(n, [&t, &samples, n] {
+           for (std::size_t i = n; i < samples.size(); ++i) {
+             t.insert(samples[i]);
+           }
+           sink = t.size();
+         }));
+  Report("window", "Adt rebuild every 1000 inserts",
+         MeasureNs(1000, [&samples, n] {
+           adt::Adt<int> rebuilt;
+           rebuilt.SetMultiset(true);
+           for (std::size_t i = samples.size() - n; i < samples.size(); ++i) {
+             rebuilt.insert(samples[i]);
+           }
+           sink = rebuilt.size();
+         }));
+  Report("window", "WindowedAdt::CountByRange", MeasureNs(n, [&t, &samples] {
+           std::size_t total = 0;
+           for (int a : std::span(samples).first(samples.size() / 2)) {
+             total += t.CountByRange(a, a + 10000000);
+           }
+           sink = total;
+         }));
+}
+
+// Restart of a tree of n random keys: snapshot load vs replay of inserts
+void BenchSnapshot(std::size_t n) {
+  std::mt19937 gen(13);
+  auto keys = seq::MakeKeys(seq::Order::kRandom, n, kFirst, kLast, gen);
+  adt::Adt<int> t;
+  for (int a : keys) {
+    t.insert(a);
+  }
+  std::stringstream stream;
+  Report("snapshot", "Adt::SaveSnapshot", MeasureNs(n, [&t, &stream] {
+           sink = t.SaveSnapshot(stream);
+         }));
+  std::string bytes = stream.str();
+  std::cout << "snapshot  size " << bytes.size() << " bytes\n";
+  Report("snapshot", "Adt::LoadSnapshot", MeasureNs(n, [&bytes] {
+           adt::Adt<int> loaded;
+           loaded.LoadSnapshot(std::span<const char>(bytes));
+           sink = loaded.size();
+         }));
+  Report("snapshot", "replay Adt::insert", MeasureNs(n, [&keys] {
+           adt::Adt<int> replayed;
+           for (int a : keys) {
+             replayed.insert(a);
+           }
+           sink = replayed.size();
+         }));
+}
+
+// n random words and n path-like keys with long shared prefixes:
+// Adt<std::string> against StringAdt
+void BenchStrings(std::size_t n) {
+  std::mt19937 gen(14);
+  std::uniform_int_distribution<> letter('a', 'z');
+  std::uniform_int_distribution<> length(6, 20);
+  std::vector<std::string> dirs;
+  for (int i = 0; i < 64; ++i) {
+    dirs.push_back("/srv/www/static/assets/" + std::to_string(i * 7919));
+  }
+  std::uniform_int_distribution<std::size_t> dir(0, dirs.size() - 1);
+  for (bool paths : {false, true}) {
+    std::vector<std::string> keys(n);
+    for (auto &key : keys) {
+      key = paths ? dirs[dir(gen)] + "/" : "";
+      for (int i = length(gen); i > 0; --i) {
+        key += static_cast<char>(letter(gen));
+      }
+    }
+    std::string name = paths ? "paths" : "words";
+    adt::Adt<std::string> strings;
+    adt::StringAdt keyed;
+    Report("strings", name + " Adt<string>::insert",
+           MeasureNs(n, [&strings, &keys] {
+             for (const auto &key : keys) {
+               strings.insert(key);
+             }
+             sink = strings.size();
+           }));
+    Report("strings", name + " StringAdt::insert",
+           MeasureNs(n, [&keyed, &keys] {
+             for (const auto &key : keys) {
+               keyed.insert(key);
+             }
+             sink = keyed.size();
+           }));
+    std::shuffle(keys.begin(), keys.end(), gen);
+    Report("strings", name + " Adt<string>::count",
+           MeasureNs(n, [&strings, &keys] {
+             std::size_t total = 0;
+             for (const auto &key : keys) {
+               total += strings.count(key);
+             }
+             sink = total;
+           }));
+    Report("strings", name + " StringAdt::count",
+           MeasureNs(n, [&keyed, &keys] {
+             std::size_t total = 0;
+             for (const auto &key : keys) {
+               total += keyed.count(key);
+             }
+             sink = total;
+           }));
+    Report("strings", name + " Adt<string>::CountByRange",
+           MeasureNs(n / 2, [&strings, &keys] {
+             std::size_t total = 0;
+             for (std::size_t i = 0; i + 1 < keys.size(); i += 2) {
+               const auto &[a, b] = std::minmax(keys[i], keys[i + 1]);
+               total += strings.CountByRange(a, b);
+             }
+             sink = total;
+           }));
+    Report("strings", name + " StringAdt::CountByRange",
+           MeasureNs(n / 2, [&keyed, &keys] {
+             std::size_t total = 0;
+             for (std::size_t i = 0; i + 1 < keys.size(); i += 2) {
+               const auto &[a, b] = std::minmax(keys[i], keys[i + 1]);
+               total += keyed.CountByRange(a, b);
+             }
+             sink = total;
+           }));
+    Report("strings", name + " StringAdt::CountByPrefix",
+           MeasureNs(n, [&keyed, &keys] {
+             std::size_t total = 0;
+             for (const auto &key : keys) {
+               total += keyed.CountByPrefix(
+                   std::string_view(key).substr(0, key.size() - 4));
+             }
+             sink = total;
+           }));
+  }
+}
+
+// Point lookups into n random keys where 90% or 50% of the probes are absent:
+// plain descents against FilteredAdt and FrozenAdt behind an XorFilter
+void BenchFilter(std::size_t n) {
+  std::mt19937 gen(15);
+  auto keys = seq::MakeKeys(seq::Order::kRandom, n, kFirst, kLast, gen);
+  adt::Adt<int> t;
+  adt::FilteredAdt<int> filtered(n);
+  for (int a : keys) {
+    t.insert(a);
+    filtered.insert(a);
+  }
+  auto frozen = t.Freeze();
+  adt::XorFilter<int> xor_filter;
+  Report("filter", "XorFilter::Build", MeasureNs(n, [&xor_filter, &frozen] {
+           sink = xor_filter.Build(frozen);
+         }));
+  std::cout << "filter    memory Adt " << t.MemoryBytes() * 8.0 / n
+            << " bits/key, BlockedBloomFilter "
+            << filtered.FilterBytes() * 8.0 / n << " bits/key, XorFilter "
+            << xor_filter.MemoryBytes() * 8.0 / n << " bits/key\n";
+  std::uniform_int_distribution<std::size_t> present(0, n - 1);
+  std::uniform_int_distribution<> any(kFirst, kLast);
+  for (int absent_percent : {90, 50}) {
+    std::vector<int> probes(n);
+    std::uniform_int_distribution<> percent(0, 99);
+    for (auto &a : probes) {
+      a = percent(gen) < absent_percent ? any(gen) : keys[present(gen)];
+    }
+    std::string name = std::to_string(absent_percent) + "% miss ";
+    Report("filter", name + "Adt::find", MeasureNs(n, [&t, &probes] {
+             std::size_t found = 0;
+             for (int a : probes) {
+               found += t.find(a) != t.end();
+             }
+             sink = found;
+           }));
+    filtered.ResetStats();
+    Report("filter", name + "FilteredAdt::find",
+           MeasureNs(n, [&filtered, &probes] {
+             std::size_t found = 0;
+             for (int a : probes) {
+               found += filtered.find(a) != filtered.end();
+             }
+             sink = found;
+           }));
+    const auto &stats = filtered.Statistics();
+    std::cout << "filter    " << name << "skipped " << std::setprecision(1)
+              << 100 * stats.FilteredRate() << "% of lookups, false positives "
+              << std::setprecision(2) << 100 * stats.FalsePositiveRate()
+              << "% of absent keys\n";
+    Report("filter", name + "FrozenAdt::find", MeasureNs(n, [&frozen, &probes] {
+             std::size_t found = 0;
+             for (int a : probes) {
+               found += frozen.find(a) != frozen.end();
+             }
+             sink = found;
+           }));
+    std::size_t passed = 0;
+    Report("filter", name + "XorFilter+FrozenAdt::find",
+           MeasureNs(n, [&frozen, &xor_filter, &probes, &passed] {
+             std::size_t found = 0;
+             for (int a : probes) {
+               if (xor_filter.MayContain(a)) {
+                 ++passed;
+                 found += frozen.find(a) != frozen.end();
+               }
+             }
+             sink = found;
+           }));
+    std::cout << "filter    " << name << "XorFilter passed "
+              << std::setprecision(1) << 100.0 * passed / n
+              << "% of lookups\n";
+  }
+}
+
+#if defined(__unix__)
+// Tree of n random keys in a file on tmpfs: copy-on-write inserts published
+// every 10000 keys, reopen and queries from the mapping
+void BenchPersistent(std::size_t n) {
+  std::mt19937 gen(14);
+  auto keys = seq::MakeKeys(seq::Order::kRandom, n, kFirst, kLast, gen);
+  std::filesystem::path dir = "/dev/shm";
+  if (!std::filesystem::is_directory(dir)) {
+    dir = std::filesystem::temp_directory_path();
+  }
+  std::string path = (dir / "adt_benchmark.persistent").string();
+  adt::PersistentAdt<int> t;
+  if (!t.Create(path)) {
+    std::cout << "persist   can not create " << path << "\n";
+    return;
+  }
+  Report("persist", "PersistentAdt::insert", MeasureNs(n, [&t, &keys] {
+           for (std::size_t i = 0; i < keys.size(); ++i) {
+             t.insert(keys[i]);
+             if (i % 10000 == 9999) {
+               t.Publish();
+             }
+           }
+           t.Publish();
+           sink = t.size();
+         }));
+  std::cout << "persist   file " << t.FileBytes() << " bytes\n";
+  adt::PersistentAdt<int> reader;
+  Report("persist", "PersistentAdt::Open", MeasureNs(1, [&reader, &path] {
+           sink = reader.Open(path);
+         }));
+  Report("persist", "PersistentAdt::CountByRange",
+         MeasureNs(n, [&reader, &keys] {
+           std::size_t total = 0;
+           for (int a : keys) {
+             total += reader.CountByRange(a, a + 10000000);
+           }
+           sink = total;
+         }));
+  adt::Adt<int> heap;
+  for (int a : keys) {
+    heap.insert(a);
+  }
+  Report("persist", "Adt::CountByRange", MeasureNs(n, [&heap, &keys] {
+           std::size_t total = 0;
+           for (int a : keys) {
+             total += heap.CountByRange(a, a + 10000000);
+           }
+           sink = total;
+         }));
+  reader.Close();
+  t.Close();
+  std::filesystem::remove(path);
+}
+
+// Logged inserts of random keys for several group commit sizes, then Open()
+// time for logs of growing length, without and with a checkpoint. Files go
+// to the temporary directory, so fdatasync reaches the disk.
+void BenchWal(std::size_t n) {
+  std::mt19937 gen(15);
+  auto keys = seq::MakeKeys(seq::Order::kRandom, n, kFirst, kLast, gen);
+  auto dir = std::filesystem::temp_directory_path() / "adt_benchmark.wal";
+  for (std::size_t group : {1, 16, 256, 4096}) {
+    // one sync per key is slow, its run is cut
+    std::size_t count = std::min(n, group * 2000);
+    std::filesystem::remove_all(dir);
+    adt::DurableAdt<int> t;
+    if (!t.Open(dir.string(), {group, 0})) {
+      std::cout << "wal       can not open " << dir.string() << "\n";
+      return;
+    }
+    std::string name = "DurableAdt::insert group " + std::to_string(group);
+    Report("wal", name, MeasureNs(count, [&t, &keys, count] {
+             for (std::size_t i = 0; i < count; ++i) {
+               t.insert(keys[i]);
+             }
+             t.Commit();
+             sink = t.Syncs();
+           }));
+  }
+  {
+    // ingest thread is blocked only inside Checkpoint(), per key of the tree
+    std::filesystem::remove_all(dir);
+    adt::DurableAdt<int> t;
+    t.Open(dir.string(), {4096, 0});
+    for (int a : keys) {
+      t.insert(a);
+    }
+    Report("wal", "DurableAdt::Checkpoint stall",
+           MeasureNs(t.size(), [&t] { sink = t.Checkpoint(); }));
+    t.WaitCheckpoint();
+  }
+  for (std::size_t length = 10000; length <= n; length *= 10) {
+    for (bool checkpoint : {false, true}) {
+      std::filesystem::remove_all(dir);
+      {
+        adt::DurableAdt<int> t;
+        t.Open(dir.string(), {4096, 0});
+        for (std::size_t i = 0; i < length; ++i) {
+          t.insert(keys[i]);
+        }
+        if (checkpoint) {
+          t.Checkpoint();
+        }
+      }
+      adt::DurableAdt<int> t;
+      std::string name = std::string("DurableAdt::Open ") +
+                         (checkpoint ? "checkpoint " : "log ") +
+                         std::to_string(length);
+      Report("wal", name, MeasureNs(1, [&t, &dir] {
+               t.Open(dir.string(), {4096, 0});
+               sink = t.size();
+             }));
+    }
+  }
+  std::filesystem::remove_all(dir);
+}
+#endif
+
+struct Suite {
+  const char *name;
+  void (*run)(std::size_t n);
+};
+
+const Suite kSuites[] = {
+    {"insert", BenchInsert},
+    {"lookup", BenchLookup},
+    {"range", BenchRange},
+    {"frozen", BenchFrozen},
+    {"btree", BenchBTree},
+    {"compact", BenchCompact},
+    {"learned", BenchLearned},
+    {"compress", BenchCompressed},
+    {"multiset", BenchMultiset},
+    {"interval", BenchInterval},
+    {"range2d", BenchRange2D},
+    {"window", BenchWindow},
+    {"snapshot", BenchSnapshot},
+    {"strings", BenchStrings},
+    {"filter", BenchFilter},
+#if defined(__unix__)
+    {"persist", BenchPersistent},
+    {"wal", BenchWal},
+#endif
+};
+
+} // namespace bench
+
+int main(int argc, char **argv) {
+  std::size_t n = bench::kDefaultSize;
+  std::vector<std::string_view> names;
+  for (int i = 1; i < argc; ++i) {
+    std::string_view arg = argv[i];
+    if (arg.starts_with("-n=")) {
+      n = std::strtoull(argv[i] + 3, nullptr, 10);
+    } else {
+      names.push_back(arg);
+    }
+  }
+  for (const auto &suite : bench::kSuites) {
+    bool selected = names.empty();
+    for (auto name : names) {
+      selected = selected || name == suite.name;
+    }
+    if (selected) {
+      suite.run(n);
+    }
+  }
+}
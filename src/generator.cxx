@@ -6,6 +6,8 @@
 #include <string>
 #include <vector>
 
+#include "key_sequences.h"
+
 const char kQuery = 'q';
 const char kKey = 'k';
 const char kSpace = ' ';
@@ -18,7 +20,13 @@ std::string GetFileName(const std::string &name, const std::string &ext,
   return out.str();
 }
 
-int main() {
+int main(int argc, char **argv) {
+  seq::Order order = seq::Order::kRandom;
+  if (argc > 1 && !seq::ParseOrder(argv[1], order)) {
+    std::cerr << "Usage: " << argv[0]
+              << " [random|ascending|descending|jitter]\n";
+    return 1;
+  }
   int first = 0;
   int last = 1000000000;
 
@@ -33,13 +41,14 @@ int main() {
   for (int n = 2; n < 8; ++n) {
     auto file_name = GetFileName("", "dat", n);
     std::ofstream out(file_name);
+    auto keys = seq::MakeKeys(order, k, first, last, gen);
     for (int i = 0; i < k; ++i) {
       if (i % scale == 0) {
         int a = distrib(gen);
         int b = distrib(gen);
         out << kQuery << ' ' << std::min(a, b) << ' ' << std::max(a, b) << ' ';
       } else {
-        out << kKey << ' ' << distrib(gen) << ' ';
+        out << kKey << ' ' << keys[i] << ' ';
       }
     }
     out << kQuery << ' ' << first << ' ' << last << '\n';
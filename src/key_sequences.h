@@ -0,0 +1,56 @@
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <random>
+#include <string_view>
+#include <vector>
+
+namespace seq {
+
+enum class Order { kRandom, kAscending, kDescending, kJitter };
+
+// Parse order name: random, ascending, descending, jitter
+inline bool ParseOrder(std::string_view name, Order &order) {
+  if (name == "random") {
+    order = Order::kRandom;
+  } else if (name == "ascending") {
+    order = Order::kAscending;
+  } else if (name == "descending") {
+    order = Order::kDescending;
+  } else if (name == "jitter") {
+    order = Order::kJitter;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+// n keys in [first, last]. Ascending and descending keys are evenly spread,
+// jitter keys are ascending keys swapped with neighbours up to window apart.
+template <class G>
+std::vector<int> MakeKeys(Order order, std::size_t n, int first, int last,
+                          G &gen, std::size_t window = 16) {
+  std::vector<int> keys(n);
+  if (order == Order::kRandom) {
+    std::uniform_int_distribution<> distrib(first, last);
+    for (auto &a : keys) {
+      a = distrib(gen);
+    }
+    return keys;
+  }
+  double step = n > 1 ? (static_cast<double>(last) - first) / (n - 1) : 0.0;
+  for (std::size_t i = 0; i < n; ++i) {
+    keys[i] = first + static_cast<int>(step * i);
+  }
+  if (order == Order::kDescending) {
+    std::reverse(keys.begin(), keys.end());
+  } else if (order == Order::kJitter && window > 1) {
+    std::uniform_int_distribution<std::size_t> distrib(0, window - 1);
+    for (std::size_t i = 0; i + 1 < n; ++i) {
+      std::swap(keys[i], keys[std::min(n - 1, i + distrib(gen))]);
+    }
+  }
+  return keys;
+}
+
+} // namespace seq
@@ -0,0 +1,231 @@
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <cstddef>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+// Load generator for range_query --serve: clients keep up to depth queries
+// in flight on their connection and time every answer.
+
+namespace load {
+using Clock = std::chrono::steady_clock;
+
+const int kFirst = 0;
+const int kLast = 1000000000;
+
+struct Options {
+  std::string socket_path;      // --socket=path
+  unsigned clients = 4;         // --clients=N : connections
+  std::size_t depth = 32;       // --depth=N : pipelined queries per client
+  std::size_t queries = 100000; // --queries=N : per client
+  std::size_t keys = 100000;    // --keys=N : inserted before the run
+  unsigned writes = 0;          // --writes=P : percent of k among requests
+};
+
+// whole text is a number that fits N
+template <typename N> bool ParseNumber(std::string_view text, N &value) {
+  const char *end = text.data() + text.size();
+  auto [ptr, ec] = std::from_chars(text.data(), end, value);
+  return ec == std::errc{} && ptr == end;
+}
+
+bool ParseOptions(int argc, char **argv, Options &options) {
+  for (int i = 1; i < argc; ++i) {
+    std::string_view arg = argv[i];
+    bool ok = true;
+    if (arg.starts_with("--socket=")) {
+      options.socket_path = arg.substr(9);
+    } else if (arg.starts_with("--clients=")) {
+      ok = ParseNumber(arg.substr(10), options.clients);
+    } else if (arg.starts_with("--depth=")) {
+      ok = ParseNumber(arg.substr(8), options.depth);
+    } else if (arg.starts_with("--queries=")) {
+      ok = ParseNumber(arg.substr(10), options.queries);
+    } else if (arg.starts_with("--keys=")) {
+      ok = ParseNumber(arg.substr(7), options.keys);
+    } else if (arg.starts_with("--writes=")) {
+      ok = ParseNumber(arg.substr(9), options.writes);
+    } else {
+      ok = false;
+    }
+    if (!ok) {
+      return false;
+    }
+  }
+  return !options.socket_path.empty() && options.clients > 0 &&
+         options.depth > 0 && options.writes < 100;
+}
+
+int Connect(const std::string &path) {
+  sockaddr_un addr{};
+  if (path.size() >= sizeof(addr.sun_path)) {
+    return -1;
+  }
+  addr.sun_family = AF_UNIX;
+  std::memcpy(addr.sun_path, path.c_str(), path.size() + 1);
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd >= 0 &&
+      connect(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) != 0) {
+    close(fd);
+    fd = -1;
+  }
+  return fd;
+}
+
+bool SendAll(int fd, const std::string &data) {
+  for (std::size_t pos = 0; pos < data.size();) {
+    ssize_t put = send(fd, data.data() + pos, data.size() - pos, MSG_NOSIGNAL);
+    if (put <= 0) {
+      return false;
+    }
+    pos += static_cast<std::size_t>(put);
+  }
+  return true;
+}
+
+// finish sending and wait until the server closes the connection
+bool Finish(int fd) {
+  shutdown(fd, SHUT_WR);
+  char buffer[256];
+  while (read(fd, buffer, sizeof(buffer)) > 0) {
+  }
+  return close(fd) == 0;
+}
+
+bool Preload(const Options &options) {
+  int fd = Connect(options.socket_path);
+  if (fd < 0) {
+    return false;
+  }
+  std::mt19937 gen(1);
+  std::uniform_int_distribution<> key(kFirst, kLast);
+  std::string batch;
+  bool ok = true;
+  for (std::size_t i = 0; i < options.keys && ok; ++i) {
+    batch += "k " + std::to_string(key(gen)) + ' ';
+    if (batch.size() > 60000 || i + 1 == options.keys) {
+      ok = SendAll(fd, batch);
+      batch.clear();
+    }
+  }
+  return Finish(fd) && ok;
+}
+
+// latencies of answered queries in microseconds, empty on error
+std::vector<double> RunClient(const Options &options, unsigned seed) {
+  std::vector<double> latencies;
+  int fd = Connect(options.socket_path);
+  if (fd < 0) {
+    return latencies;
+  }
+  latencies.reserve(options.queries);
+  std::mt19937 gen(seed);
+  std::uniform_int_distribution<> key(kFirst, kLast);
+  std::uniform_int_distribution<> percent(0, 99);
+  std::vector<Clock::time_point> sent(options.queries);
+  std::size_t issued = 0;
+  std::string batch;
+  char buffer[16384];
+  while (latencies.size() < options.queries) {
+    batch.clear();
+    while (issued < options.queries &&
+           issued - latencies.size() < options.depth) {
+      int a = key(gen);
+      if (static_cast<unsigned>(percent(gen)) < options.writes) {
+        batch += "k " + std::to_string(a) + ' ';
+        continue;
+      }
+      int b = a + (kLast - kFirst) / 1000;
+      batch += "q " + std::to_string(a) + ' ' + std::to_string(b) + ' ';
+      sent[issued++] = Clock::now();
+    }
+    if (!batch.empty() && !SendAll(fd, batch)) {
+      break;
+    }
+    ssize_t got = read(fd, buffer, sizeof(buffer));
+    if (got <= 0) {
+      break;
+    }
+    auto now = Clock::now();
+    // every answer ends with a space
+    for (ssize_t i = 0; i < got; ++i) {
+      if (buffer[i] == ' ') {
+        std::chrono::duration<double, std::micro> wait =
+            now - sent[latencies.size()];
+        latencies.push_back(wait.count());
+      }
+    }
+  }
+  Finish(fd);
+  if (latencies.size() != options.queries) {
+    latencies.clear();
+  }
+  return latencies;
+}
+
+double Percentile(std::vector<double> &values, double p) {
+  auto k = static_cast<std::size_t>(p * static_cast<double>(values.size()));
+  k = std::min(k, values.size() - 1);
+  std::nth_element(values.begin(), values.begin() + k, values.end());
+  return values[k];
+}
+} // namespace load
+
+int main(int argc, char **argv) {
+  load::Options options;
+  if (!load::ParseOptions(argc, argv, options)) {
+    std::cerr << "Usage: " << argv[0]
+              << " --socket=path [--clients=N] [--depth=N] [--queries=N]"
+                 " [--keys=N] [--writes=percent]\n";
+    return 1;
+  }
+  if (options.keys > 0 && !load::Preload(options)) {
+    std::cerr << "Can not connect to " << options.socket_path << "\n";
+    return 2;
+  }
+  std::vector<std::vector<double>> results(options.clients);
+  auto start = load::Clock::now();
+  std::vector<std::thread> clients;
+  for (unsigned c = 0; c < options.clients; ++c) {
+    clients.emplace_back([&options, &results, c] {
+      results[c] = load::RunClient(options, c + 2);
+    });
+  }
+  for (auto &client : clients) {
+    client.join();
+  }
+  std::chrono::duration<double> elapsed = load::Clock::now() - start;
+  std::vector<double> latencies;
+  for (const auto &result : results) {
+    if (result.empty() && options.queries > 0) {
+      std::cerr << "Client lost connection to " << options.socket_path
+                << "\n";
+      return 2;
+    }
+    latencies.insert(latencies.end(), result.begin(), result.end());
+  }
+  if (latencies.empty()) {
+    return 0;
+  }
+  std::cout << options.clients << " clients, depth " << options.depth << ": "
+            << latencies.size() << " queries in " << std::fixed
+            << std::setprecision(3) << elapsed.count() << " s, "
+            << std::setprecision(0)
+            << static_cast<double>(latencies.size()) / elapsed.count()
+            << " queries/s\n"
+            << std::setprecision(1)
+            << "latency us: p50 " << load::Percentile(latencies, 0.5)
+            << " p99 " << load::Percentile(latencies, 0.99) << " p999 "
+            << load::Percentile(latencies, 0.999) << "\n";
+}
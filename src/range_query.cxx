@@ -1,11 +1,32 @@
+#include <algorithm>
+#include <charconv>
+#include <cstddef>
 #include <fstream>
 #include <iomanip>
 #include <iostream>
+#include <span>
 #include <sstream>
 #include <string>
+#include <string_view>
+#include <thread>
+#include <utility>
 #include <vector>
 
+#include "btree_adt.h"
+#include "kll_sketch.h"
+#include "query_server.h"
 #include "simple_adt.h"
+#include "spsc_ring.h"
+#include "wal.h"
+#include "windowed_adt.h"
+
+#if defined(__unix__)
+#include <csignal>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 
 void SaveToFile(const std::string &filename, const adt::Adt<int> &t) {
   std::ofstream out(filename);
@@ -29,15 +50,228 @@ template <class T> void print(std::ostream &os, std::vector<T> v) {
 namespace sol {
 const char kKey = 'k';
 const char kQuery = 'q';
+const char kHistogram = 'h'; // h n b0 b1 ... bn : counts of n buckets
 
 const int kOk = 1;
 const int kInputError = 2;
+const int kUsageError = 3;
+
+enum class Engine { kAvl, kBTree };
+
+struct Options {
+  Engine engine = Engine::kAvl; // --engine=avl|btree
+  bool approx = false;          // --approx[=error] : use KllSketch engine
+  double approx_error = 0.0;    // requested normalized error, 0 - default k
+  std::size_t window = 0;       // --window=N : last N inserts (avl, multiset)
+  std::string load_path;        // --load=path : start from snapshot (avl)
+  std::string save_path;        // --save=path : write snapshot at exit (avl)
+  std::string wal_dir;          // --wal=dir : log and checkpoints (avl)
+  std::size_t group_commit = 256;   // --group-commit=N : keys per fdatasync
+  std::size_t checkpoint_every = 0; // --checkpoint-every=N : keys, 0 - never
+  std::string serve_path;       // --serve=path : answer clients on socket (avl)
+  unsigned threads = 0;         // --threads=N : server workers, 0 - all cores
+  bool pipeline = false;        // --pipeline : parse, execute, write on threads
+};
+
+// value of an option is the whole text, false if it is not a number
+template <typename N> bool ParseNumber(std::string_view text, N &value) {
+  const char *end = text.data() + text.size();
+  auto [ptr, ec] = std::from_chars(text.data(), end, value);
+  return ec == std::errc{} && ptr == end;
+}
+
+int ParseOptions(int argc, char **argv, Options &options) {
+  for (int i = 1; i < argc; ++i) {
+    std::string_view arg = argv[i];
+    if (arg == "--approx") {
+      options.approx = true;
+    } else if (arg.starts_with("--approx=")) {
+      options.approx = true;
+      // error is a share of all items, in (0, 1)
+      if (!ParseNumber(arg.substr(9), options.approx_error) ||
+          !(options.approx_error > 0.0 && options.approx_error < 1.0)) {
+        return kUsageError;
+      }
+    } else if (arg == "--engine=avl") {
+      options.engine = Engine::kAvl;
+    } else if (arg == "--engine=btree") {
+      options.engine = Engine::kBTree;
+    } else if (arg.starts_with("--window=")) {
+      if (!ParseNumber(arg.substr(9), options.window)) {
+        return kUsageError;
+      }
+    } else if (arg.starts_with("--load=")) {
+      options.load_path = arg.substr(7);
+    } else if (arg.starts_with("--save=")) {
+      options.save_path = arg.substr(7);
+    } else if (arg.starts_with("--wal=")) {
+      options.wal_dir = arg.substr(6);
+    } else if (arg.starts_with("--group-commit=")) {
+      if (!ParseNumber(arg.substr(15), options.group_commit)) {
+        return kUsageError;
+      }
+    } else if (arg.starts_with("--checkpoint-every=")) {
+      if (!ParseNumber(arg.substr(19), options.checkpoint_every)) {
+        return kUsageError;
+      }
+    } else if (arg.starts_with("--serve=")) {
+      options.serve_path = arg.substr(8);
+    } else if (arg == "--pipeline") {
+      options.pipeline = true;
+    } else if (arg.starts_with("--threads=")) {
+      if (!ParseNumber(arg.substr(10), options.threads)) {
+        return kUsageError;
+      }
+    } else {
+      return kUsageError;
+    }
+  }
+  if (options.window > 0 &&
+      (options.approx || options.engine != Engine::kAvl)) {
+    return kUsageError; // eviction needs Adt::Erase
+  }
+  bool persistent = !options.load_path.empty() ||
+                    !options.save_path.empty() || !options.wal_dir.empty();
+  if (persistent && (options.approx || options.window > 0 ||
+                     options.engine != Engine::kAvl)) {
+    return kUsageError; // snapshots are written by Adt only
+  }
+  if (!options.wal_dir.empty() &&
+      (!options.load_path.empty() || !options.save_path.empty())) {
+    return kUsageError; // log directory keeps its own checkpoints
+  }
+  if (!options.serve_path.empty() &&
+      (options.approx || options.window > 0 || !options.wal_dir.empty() ||
+       options.pipeline || options.engine != Engine::kAvl)) {
+    return kUsageError; // server keeps a plain Adt
+  }
+  return kOk;
+}
+
+// Snapshot is mapped into memory where possible, so loading reads the file
+// once without copying it.
+bool LoadTree(const std::string &path, adt::Adt<int> &tree) {
+#if defined(__unix__)
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    return false;
+  }
+  struct stat st;
+  bool ok = fstat(fd, &st) == 0 && st.st_size > 0;
+  std::size_t size = ok ? static_cast<std::size_t>(st.st_size) : 0;
+  void *data = ok ? mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0)
+                  : MAP_FAILED;
+  close(fd);
+  if (data == MAP_FAILED) {
+    return false;
+  }
+  madvise(data, size, MADV_SEQUENTIAL);
+  ok = tree.LoadSnapshot(
+      std::span<const char>(static_cast<const char *>(data), size));
+  munmap(data, size);
+  return ok;
+#else
+  std::ifstream in(path, std::ios::binary);
+  return in && tree.LoadSnapshot(in);
+#endif
+}
+
+#if defined(__linux__)
+// Serve clients on a socket until SIGINT or SIGTERM. Signals are blocked
+// before the workers start, so only the main thread receives them.
+int Serve(const Options &options, adt::QueryServer<int> &server) {
+  sigset_t stop;
+  sigemptyset(&stop);
+  sigaddset(&stop, SIGINT);
+  sigaddset(&stop, SIGTERM);
+  pthread_sigmask(SIG_BLOCK, &stop, nullptr);
+  if (!server.Listen(options.serve_path) || !server.Start(options.threads)) {
+    std::cerr << "Can not listen on " << options.serve_path << "\n";
+    return kInputError;
+  }
+  std::cerr << "serve: " << server.Tree().size() << " keys on "
+            << options.serve_path << "\n";
+  int signal = 0;
+  sigwait(&stop, &signal);
+  server.Stop();
+  std::cerr << "serve: " << server.Clients() << " clients, "
+            << server.Requests() << " requests\n";
+  return kOk;
+}
+#endif
+
+bool SaveTree(const std::string &path, const adt::Adt<int> &tree) {
+  std::ofstream out(path, std::ios::binary);
+  return tree.SaveSnapshot(out) && out.flush();
+}
 
 template <typename C, typename T> int range_query(const C &s, T fst, T snd) {
   return s.CountByRange(fst, snd);
 }
 
-int ProcessInputStream(std::istream &in, std::ostream &out) {
+// answer run of queries, batched when the engine supports it
+template <typename C, typename T>
+std::vector<int> range_query_many(const C &s,
+                                  const std::vector<std::pair<T, T>> &ranges) {
+  if constexpr (requires { s.count_many(ranges); }) {
+    return s.count_many(ranges);
+  } else {
+    std::vector<int> result;
+    result.reserve(ranges.size());
+    for (const auto &range : ranges) {
+      result.push_back(range_query(s, range.first, range.second));
+    }
+    return result;
+  }
+}
+
+// counts of buckets [b0, b1), [b1, b2), ... for ascending boundaries
+template <typename C>
+std::vector<std::size_t> range_histogram(const C &s,
+                                         std::span<const int> boundaries) {
+  if constexpr (requires { s.Histogram(boundaries); }) {
+    return s.Histogram(boundaries);
+  } else if constexpr (requires { s.Tree().Histogram(boundaries); }) {
+    return s.Tree().Histogram(boundaries);
+  } else {
+    // only non-empty buckets are queried: their end b[i + 1] - 1 can not
+    // underflow, an empty bucket at INT_MIN would
+    std::vector<std::pair<int, int>> ranges;
+    for (std::size_t i = 0; i + 1 < boundaries.size(); ++i) {
+      if (boundaries[i] < boundaries[i + 1]) {
+        ranges.emplace_back(boundaries[i], boundaries[i + 1] - 1);
+      }
+    }
+    auto counts = range_query_many(s, ranges);
+    std::vector<std::size_t> histogram(boundaries.size() - 1);
+    for (std::size_t i = 0, j = 0; i < histogram.size(); ++i) {
+      if (boundaries[i] < boundaries[i + 1]) {
+        histogram[i] = static_cast<std::size_t>(counts[j++]);
+      }
+    }
+    return histogram;
+  }
+}
+
+// max number of consecutive queries answered by one batch
+const std::size_t kMaxQueryRun = 4096;
+// max number of buckets of one h request
+const int kMaxBuckets = 1 << 20;
+
+template <typename C>
+void FlushQueries(const C &tree, std::vector<std::pair<int, int>> &queries,
+                  std::ostream &out) {
+  if (queries.empty()) {
+    return;
+  }
+  for (int count : range_query_many(tree, queries)) {
+    out << count << ' ';
+  }
+  queries.clear();
+}
+
+template <typename C>
+int ProcessInputStream(std::istream &in, std::ostream &out, C &tree) {
   char command;
   int value;
   int first;
@@ -45,12 +279,14 @@ int ProcessInputStream(std::istream &in, std::ostream &out) {
 #ifdef my_debug_1
   int i = 0;
 #endif
-
-  adt::Adt<int> tree;
+  std::vector<std::pair<int, int>> queries;
+  queries.reserve(kMaxQueryRun);
+  std::vector<int> boundaries;
 
   while (in >> command) {
     switch (command) {
     case kKey: {
+      FlushQueries(tree, queries, out);
       in >> value;
       tree.insert(value);
       break;
@@ -62,24 +298,353 @@ int ProcessInputStream(std::istream &in, std::ostream &out) {
         ++i;
         SaveToFile(GetFileName("tree", "dot", i), tree);
 #endif
-        out << range_query(tree, first, second) << ' ';
+        queries.emplace_back(first, second);
+        if (queries.size() == kMaxQueryRun) {
+          FlushQueries(tree, queries, out);
+        }
       } else {
+        FlushQueries(tree, queries, out);
+        return kInputError;
+      }
+      break;
+    }
+    case kHistogram: {
+      FlushQueries(tree, queries, out);
+      int buckets = -1;
+      in >> buckets;
+      if (buckets < 0 || buckets > kMaxBuckets) {
         return kInputError;
       }
+      boundaries.resize(buckets + 1);
+      for (int &b : boundaries) {
+        in >> b;
+      }
+      if (!in || !std::is_sorted(boundaries.begin(), boundaries.end())) {
+        return kInputError;
+      }
+      for (std::size_t count : range_histogram(tree, boundaries)) {
+        out << count << ' ';
+      }
       break;
     }
     }
   }
+  FlushQueries(tree, queries, out);
 
   out << '\n';
 
   return kOk;
 }
+
+// Reads whitespace separated tokens from a stream in large chunks, like
+// operator>> of char and int but without per-token stream overhead.
+class Scanner {
+  static constexpr std::size_t kChunk = 1 << 16;
+
+public:
+  explicit Scanner(std::istream &in) : in_(in), buffer_(kChunk) {}
+  // next non-space character, false at end of input
+  bool Command(char &command) {
+    if (!SkipSpace()) {
+      return false;
+    }
+    command = buffer_[begin_++];
+    return true;
+  }
+  // next number, false at end of input or if it is not a number
+  bool Number(int &value) {
+    if (!SkipSpace()) {
+      return false;
+    }
+    std::size_t end = begin_;
+    for (;;) {
+      while (end < end_ && !IsSpace(buffer_[end])) {
+        ++end;
+      }
+      if (end < end_ || eof_) {
+        break;
+      }
+      end -= begin_; // token may continue in the next chunk
+      Refill();
+      end += begin_;
+    }
+    auto [ptr, ec] =
+        std::from_chars(buffer_.data() + begin_, buffer_.data() + end, value);
+    begin_ = end;
+    return ec == std::errc{} && ptr == buffer_.data() + end;
+  }
+
+private:
+  std::istream &in_;
+  std::vector<char> buffer_;
+  std::size_t begin_ = 0; // unread part of buffer_
+  std::size_t end_ = 0;
+  bool eof_ = false;
+
+  static bool IsSpace(char ch) {
+    return ch == ' ' || ch == '\n' || ch == '\t' || ch == '\r' ||
+           ch == '\v' || ch == '\f';
+  }
+  bool SkipSpace() {
+    for (;;) {
+      while (begin_ < end_ && IsSpace(buffer_[begin_])) {
+        ++begin_;
+      }
+      if (begin_ < end_ || eof_) {
+        return begin_ < end_;
+      }
+      Refill();
+    }
+  }
+  // keep unread bytes, append next chunk
+  void Refill() {
+    std::copy(buffer_.begin() + begin_, buffer_.begin() + end_,
+              buffer_.begin());
+    end_ -= begin_;
+    begin_ = 0;
+    if (buffer_.size() - end_ < kChunk) {
+      buffer_.resize(end_ + kChunk);
+    }
+    in_.read(buffer_.data() + end_, kChunk);
+    end_ += in_.gcount();
+    eof_ = in_.gcount() == 0;
+  }
+};
+
+struct Command {
+  char type; // kKey, kQuery or kHistogram
+  int first; // kHistogram: offset of boundaries in CommandBatch
+  int second; // kHistogram: number of buckets
+};
+
+struct CommandBatch {
+  std::vector<Command> commands;
+  std::vector<int> boundaries; // of all kHistogram commands
+  bool last = false;  // end of input
+  bool error = false; // input stopped at an invalid query
+};
+
+struct ResultBatch {
+  std::vector<int> counts;
+  bool last = false;
+  bool error = false;
+};
+
+// Read "n b0 ... bn" of a kHistogram command, false on a cut request or
+// descending boundaries (input error of ProcessInputStream() as well).
+bool ReadHistogram(Scanner &scanner, Command &c, std::vector<int> &boundaries) {
+  if (!scanner.Number(c.second) || c.second < 0 || c.second > kMaxBuckets) {
+    return false;
+  }
+  c.first = static_cast<int>(boundaries.size());
+  for (int i = 0; i <= c.second; ++i) {
+    int b = 0;
+    if (!scanner.Number(b) || (i > 0 && b < boundaries.back())) {
+      return false;
+    }
+    boundaries.push_back(b);
+  }
+  return true;
+}
+
+// batches in flight between two stages
+const std::size_t kPipelineBatches = 8;
+
+// Same protocol as ProcessInputStream(), on three threads: the caller parses
+// commands into batches, an executor thread applies them to tree and a
+// writer thread formats the counts. Stages pass batch pointers through
+// SpscRing, and every used batch goes back to its producer through a second
+// ring, so batches are allocated once and reused.
+template <typename C>
+int ProcessInputPipelined(std::istream &in, std::ostream &out, C &tree) {
+  std::vector<CommandBatch> command_pool(kPipelineBatches);
+  std::vector<ResultBatch> result_pool(kPipelineBatches);
+  adt::SpscRing<CommandBatch *> commands(kPipelineBatches);
+  adt::SpscRing<CommandBatch *> free_commands(kPipelineBatches);
+  adt::SpscRing<ResultBatch *> results(kPipelineBatches);
+  adt::SpscRing<ResultBatch *> free_results(kPipelineBatches);
+  for (std::size_t i = 0; i < kPipelineBatches; ++i) {
+    command_pool[i].commands.reserve(kMaxQueryRun);
+    free_commands.push(&command_pool[i]);
+    result_pool[i].counts.reserve(kMaxQueryRun);
+    free_results.push(&result_pool[i]);
+  }
+
+  std::thread executor([&] {
+    std::vector<std::pair<int, int>> queries;
+    queries.reserve(kMaxQueryRun);
+    for (bool last = false; !last;) {
+      CommandBatch *batch = commands.pop();
+      ResultBatch *result = free_results.pop();
+      result->counts.clear();
+      auto flush = [&tree, &queries, result] {
+        if (!queries.empty()) {
+          auto counts = range_query_many(tree, queries);
+          result->counts.insert(result->counts.end(), counts.begin(),
+                                counts.end());
+          queries.clear();
+        }
+      };
+      for (const auto &command : batch->commands) {
+        if (command.type == kKey) {
+          flush();
+          tree.insert(command.first);
+        } else if (command.type == kHistogram) {
+          flush();
+          std::span<const int> boundaries(
+              batch->boundaries.data() + command.first, command.second + 1);
+          for (std::size_t count : range_histogram(tree, boundaries)) {
+            result->counts.push_back(static_cast<int>(count));
+          }
+        } else {
+          queries.emplace_back(command.first, command.second);
+        }
+      }
+      flush();
+      last = batch->last;
+      result->last = last;
+      result->error = batch->error;
+      free_commands.push(batch);
+      results.push(result);
+    }
+  });
+
+  std::thread writer([&] {
+    std::string text;
+    char number[16];
+    for (bool last = false; !last;) {
+      ResultBatch *result = results.pop();
+      text.clear();
+      for (int count : result->counts) {
+        text.append(number,
+                    std::to_chars(number, number + sizeof(number), count).ptr);
+        text += ' ';
+      }
+      if (result->last && !result->error) {
+        text += '\n';
+      }
+      out.write(text.data(), static_cast<std::streamsize>(text.size()));
+      last = result->last;
+      free_results.push(result);
+    }
+  });
+
+  Scanner scanner(in);
+  bool error = false;
+  for (bool last = false; !last;) {
+    CommandBatch *batch = free_commands.pop();
+    batch->commands.clear();
+    batch->boundaries.clear();
+    while (batch->commands.size() < kMaxQueryRun && !last) {
+      Command c{};
+      last = !scanner.Command(c.type);
+      if (last) {
+        break;
+      }
+      if (c.type == kKey) {
+        last = !scanner.Number(c.first);
+      } else if (c.type == kQuery) {
+        last = !scanner.Number(c.first) || !scanner.Number(c.second);
+        error = !last && c.first > c.second;
+        last = last || error;
+      } else if (c.type == kHistogram) {
+        error = !ReadHistogram(scanner, c, batch->boundaries);
+        last = error;
+      } else {
+        continue; // unknown command character
+      }
+      if (!last) {
+        batch->commands.push_back(c);
+      }
+    }
+    batch->last = last;
+    batch->error = error;
+    commands.push(batch);
+  }
+  executor.join();
+  writer.join();
+  return error ? kInputError : kOk;
+}
+
+// ProcessInputStream() or its pipelined variant
+template <typename C>
+int Process(const Options &options, std::istream &in, std::ostream &out,
+            C &tree) {
+  return options.pipeline ? ProcessInputPipelined(in, out, tree)
+                          : ProcessInputStream(in, out, tree);
+}
 } // namespace sol
 
-int main() {
+int main(int argc, char **argv) {
   std::ios::sync_with_stdio(false);
-  int result = sol::ProcessInputStream(std::cin, std::cout);
+  sol::Options options;
+  int result = sol::ParseOptions(argc, argv, options);
+  if (result != sol::kOk) {
+    std::cerr << "Usage: " << argv[0]
+              << " [--engine=avl|btree] [--approx[=error]] [--window=N]"
+                 " [--load=path] [--save=path]"
+                 " [--wal=dir [--group-commit=N] [--checkpoint-every=N]]"
+                 " [--serve=path [--threads=N]] [--pipeline]\n"
+                 "  --window=N counts the last N inserts, a key inserted"
+                 " twice in them counts twice\n";
+    return result;
+  }
+  if (options.approx) {
+    adt::KllSketch<int> sketch(
+        adt::KllSketch<int>::KFromErrorBound(options.approx_error));
+    result = sol::Process(options, std::cin, std::cout, sketch);
+    std::cerr << "approx: items " << sketch.size() << ", retained "
+              << sketch.RetainedItems() << ", count error <= "
+              << sketch.MaxCountError() << " (" << sketch.ErrorBound() * 100
+              << "%)\n";
+#if defined(__linux__)
+  } else if (!options.serve_path.empty()) {
+    adt::QueryServer<int> server;
+    if (!options.load_path.empty() &&
+        !sol::LoadTree(options.load_path, server.Tree())) {
+      std::cerr << "Can not load snapshot " << options.load_path << "\n";
+      return sol::kInputError;
+    }
+    result = sol::Serve(options, server);
+    if (!options.save_path.empty() &&
+        !sol::SaveTree(options.save_path, server.Tree())) {
+      std::cerr << "Can not save snapshot " << options.save_path << "\n";
+    }
+#endif
+#if defined(__unix__)
+  } else if (!options.wal_dir.empty()) {
+    adt::DurableAdt<int> tree;
+    if (!tree.Open(options.wal_dir,
+                   {options.group_commit, options.checkpoint_every})) {
+      std::cerr << "Can not open log directory " << options.wal_dir << "\n";
+      return sol::kInputError;
+    }
+    std::cerr << "wal: recovered " << tree.size() << " keys, "
+              << tree.ReplayedKeys() << " from log\n";
+    result = sol::Process(options, std::cin, std::cout, tree);
+    if (!tree.Close()) {
+      std::cerr << "Can not write log " << options.wal_dir << "\n";
+    }
+#endif
+  } else if (options.window > 0) {
+    adt::WindowedAdt<int> tree(options.window);
+    result = sol::Process(options, std::cin, std::cout, tree);
+  } else if (options.engine == sol::Engine::kBTree) {
+    adt::BTreeAdt<int> tree;
+    result = sol::Process(options, std::cin, std::cout, tree);
+  } else {
+    adt::Adt<int> tree;
+    if (!options.load_path.empty() &&
+        !sol::LoadTree(options.load_path, tree)) {
+      std::cerr << "Can not load snapshot " << options.load_path << "\n";
+      return sol::kInputError;
+    }
+    result = sol::Process(options, std::cin, std::cout, tree);
+    if (!options.save_path.empty() &&
+        !sol::SaveTree(options.save_path, tree)) {
+      std::cerr << "Can not save snapshot " << options.save_path << "\n";
+    }
+  }
   if (result != sol::kOk) {
     std::cerr << "Error :" << result << "\n";
   }
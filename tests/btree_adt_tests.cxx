@@ -0,0 +1,114 @@
+#include "btree_adt.h"
+#include "simple_adt.h"
+
+#include <algorithm>
+#include <gtest/gtest.h>
+#include <iterator>
+#include <random>
+#include <set>
+#include <vector>
+
+namespace my {
+namespace project {
+namespace {
+
+TEST(BTreeAdtInt, Empty) {
+  auto tree = adt::BTreeAdt<int>{};
+  EXPECT_EQ(tree.size(), 0);
+  EXPECT_EQ(tree.height(), 0);
+  EXPECT_EQ(tree.begin(), tree.end());
+  EXPECT_EQ(tree.find(1), tree.end());
+  EXPECT_EQ(tree.lower_bound(1), tree.end());
+  EXPECT_EQ(tree.CountByRange(0, 10), 0);
+}
+
+TEST(BTreeAdtInt, InsertAndIterate) {
+  auto tree = adt::BTreeAdt<int, 4>{};
+  std::vector<int> expected;
+  for (int i = 0; i < 1000; ++i) {
+    int a = (i * 7919) % 1000;
+    auto [it, inserted] = tree.insert(a);
+    EXPECT_TRUE(inserted);
+    EXPECT_EQ(*it, a);
+    expected.push_back(a);
+  }
+  EXPECT_FALSE(tree.insert(500).second);
+  EXPECT_EQ(*tree.insert(500).first, 500);
+  std::sort(expected.begin(), expected.end());
+  EXPECT_EQ(tree.size(), 1000);
+  EXPECT_EQ(std::vector<int>(tree.begin(), tree.end()), expected);
+  std::vector<int> reversed;
+  for (auto it = tree.end(); it != tree.begin();) {
+    reversed.push_back(*--it);
+  }
+  EXPECT_TRUE(std::equal(reversed.rbegin(), reversed.rend(), expected.begin(),
+                         expected.end()));
+  EXPECT_GE(tree.height(), 5);
+}
+
+TEST(BTreeAdtInt, Bounds) {
+  auto tree = adt::BTreeAdt<int>{};
+  for (int i = 0; i < 1000; ++i) {
+    tree.insert(i * 10);
+  }
+  EXPECT_EQ(*tree.find(120), 120);
+  EXPECT_EQ(tree.find(125), tree.end());
+  EXPECT_EQ(*tree.lower_bound(125), 130);
+  EXPECT_EQ(*tree.lower_bound(130), 130);
+  EXPECT_EQ(*tree.upper_bound(130), 140);
+  EXPECT_EQ(*tree.lower_bound(-5), 0);
+  EXPECT_EQ(tree.lower_bound(9991), tree.end());
+  EXPECT_EQ(tree.upper_bound(9990), tree.end());
+  EXPECT_EQ(*--tree.end(), 9990);
+  EXPECT_EQ(tree.rank(125), 13);
+}
+
+// Keys equal to the padding of unused slots must be counted correctly.
+TEST(BTreeAdtInt, ExtremeKeys) {
+  auto tree = adt::BTreeAdt<int>{};
+  const int min = std::numeric_limits<int>::min();
+  const int max = std::numeric_limits<int>::max();
+  tree.insert(max);
+  tree.insert(min);
+  tree.insert(0);
+  EXPECT_EQ(tree.CountByRange(min, max), 3);
+  EXPECT_EQ(tree.CountByRange(1, max), 1);
+  EXPECT_EQ(*tree.find(max), max);
+  EXPECT_EQ(tree.upper_bound(max), tree.end());
+}
+
+TEST(BTreeAdtInt, CountByRangeMatchesAdt) {
+  std::mt19937 gen(7);
+  std::uniform_int_distribution<> distrib(0, 1000000);
+  auto tree = adt::BTreeAdt<int>{};
+  auto avl = adt::Adt<int>{};
+  for (int i = 0; i < 50000; ++i) {
+    int a = distrib(gen);
+    EXPECT_EQ(tree.insert(a).second, avl.insert(a).second);
+  }
+  EXPECT_EQ(tree.size(), avl.size());
+  for (int i = 0; i < 1000; ++i) {
+    int a = distrib(gen);
+    int b = distrib(gen);
+    EXPECT_EQ(tree.CountByRange(a, b), avl.CountByRange(a, b));
+  }
+}
+
+// generic in-node search for keys without SIMD support
+TEST(BTreeAdtInt, GenericKeys) {
+  auto tree = adt::BTreeAdt<double, 8>{};
+  std::set<double> expected;
+  for (int i = 0; i < 500; ++i) {
+    double a = (i * 37 % 500) / 4.0;
+    tree.insert(a);
+    expected.insert(a);
+  }
+  EXPECT_TRUE(std::equal(tree.begin(), tree.end(), expected.begin(),
+                         expected.end()));
+  EXPECT_EQ(tree.CountByRange(10.0, 20.0), 41);
+  EXPECT_EQ(*tree.lower_bound(10.1), 10.25);
+}
+
+} // namespace
+} // namespace project
+} // namespace my
@@ -0,0 +1,122 @@
+#include "compressed_keys.h"
+#include "simple_adt.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <gtest/gtest.h>
+#include <limits>
+#include <numeric>
+#include <random>
+#include <vector>
+
+namespace my {
+namespace project {
+namespace {
+
+TEST(CompressedKeysInt, Empty) {
+  auto keys = adt::CompressedKeys<int>{std::vector<int>{}};
+  EXPECT_EQ(keys.size(), 0);
+  EXPECT_EQ(keys.begin(), keys.end());
+  EXPECT_EQ(keys.rank(3), 0);
+  EXPECT_EQ(keys.lower_bound(3), keys.end());
+  EXPECT_EQ(keys.CountByRange(0, 10), 0);
+}
+
+TEST(CompressedKeysInt, DenseIds) {
+  std::vector<int> ids;
+  for (int i = 0; i < 100000; ++i) {
+    ids.push_back(1000 + i + i / 7); // a few holes
+  }
+  auto keys = adt::CompressedKeys<int>(ids);
+  EXPECT_LT(keys.MemoryBytes(), 2 * ids.size());
+  EXPECT_TRUE(std::equal(keys.begin(), keys.end(), ids.begin(), ids.end()));
+  EXPECT_EQ(keys.rank(1000), 0);
+  EXPECT_EQ(keys.rank(ids[500]), 500);
+  EXPECT_EQ(*keys.lower_bound(ids[500]), ids[500]);
+  EXPECT_EQ(*keys.lower_bound(ids[500] + 1), ids[501]);
+  EXPECT_EQ(keys.upper_bound(ids.back()), keys.end());
+  EXPECT_EQ(keys.CountByRange(ids[10], ids[99999]), 99990);
+}
+
+TEST(CompressedKeysInt, ContiguousIds) {
+  // full blocks of width 0 and a partial last one
+  std::vector<int> ids(4096 + 50);
+  std::iota(ids.begin(), ids.end(), -100);
+  auto keys = adt::CompressedKeys<int>(ids);
+  EXPECT_LT(keys.MemoryBytes(), ids.size());
+  EXPECT_TRUE(std::equal(keys.begin(), keys.end(), ids.begin(), ids.end()));
+  EXPECT_EQ(keys.rank(0), 100);
+  EXPECT_EQ(*keys.lower_bound(4000), 4000);
+  EXPECT_EQ(keys.upper_bound(ids.back()), keys.end());
+  EXPECT_EQ(keys.CountByRange(-1000, 100000), ids.size());
+  EXPECT_EQ(keys.CountByRange(10, 4000), 3991);
+  std::vector<std::int64_t> wide(300);
+  std::iota(wide.begin(), wide.end(), std::int64_t{1} << 40);
+  auto wide_keys = adt::CompressedKeys<std::int64_t>(wide);
+  EXPECT_TRUE(std::equal(wide_keys.begin(), wide_keys.end(), wide.begin(),
+                         wide.end()));
+}
+
+TEST(CompressedKeysInt, MatchesAdt) {
+  std::mt19937 gen(5);
+  std::uniform_int_distribution<> distrib(std::numeric_limits<int>::min(),
+                                          std::numeric_limits<int>::max());
+  auto tree = adt::Adt<int>{};
+  for (int i = 0; i < 30000; ++i) {
+    tree.insert(distrib(gen));
+  }
+  tree.insert(std::numeric_limits<int>::min());
+  tree.insert(std::numeric_limits<int>::max());
+  auto sorted = tree.GetInorderVector();
+  auto keys = adt::CompressedKeys<int>(sorted);
+  EXPECT_TRUE(
+      std::equal(keys.begin(), keys.end(), sorted.begin(), sorted.end()));
+  for (int i = 0; i < 2000; ++i) {
+    int a = distrib(gen);
+    int b = distrib(gen);
+    ASSERT_EQ(keys.CountByRange(a, b), tree.CountByRange(a, b));
+    auto it = keys.lower_bound(a);
+    auto expected = tree.lower_bound(a);
+    ASSERT_EQ(it == keys.end(), expected == tree.end());
+    if (it != keys.end()) {
+      ASSERT_EQ(*it, *expected);
+    }
+  }
+}
+
+TEST(CompressedKeysInt, ForEachInRange) {
+  std::vector<int> sorted;
+  for (int i = 0; i < 1000; ++i) {
+    sorted.push_back(i * i);
+  }
+  auto keys = adt::CompressedKeys<int>(sorted);
+  std::vector<int> out;
+  keys.for_each_in_range(100, 40000, [&out](int v) { out.push_back(v); });
+  std::vector<int> expected(sorted.begin() + 10, sorted.begin() + 201);
+  EXPECT_EQ(out, expected);
+  out.clear();
+  keys.for_each_in_range(5, 3, [&out](int v) { out.push_back(v); });
+  EXPECT_TRUE(out.empty());
+}
+
+// gaps wider than 32 bits are stored raw
+TEST(CompressedKeysInt, Int64WideGaps) {
+  using Key = std::int64_t;
+  std::vector<Key> sorted = {std::numeric_limits<Key>::min(), -1, 0, 1};
+  for (Key i = 1; i < 300; ++i) {
+    sorted.push_back(i << 40);
+  }
+  sorted.push_back(std::numeric_limits<Key>::max());
+  auto keys = adt::CompressedKeys<Key>(sorted);
+  EXPECT_TRUE(
+      std::equal(keys.begin(), keys.end(), sorted.begin(), sorted.end()));
+  EXPECT_EQ(keys.CountByRange(std::numeric_limits<Key>::min(),
+                              std::numeric_limits<Key>::max()),
+            static_cast<int>(sorted.size()));
+  EXPECT_EQ(keys.rank(Key{1} << 41), 5);
+  EXPECT_EQ(*keys.upper_bound(1), Key{1} << 40);
+}
+
+} // namespace
+} // namespace project
+} // namespace my
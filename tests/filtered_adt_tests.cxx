@@ -0,0 +1,63 @@
+#include "filtered_adt.h"
+
+#include <gtest/gtest.h>
+#include <random>
+#include <set>
+
+namespace my {
+namespace project {
+namespace {
+
+TEST(FilteredAdtInt, MatchesStdSet) {
+  std::mt19937 gen(50);
+  std::uniform_int_distribution<> key(0, 100000);
+  adt::FilteredAdt<int> tree(16); // grows by rebuilds
+  std::set<int> expected;
+  for (int i = 0; i < 60000; ++i) {
+    int a = key(gen);
+    if (i % 4 == 0) {
+      EXPECT_EQ(tree.erase(a), expected.erase(a));
+    } else if (i % 4 == 1) {
+      EXPECT_EQ(tree.insert(a), expected.insert(a).second);
+    } else {
+      bool found = expected.count(a) > 0;
+      EXPECT_EQ(tree.contains(a), found);
+      auto it = tree.find(a);
+      EXPECT_EQ(it == tree.end(), !found);
+      if (found) {
+        EXPECT_EQ(*it, a);
+      }
+    }
+  }
+  EXPECT_EQ(tree.size(), expected.size());
+  EXPECT_EQ(tree.Tree().GetInorderVector(),
+            std::vector<int>(expected.begin(), expected.end()));
+  const auto &stats = tree.Statistics();
+  EXPECT_EQ(stats.lookups, 60000);
+  EXPECT_GT(stats.rebuilds, 5);
+  EXPECT_GT(stats.FilteredRate(), 0.5);
+  EXPECT_LT(stats.FalsePositiveRate(), 0.05);
+}
+
+TEST(FilteredAdtInt, StatsOfMisses) {
+  adt::FilteredAdt<int> tree(1000);
+  for (int a = 0; a < 1000; a += 2) {
+    tree.insert(a);
+  }
+  EXPECT_FALSE(tree.insert(10));
+  for (int a = 0; a < 1000; ++a) {
+    EXPECT_EQ(tree.count(a), a % 2 == 0 ? 1 : 0);
+  }
+  auto stats = tree.Statistics();
+  EXPECT_EQ(stats.lookups, 1000);
+  EXPECT_EQ(stats.filtered + stats.false_positives, 500);
+  EXPECT_EQ(stats.rebuilds, 0);
+  tree.ResetStats();
+  EXPECT_EQ(tree.Statistics().lookups, 0);
+  EXPECT_EQ(tree.MemoryBytes(),
+            tree.Tree().MemoryBytes() + tree.FilterBytes());
+}
+
+} // namespace
+} // namespace project
+} // namespace my
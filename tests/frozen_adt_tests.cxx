@@ -0,0 +1,66 @@
+#include "frozen_adt.h"
+#include "simple_adt.h"
+
+#include <gtest/gtest.h>
+#include <iterator>
+#include <vector>
+
+namespace my {
+namespace project {
+namespace {
+
+TEST(FrozenAdtInt, Empty) {
+  auto dt = adt::Adt<int>{};
+  auto frozen = dt.Freeze();
+  EXPECT_EQ(frozen.size(), 0);
+  EXPECT_EQ(frozen.begin(), frozen.end());
+  EXPECT_EQ(frozen.find(1), frozen.end());
+  EXPECT_EQ(frozen.lower_bound(1), frozen.end());
+  EXPECT_EQ(frozen.CountByRange(0, 10), 0);
+}
+
+TEST(FrozenAdtInt, Bounds) {
+  auto dt = adt::Adt<int>{};
+  std::vector<int> source = {100, 50, 150, 25, 75, 125, 175, 12, 35, 20};
+  for (int a : source) {
+    dt.insert(a);
+  }
+  auto frozen = dt.Freeze();
+  EXPECT_EQ(frozen.size(), source.size());
+  EXPECT_EQ(*frozen.lower_bound(11), 12);
+  EXPECT_EQ(*frozen.lower_bound(13), 20);
+  EXPECT_EQ(*frozen.lower_bound(25), 25);
+  EXPECT_EQ(*frozen.lower_bound(102), 125);
+  EXPECT_EQ(frozen.lower_bound(180), frozen.end());
+  EXPECT_EQ(*frozen.upper_bound(12), 20);
+  EXPECT_EQ(*frozen.upper_bound(100), 125);
+  EXPECT_EQ(frozen.upper_bound(175), frozen.end());
+  EXPECT_EQ(*frozen.find(75), 75);
+  EXPECT_EQ(frozen.find(76), frozen.end());
+  EXPECT_EQ(frozen.lower_bound(50).rank(), 4);
+  EXPECT_EQ(frozen.end().rank(), source.size());
+}
+
+TEST(FrozenAdtInt, IteratorRangeAndCount) {
+  auto dt = adt::Adt<int>{};
+  for (int n = 0; n < 300; ++n) {
+    auto frozen = dt.Freeze();
+    auto inorder = dt.GetInorderVector();
+    EXPECT_EQ(std::vector<int>(frozen.begin(), frozen.end()), inorder);
+    std::vector<int> reverse_order;
+    for (auto it = frozen.end(); it != frozen.begin();) {
+      reverse_order.push_back(*(--it));
+    }
+    EXPECT_EQ(std::vector<int>(inorder.rbegin(), inorder.rend()),
+              reverse_order);
+    for (int a = -3; a < 3 * n + 3; a += 7) {
+      EXPECT_EQ(frozen.CountByRange(a, a + 20), dt.CountByRange(a, a + 20));
+      EXPECT_EQ(frozen.CountByRange(a + 20, a), 0);
+    }
+    dt.insert((n * 17) % 900);
+  }
+}
+
+} // namespace
+} // namespace project
+} // namespace my
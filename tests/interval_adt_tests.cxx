@@ -0,0 +1,74 @@
+#include "interval_adt.h"
+
+#include <algorithm>
+#include <gtest/gtest.h>
+#include <random>
+#include <vector>
+
+namespace my {
+namespace project {
+namespace {
+
+using Interval = adt::Interval<int>;
+
+std::vector<Interval> Overlapping(const std::vector<Interval> &all, int a,
+                                  int b) {
+  std::vector<Interval> result;
+  for (const auto &v : all) {
+    if (v.first <= b && a <= v.second) {
+      result.push_back(v);
+    }
+  }
+  std::sort(result.begin(), result.end());
+  return result;
+}
+
+TEST(IntervalAdtInt, Empty) {
+  auto tree = adt::IntervalAdt<int>{};
+  EXPECT_EQ(tree.size(), 0);
+  EXPECT_EQ(tree.stab(1), 0);
+  EXPECT_TRUE(tree.overlapping(0, 10).empty());
+  EXPECT_FALSE(tree.insert(5, 4));
+}
+
+TEST(IntervalAdtInt, Reservations) {
+  auto tree = adt::IntervalAdt<int>{};
+  tree.insert(9, 12);
+  tree.insert(10, 11);
+  tree.insert(13, 15);
+  tree.insert(10, 11); // same reservation twice
+  EXPECT_EQ(tree.size(), 4);
+  EXPECT_EQ(tree.stab(10), 3);
+  EXPECT_EQ(tree.stab(12), 1);
+  EXPECT_EQ(tree.stab(16), 0);
+  EXPECT_EQ(tree.count_overlapping(12, 13), 2);
+  EXPECT_EQ(tree.overlapping(11, 12),
+            (std::vector<Interval>{{9, 12}, {10, 11}, {10, 11}}));
+  EXPECT_EQ(tree.count_overlapping(3, 2), 0);
+}
+
+TEST(IntervalAdtInt, MatchesLinearScan) {
+  std::mt19937 gen(17);
+  std::uniform_int_distribution<> start(0, 100000);
+  std::uniform_int_distribution<> length(0, 2000);
+  auto tree = adt::IntervalAdt<int>{};
+  std::vector<Interval> all;
+  for (int i = 0; i < 5000; ++i) {
+    int a = start(gen);
+    int b = a + length(gen);
+    tree.insert(a, b);
+    all.push_back({a, b});
+  }
+  for (int i = 0; i < 300; ++i) {
+    int a = start(gen);
+    int b = a + length(gen) / 4;
+    auto expected = Overlapping(all, a, b);
+    ASSERT_EQ(tree.overlapping(a, b), expected);
+    ASSERT_EQ(tree.count_overlapping(a, b), expected.size());
+    ASSERT_EQ(tree.stab(a), Overlapping(all, a, a).size());
+  }
+}
+
+} // namespace
+} // namespace project
+} // namespace my
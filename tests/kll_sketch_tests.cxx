@@ -0,0 +1,86 @@
+#include "kll_sketch.h"
+#include "simple_adt.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <gtest/gtest.h>
+#include <random>
+#include <vector>
+
+namespace my {
+namespace project {
+namespace {
+
+TEST(KllSketchInt, ExactWhileSmall) {
+  auto sketch = adt::KllSketch<int>{};
+  for (int i = 0; i < 100; ++i) {
+    sketch.insert(i);
+  }
+  EXPECT_EQ(sketch.size(), 100);
+  EXPECT_EQ(sketch.ErrorBound(), 0.0);
+  EXPECT_EQ(sketch.CountByRange(10, 19), 10);
+  EXPECT_EQ(sketch.CountByRange(20, 10), 0);
+  EXPECT_EQ(sketch.rank(50), 50);
+}
+
+TEST(KllSketchInt, ErrorBoundFromK) {
+  std::size_t k = adt::KllSketch<int>::KFromErrorBound(0.01);
+  auto sketch = adt::KllSketch<int>(k);
+  for (int i = 0; i < 100000; ++i) {
+    sketch.insert(i);
+  }
+  EXPECT_LE(sketch.ErrorBound(), 0.01);
+  EXPECT_LT(sketch.RetainedItems(), 10 * k);
+}
+
+// Same stream shape as test_generator: every 5th command is a query.
+TEST(KllSketchInt, AccuracyOnGeneratorStream) {
+  const int first = 0;
+  const int last = 1000000000;
+  std::mt19937 gen(42);
+  std::uniform_int_distribution<> distrib(first, last);
+
+  auto tree = adt::Adt<int>{};
+  auto sketch = adt::KllSketch<int>{};
+  int queries = 0;
+  int misses = 0;
+  for (int i = 0; i < 100000; ++i) {
+    if (i % 5 == 0) {
+      int a = distrib(gen);
+      int b = distrib(gen);
+      int exact = tree.CountByRange(std::min(a, b), std::max(a, b));
+      int approx = sketch.CountByRange(std::min(a, b), std::max(a, b));
+      ++queries;
+      if (static_cast<std::size_t>(std::abs(exact - approx)) >
+          sketch.MaxCountError()) {
+        ++misses;
+      }
+    } else {
+      int a = distrib(gen);
+      tree.insert(a);
+      sketch.insert(a);
+    }
+  }
+  EXPECT_LE(misses, queries / 100);
+  auto total = static_cast<std::size_t>(std::abs(
+      tree.CountByRange(first, last) - sketch.CountByRange(first, last)));
+  EXPECT_LE(total, sketch.MaxCountError());
+}
+
+TEST(KllSketchInt, Merge) {
+  auto left = adt::KllSketch<int>{};
+  auto right = adt::KllSketch<int>{};
+  for (int i = 0; i < 50000; ++i) {
+    left.insert(i);
+    right.insert(50000 + i);
+  }
+  left.Merge(right);
+  EXPECT_EQ(left.size(), 100000);
+  auto error = static_cast<std::size_t>(
+      std::abs(left.CountByRange(25000, 74999) - 50000));
+  EXPECT_LE(error, left.MaxCountError());
+}
+
+} // namespace
+} // namespace project
+} // namespace my
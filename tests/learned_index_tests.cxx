@@ -0,0 +1,83 @@
+#include "learned_index.h"
+#include "simple_adt.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <gtest/gtest.h>
+#include <limits>
+#include <random>
+#include <vector>
+
+namespace my {
+namespace project {
+namespace {
+
+TEST(LearnedIndexInt, Empty) {
+  auto index = adt::LearnedIndex<int>{std::vector<int>{}};
+  EXPECT_EQ(index.size(), 0);
+  EXPECT_EQ(index.SegmentCount(), 0);
+  EXPECT_EQ(index.rank(5), 0);
+  EXPECT_FALSE(index.contains(5));
+  EXPECT_EQ(index.CountByRange(0, 10), 0);
+}
+
+TEST(LearnedIndexInt, LinearKeysNeedOneSegment) {
+  std::vector<int> keys;
+  for (int i = 0; i < 10000; ++i) {
+    keys.push_back(100 + 3 * i);
+  }
+  auto index = adt::LearnedIndex<int>(keys, 4);
+  EXPECT_EQ(index.SegmentCount(), 1);
+  EXPECT_EQ(index.MaxError(), 0);
+  EXPECT_EQ(index.rank(100), 0);
+  EXPECT_EQ(index.rank(101), 1);
+  EXPECT_EQ(index.rank(1000000), 10000);
+  EXPECT_TRUE(index.contains(103));
+  EXPECT_FALSE(index.contains(104));
+  EXPECT_EQ(index.CountByRange(100, 129), 10);
+}
+
+TEST(LearnedIndexInt, RankMatchesBinarySearch) {
+  std::mt19937 gen(3);
+  std::uniform_int_distribution<> distrib(0, 100000000);
+  auto tree = adt::Adt<int>{};
+  for (int i = 0; i < 100000; ++i) {
+    tree.insert(distrib(gen));
+  }
+  auto keys = tree.GetInorderVector();
+  for (std::size_t epsilon : {0, 1, 8, 64}) {
+    auto index = adt::LearnedIndex<int>(keys, epsilon);
+    EXPECT_LE(index.MaxError(), epsilon);
+    for (int i = 0; i < 10000; ++i) {
+      int v = distrib(gen);
+      auto expected = static_cast<std::size_t>(
+          std::lower_bound(keys.begin(), keys.end(), v) - keys.begin());
+      ASSERT_EQ(index.rank(v), expected);
+    }
+    for (int i = 0; i < 1000; ++i) {
+      int v = keys[static_cast<std::size_t>(distrib(gen)) % keys.size()];
+      ASSERT_EQ(index.rank(v), tree.rank(v));
+      ASSERT_EQ(index.CountByRange(v, v + 1000000),
+                tree.CountByRange(v, v + 1000000));
+    }
+  }
+}
+
+TEST(LearnedIndexInt, ExtremeKeys) {
+  using Key = std::int64_t;
+  const Key min = std::numeric_limits<Key>::min();
+  const Key max = std::numeric_limits<Key>::max();
+  std::vector<Key> keys = {min, min + 1, -5, 0, 7, max - 1, max};
+  auto index = adt::LearnedIndex<Key>(keys, 1);
+  EXPECT_LE(index.MaxError(), 1);
+  for (std::size_t i = 0; i < keys.size(); ++i) {
+    EXPECT_EQ(index.rank(keys[i]), i);
+  }
+  EXPECT_EQ(index.rank(1), 4);
+  EXPECT_EQ(index.CountByRange(min, max), 7);
+  EXPECT_EQ(index.CountByRange(1, max), 3);
+}
+
+} // namespace
+} // namespace project
+} // namespace my
@@ -0,0 +1,94 @@
+#include "membership_filter.h"
+
+#include <gtest/gtest.h>
+#include <random>
+#include <set>
+#include <vector>
+
+namespace my {
+namespace project {
+namespace {
+
+// n distinct random keys, odd ones only: even keys are never inserted
+std::vector<int> OddKeys(std::size_t n, unsigned seed) {
+  std::mt19937 gen(seed);
+  std::uniform_int_distribution<> key(0, 1 << 29);
+  std::set<int> keys;
+  while (keys.size() < n) {
+    keys.insert(2 * key(gen) + 1);
+  }
+  return {keys.begin(), keys.end()};
+}
+
+// share of 100000 absent (even) keys the filter lets through
+template <class Filter> double FalsePositiveRate(const Filter &filter) {
+  std::size_t passed = 0;
+  for (int a = 0; a < 200000; a += 2) {
+    passed += filter.MayContain(a);
+  }
+  return passed / 100000.0;
+}
+
+TEST(BlockedBloomFilterInt, NoFalseNegatives) {
+  auto keys = OddKeys(50000, 50);
+  adt::BlockedBloomFilter<int> filter(keys.size());
+  for (int a : keys) {
+    filter.insert(a);
+  }
+  for (int a : keys) {
+    ASSERT_TRUE(filter.MayContain(a));
+  }
+  EXPECT_LT(FalsePositiveRate(filter), 0.03);
+  EXPECT_EQ(filter.MemoryBytes(), 50000 * 10 / 512 * 64 + 64);
+  filter.Clear();
+  EXPECT_EQ(FalsePositiveRate(filter), 0.0);
+}
+
+TEST(XorFilterInt, BuildAndQuery) {
+  adt::XorFilter<int> filter;
+  EXPECT_FALSE(filter.MayContain(1)); // not built
+  auto keys = OddKeys(50000, 51);
+  std::vector<int> twice = keys;
+  twice.insert(twice.end(), keys.begin(), keys.end());
+  ASSERT_TRUE(filter.Build(twice));
+  EXPECT_EQ(filter.size(), keys.size());
+  for (int a : keys) {
+    ASSERT_TRUE(filter.MayContain(a));
+  }
+  EXPECT_LT(FalsePositiveRate(filter), 0.01);
+  EXPECT_LT(filter.MemoryBytes() * 8.0 / keys.size(), 10.0);
+  // small and empty sets
+  for (std::size_t n : {0, 1, 2, 5}) {
+    std::vector<int> few(keys.begin(), keys.begin() + n);
+    ASSERT_TRUE(filter.Build(few));
+    for (int a : few) {
+      EXPECT_TRUE(filter.MayContain(a));
+    }
+  }
+  // an empty set has no false positives, even after a larger one
+  ASSERT_TRUE(filter.Build(std::vector<int>{}));
+  EXPECT_EQ(filter.size(), 0);
+  EXPECT_EQ(FalsePositiveRate(filter), 0.0);
+  EXPECT_FALSE(filter.MayContain(keys[0]));
+}
+
+TEST(XorFilterInt, FromFrozenSnapshot) {
+  auto keys = OddKeys(1000, 52);
+  adt::FrozenAdt<int> frozen(keys);
+  adt::XorFilter<int> filter;
+  ASSERT_TRUE(filter.Build(frozen));
+  for (int a : keys) {
+    EXPECT_TRUE(filter.MayContain(a));
+  }
+}
+
+TEST(FilterHash, EqualKeysHashAlike) {
+  adt::FilterHash<double> hash;
+  EXPECT_EQ(hash(0.0), hash(-0.0));
+  EXPECT_NE(hash(1.0), hash(2.0));
+  EXPECT_NE(adt::FilterHash<long>()(1), adt::FilterHash<long>()(2));
+}
+
+} // namespace
+} // namespace project
+} // namespace my
@@ -0,0 +1,183 @@
+#include "persistent_adt.h"
+
+#if defined(__unix__)
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <gtest/gtest.h>
+#include <random>
+#include <set>
+#include <string>
+#include <vector>
+
+namespace my {
+namespace project {
+namespace {
+
+using Tree = adt::PersistentAdt<int>;
+
+// tmpfs when available
+std::string TempPath(const std::string &name) {
+  std::filesystem::path dir = "/dev/shm";
+  if (!std::filesystem::is_directory(dir)) {
+    dir = std::filesystem::temp_directory_path();
+  }
+  return (dir / (name + std::to_string(getpid()))).string();
+}
+
+TEST(PersistentAdtInt, CreateInsertQuery) {
+  auto path = TempPath("persistent_adt_query");
+  Tree tree;
+  ASSERT_TRUE(tree.Create(path));
+  EXPECT_EQ(tree.size(), 0);
+  EXPECT_EQ(tree.begin(), tree.end());
+  std::mt19937 gen(43);
+  std::uniform_int_distribution<> key(0, 100000);
+  std::set<int> expected;
+  for (int i = 0; i < 20000; ++i) {
+    int a = key(gen);
+    EXPECT_EQ(tree.insert(a), expected.insert(a).second);
+    if (i % 5000 == 0) {
+      EXPECT_TRUE(tree.Publish());
+    }
+  }
+  EXPECT_EQ(tree.size(), expected.size());
+  EXPECT_TRUE(std::equal(tree.begin(), tree.end(), expected.begin(),
+                         expected.end()));
+  for (int a = -1; a <= 100001; a += 613) {
+    EXPECT_EQ(tree.rank(a), static_cast<std::size_t>(std::distance(
+                                expected.begin(), expected.lower_bound(a))));
+    EXPECT_EQ(tree.CountByRange(a, a + 3000),
+              std::distance(expected.lower_bound(a),
+                            expected.upper_bound(a + 3000)));
+    EXPECT_EQ(tree.contains(a), expected.count(a) > 0);
+    auto it = tree.lower_bound(a);
+    auto upper = tree.upper_bound(a);
+    if (expected.lower_bound(a) == expected.end()) {
+      EXPECT_EQ(it, tree.end());
+    } else {
+      EXPECT_EQ(*it, *expected.lower_bound(a));
+      EXPECT_EQ(*upper, *expected.upper_bound(a));
+    }
+  }
+  tree.Close();
+  std::filesystem::remove(path);
+}
+
+TEST(PersistentAdtInt, ReadersSeePublishedVersions) {
+  auto path = TempPath("persistent_adt_readers");
+  Tree writer;
+  ASSERT_TRUE(writer.Create(path));
+  for (int a = 0; a < 1000; ++a) {
+    writer.insert(a * 2);
+  }
+  ASSERT_TRUE(writer.Publish());
+  Tree reader; // a second mapping, as in another process
+  ASSERT_TRUE(reader.Open(path));
+  EXPECT_EQ(reader.size(), 1000);
+  EXPECT_FALSE(reader.insert(1));
+  std::vector<int> before(reader.begin(), reader.end());
+  // unpublished inserts are not visible, published nodes are not changed
+  for (int a = 0; a < 100000; ++a) {
+    writer.insert(a * 2 + 1);
+  }
+  EXPECT_TRUE(reader.Refresh());
+  EXPECT_EQ(reader.size(), 1000);
+  EXPECT_EQ(std::vector<int>(reader.begin(), reader.end()), before);
+  EXPECT_EQ(reader.CountByRange(0, 100), 51);
+  ASSERT_TRUE(writer.Publish());
+  EXPECT_TRUE(reader.Refresh());
+  EXPECT_EQ(reader.size(), 101000);
+  EXPECT_EQ(reader.Version(), writer.Version());
+  EXPECT_EQ(reader.CountByRange(0, 100), 101);
+}
+
+TEST(PersistentAdtInt, CrashKeepsLastPublished) {
+  auto path = TempPath("persistent_adt_crash");
+  {
+    Tree writer;
+    ASSERT_TRUE(writer.Create(path));
+    writer.insert(1);
+    writer.insert(2);
+    ASSERT_TRUE(writer.Publish());
+    writer.insert(3); // lost, never published
+  }
+  Tree tree;
+  ASSERT_TRUE(tree.Open(path, true));
+  EXPECT_EQ(std::vector<int>(tree.begin(), tree.end()),
+            (std::vector<int>{1, 2}));
+  EXPECT_TRUE(tree.insert(4));
+  ASSERT_TRUE(tree.Publish());
+  tree.Close();
+  // torn write of the newest header slot falls back to the older version
+  Tree reader;
+  ASSERT_TRUE(reader.Open(path));
+  auto version = reader.Version();
+  reader.Close();
+  {
+    std::FILE *f = std::fopen(path.c_str(), "r+b");
+    ASSERT_NE(f, nullptr);
+    std::fseek(f, static_cast<long>(version % 2 * 56 + 20), SEEK_SET);
+    std::fputc(0x7f, f);
+    std::fclose(f);
+  }
+  ASSERT_TRUE(reader.Open(path));
+  EXPECT_EQ(reader.Version(), version - 1);
+  EXPECT_EQ(std::vector<int>(reader.begin(), reader.end()),
+            (std::vector<int>{1, 2}));
+  reader.Close();
+  std::filesystem::remove(path);
+  EXPECT_FALSE(reader.Open(path));
+}
+
+TEST(PersistentAdtInt, SingleWriter) {
+  auto path = TempPath("persistent_adt_writer");
+  Tree writer;
+  ASSERT_TRUE(writer.Create(path));
+  writer.insert(1);
+  ASSERT_TRUE(writer.Publish());
+  Tree other;
+  EXPECT_FALSE(other.Create(path)); // would truncate the writer's file
+  EXPECT_FALSE(other.Open(path, true));
+  ASSERT_TRUE(other.Open(path)); // readers are not locked out
+  EXPECT_EQ(other.size(), 1);
+  writer.Close();
+  EXPECT_TRUE(other.Open(path, true));
+  other.Close();
+  std::filesystem::remove(path);
+}
+
+TEST(PersistentAdtInt, RootOutsideOfNodes) {
+  auto path = TempPath("persistent_adt_root");
+  {
+    Tree writer;
+    ASSERT_TRUE(writer.Create(path));
+    writer.insert(1);
+    ASSERT_TRUE(writer.Publish());
+  }
+  // both header slots get root 1000 of 1 node with a valid checksum
+  std::FILE *f = std::fopen(path.c_str(), "r+b");
+  ASSERT_NE(f, nullptr);
+  for (long slot = 0; slot < 2; ++slot) {
+    char header[56];
+    std::fseek(f, slot * 56, SEEK_SET);
+    ASSERT_EQ(std::fread(header, 1, sizeof(header), f), sizeof(header));
+    const std::uint64_t root = 1000;
+    std::memcpy(header + 40, &root, sizeof(root));
+    const std::uint64_t checksum = adt::Fnv1a(header, 48);
+    std::memcpy(header + 48, &checksum, sizeof(checksum));
+    std::fseek(f, slot * 56, SEEK_SET);
+    std::fwrite(header, 1, sizeof(header), f);
+  }
+  std::fclose(f);
+  Tree tree;
+  EXPECT_FALSE(tree.Open(path));
+  EXPECT_FALSE(tree.Open(path, true));
+  std::filesystem::remove(path);
+}
+
+} // namespace
+} // namespace project
+} // namespace my
+#endif
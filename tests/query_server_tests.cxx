@@ -0,0 +1,205 @@
+#include "query_server.h"
+
+#if defined(__linux__)
+#include <filesystem>
+#include <gtest/gtest.h>
+#include <random>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace my {
+namespace project {
+namespace {
+
+std::string SocketPath(const std::string &name) {
+  return (std::filesystem::temp_directory_path() /
+          (name + std::to_string(getpid())))
+      .string();
+}
+
+int Connect(const std::string &path) {
+  sockaddr_un addr{};
+  addr.sun_family = AF_UNIX;
+  std::memcpy(addr.sun_path, path.c_str(), path.size() + 1);
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (connect(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) != 0) {
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+// send request in pieces of chunk bytes, finish sending and read all answers
+std::string Exchange(const std::string &path, const std::string &request,
+                     std::size_t chunk) {
+  int fd = Connect(path);
+  if (fd < 0) {
+    return "no connection";
+  }
+  std::thread sender([fd, &request, chunk] {
+    for (std::size_t pos = 0; pos < request.size(); pos += chunk) {
+      std::size_t size = std::min(chunk, request.size() - pos);
+      if (send(fd, request.data() + pos, size, MSG_NOSIGNAL) !=
+          static_cast<ssize_t>(size)) {
+        break;
+      }
+    }
+    shutdown(fd, SHUT_WR);
+  });
+  std::string answer;
+  char buffer[4096];
+  for (ssize_t got; (got = read(fd, buffer, sizeof(buffer))) > 0;) {
+    answer.append(buffer, static_cast<std::size_t>(got));
+  }
+  sender.join();
+  close(fd);
+  return answer;
+}
+
+TEST(QueryServerInt, PipelinedMatchesLocal) {
+  auto path = SocketPath("query_server_pipe");
+  adt::QueryServer<int> server;
+  ASSERT_TRUE(server.Listen(path));
+  ASSERT_TRUE(server.Start(2));
+  std::mt19937 gen(47);
+  std::uniform_int_distribution<> key(-1000, 1000);
+  std::set<int> expected;
+  std::string request;
+  std::string answer;
+  for (int i = 0; i < 3000; ++i) {
+    if (i % 3 != 0) {
+      int a = key(gen);
+      expected.insert(a);
+      request += "k " + std::to_string(a) + "\n";
+    } else {
+      int a = key(gen);
+      int b = a + 200;
+      request += "q " + std::to_string(a) + " " + std::to_string(b) + "\n";
+      answer += std::to_string(std::distance(expected.lower_bound(a),
+                                             expected.upper_bound(b))) +
+                " ";
+    }
+  }
+  // small pieces split numbers between reads
+  EXPECT_EQ(Exchange(path, request, 7), answer + "\n");
+  EXPECT_EQ(server.Requests(), 3000);
+  // unknown commands are skipped, the last number ends with input
+  EXPECT_EQ(Exchange(path, "x q -1000 1000 k 5000 q 4999 5000", 1000),
+            std::to_string(expected.size()) + " 1 \n");
+  server.Stop();
+  EXPECT_EQ(server.Tree().size(), expected.size() + 1);
+  EXPECT_FALSE(std::filesystem::exists(path));
+}
+
+TEST(QueryServerInt, BadQueryDropsClient) {
+  auto path = SocketPath("query_server_bad");
+  adt::QueryServer<int> server;
+  server.Tree().insert(1);
+  server.Tree().insert(2);
+  ASSERT_TRUE(server.Listen(path));
+  ASSERT_TRUE(server.Start(1));
+  // answers before the error are sent, the rest is ignored
+  EXPECT_EQ(Exchange(path, "q 0 5 q 5 2 q 0 5", 100), "2 ");
+  EXPECT_EQ(Exchange(path, "q 0 z", 100), "");
+  EXPECT_EQ(Exchange(path, "q 0 5", 100), "2 \n");
+  EXPECT_EQ(server.Clients(), 3);
+}
+
+TEST(QueryServerInt, Histogram) {
+  auto path = SocketPath("query_server_hist");
+  adt::QueryServer<int> server;
+  ASSERT_TRUE(server.Listen(path));
+  ASSERT_TRUE(server.Start(1));
+  EXPECT_EQ(Exchange(path, "k 1 k 2 k 7 h 3 0 2 2 10 q 0 5 h 0 4", 3),
+            "1 0 2 2 \n");
+  EXPECT_EQ(Exchange(path, "h 2 0 5 3 q 0 9", 100), "");
+  // boundaries of a long h arrive over many reads
+  std::string request = "h 20000";
+  std::string answer = "0 1 1 0 0 0 0 1 ";
+  for (int b = 0; b <= 20000; ++b) {
+    request += " " + std::to_string(b);
+  }
+  for (int b = 8; b < 20000; ++b) {
+    answer += "0 ";
+  }
+  EXPECT_EQ(Exchange(path, request + " q 0 9", 1000), answer + "3 \n");
+}
+
+TEST(QueryServerInt, LongCommandDropsClient) {
+  auto path = SocketPath("query_server_long");
+  adt::QueryServer<int> server;
+  ASSERT_TRUE(server.Listen(path));
+  ASSERT_TRUE(server.Start(1));
+  // a number that never ends is not buffered without limit: the client is
+  // dropped while it still sends
+  int fd = Connect(path);
+  ASSERT_GE(fd, 0);
+  timeval timeout{10, 0};
+  setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+  std::thread sender([fd] {
+    std::string digits(4096, '1');
+    send(fd, "q 0 ", 4, MSG_NOSIGNAL);
+    for (int i = 0; i < 256; ++i) {
+      if (send(fd, digits.data(), digits.size(), MSG_NOSIGNAL) < 0) {
+        break;
+      }
+    }
+  });
+  char buffer[16];
+  ssize_t got = read(fd, buffer, sizeof(buffer));
+  EXPECT_TRUE(got == 0 || (got < 0 && errno == ECONNRESET));
+  shutdown(fd, SHUT_RDWR);
+  sender.join();
+  close(fd);
+  EXPECT_EQ(Exchange(path, "q 0 5", 100), "0 \n");
+}
+
+TEST(QueryServerInt, ConcurrentClients) {
+  auto path = SocketPath("query_server_many");
+  adt::QueryServer<int> server;
+  for (int a = 0; a < 10000; a += 2) {
+    server.Tree().insert(a);
+  }
+  ASSERT_TRUE(server.Listen(path));
+  ASSERT_TRUE(server.Start(4));
+  const int kReaders = 8;
+  std::vector<std::string> requests(kReaders);
+  std::vector<std::string> expected(kReaders);
+  std::vector<std::string> answers(kReaders);
+  for (int r = 0; r < kReaders; ++r) {
+    for (int i = 0; i < 2000; ++i) {
+      int a = (i * 37 + r * 101) % 9000;
+      requests[r] += "q " + std::to_string(a) + " " +
+                     std::to_string(a + 999) + " ";
+      expected[r] += std::to_string(500) + " ";
+    }
+    expected[r] += "\n";
+  }
+  std::string inserts; // keys above every query range
+  for (int a = 20000; a < 30000; ++a) {
+    inserts += "k " + std::to_string(a) + " ";
+  }
+  std::vector<std::thread> clients;
+  for (int r = 0; r < kReaders; ++r) {
+    clients.emplace_back([&, r] {
+      answers[r] = Exchange(path, requests[r], 512 + r);
+    });
+  }
+  std::string writer = Exchange(path, inserts, 4096);
+  for (auto &client : clients) {
+    client.join();
+  }
+  EXPECT_EQ(writer, "\n");
+  for (int r = 0; r < kReaders; ++r) {
+    EXPECT_EQ(answers[r], expected[r]);
+  }
+  server.Stop();
+  EXPECT_EQ(server.Tree().size(), 15000);
+}
+
+} // namespace
+} // namespace project
+} // namespace my
+#endif
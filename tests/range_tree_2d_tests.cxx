@@ -0,0 +1,102 @@
+#include "range_tree_2d.h"
+
+#include <gtest/gtest.h>
+#include <random>
+#include <vector>
+
+namespace my {
+namespace project {
+namespace {
+
+using Point = adt::Point<int>;
+
+std::size_t CountByRect(const std::vector<Point> &all, int x1, int x2, int y1,
+                        int y2) {
+  std::size_t result = 0;
+  for (const auto &p : all) {
+    result += x1 <= p.x && p.x <= x2 && y1 <= p.y && p.y <= y2;
+  }
+  return result;
+}
+
+std::vector<Point> RandomPoints(std::mt19937 &gen, int n, int side) {
+  std::uniform_int_distribution<> coord(0, side);
+  std::vector<Point> points(n);
+  for (auto &p : points) {
+    p = {coord(gen), coord(gen)};
+  }
+  return points;
+}
+
+TEST(RangeTree2DInt, Empty) {
+  auto tree = adt::RangeTree2D<int>{};
+  EXPECT_EQ(tree.size(), 0);
+  EXPECT_EQ(tree.CountByRect(0, 10, 0, 10), 0);
+  tree.Rebuild();
+  EXPECT_EQ(tree.CountByRect(0, 10, 0, 10), 0);
+}
+
+TEST(RangeTree2DInt, Duplicates) {
+  auto tree = adt::RangeTree2D<int>(
+      std::vector<Point>{{1, 1}, {1, 1}, {1, 2}, {2, 1}, {3, 3}, {3, 3}});
+  EXPECT_EQ(tree.size(), 6);
+  EXPECT_EQ(tree.CountByRect(1, 1, 1, 1), 2);
+  EXPECT_EQ(tree.CountByRect(1, 2, 1, 2), 4);
+  EXPECT_EQ(tree.CountByRect(0, 5, 3, 3), 2);
+  EXPECT_EQ(tree.CountByRect(0, 5, 0, 5), 6);
+  EXPECT_EQ(tree.CountByRect(2, 1, 0, 5), 0);
+}
+
+TEST(RangeTree2DInt, MatchesLinearScan) {
+  std::mt19937 gen(19);
+  // small side gives many equal x and y
+  auto points = RandomPoints(gen, 3000, 200);
+  auto tree = adt::RangeTree2D<int>(points, 1);
+  std::uniform_int_distribution<> coord(-10, 210);
+  for (int i = 0; i < 2000; ++i) {
+    int x1 = coord(gen);
+    int x2 = coord(gen);
+    int y1 = coord(gen);
+    int y2 = coord(gen);
+    ASSERT_EQ(tree.CountByRect(x1, x2, y1, y2),
+              CountByRect(points, x1, x2, y1, y2));
+  }
+}
+
+TEST(RangeTree2DInt, ThreadsGiveSameResult) {
+  std::mt19937 gen(23);
+  auto points = RandomPoints(gen, 5000, 100000);
+  auto single = adt::RangeTree2D<int>(points, 1);
+  auto parallel = adt::RangeTree2D<int>(points, 4);
+  std::uniform_int_distribution<> coord(0, 100000);
+  for (int i = 0; i < 1000; ++i) {
+    int x = coord(gen);
+    int y = coord(gen);
+    ASSERT_EQ(single.CountByRect(x, x + 20000, y, y + 30000),
+              parallel.CountByRect(x, x + 20000, y, y + 30000));
+  }
+}
+
+TEST(RangeTree2DInt, InsertAfterBuild) {
+  std::mt19937 gen(29);
+  auto points = RandomPoints(gen, 1000, 1000);
+  auto tree = adt::RangeTree2D<int>(points);
+  auto more = RandomPoints(gen, 2000, 1000);
+  std::uniform_int_distribution<> coord(0, 1000);
+  bool rebuilt = false;
+  for (const auto &p : more) {
+    tree.insert(p);
+    points.push_back(p);
+    rebuilt = rebuilt || tree.PendingSize() == 0;
+    int x = coord(gen);
+    int y = coord(gen);
+    ASSERT_EQ(tree.CountByRect(x, x + 300, y, y + 300),
+              CountByRect(points, x, x + 300, y, y + 300));
+  }
+  EXPECT_TRUE(rebuilt);
+  EXPECT_EQ(tree.size(), points.size());
+}
+
+} // namespace
+} // namespace project
+} // namespace my
@@ -0,0 +1,12 @@
+# Run RANGE_QUERY with ARGS on INPUT and compare its output with ANSWER
+execute_process(
+  COMMAND ${RANGE_QUERY} ${ARGS}
+  INPUT_FILE ${INPUT}
+  OUTPUT_VARIABLE output
+  RESULT_VARIABLE result
+)
+file(READ ${ANSWER} expected)
+if (NOT result EQUAL 0 OR NOT output STREQUAL expected)
+  message(FATAL_ERROR "range_query ${ARGS} < ${INPUT}: exit ${result}, "
+                      "output '${output}', expected '${expected}'")
+endif()
@@ -0,0 +1,63 @@
+#include "spsc_ring.h"
+
+#include <gtest/gtest.h>
+#include <memory>
+#include <thread>
+#include <vector>
+
+namespace my {
+namespace project {
+namespace {
+
+TEST(SpscRingInt, FullAndEmpty) {
+  adt::SpscRing<int> ring(3);
+  EXPECT_EQ(ring.Capacity(), 4);
+  int value = 0;
+  EXPECT_FALSE(ring.try_pop(value));
+  for (int i = 1; i <= 4; ++i) {
+    EXPECT_TRUE(ring.try_push(i));
+  }
+  int extra = 5;
+  EXPECT_FALSE(ring.try_push(extra));
+  EXPECT_EQ(extra, 5);
+  // indices wrap around the slots
+  for (int i = 1; i <= 10; ++i) {
+    ASSERT_TRUE(ring.try_pop(value));
+    EXPECT_EQ(value, i);
+    int next = i + 4;
+    EXPECT_TRUE(ring.try_push(next));
+  }
+  EXPECT_EQ(ring.pop(), 11);
+}
+
+TEST(SpscRingInt, MoveOnlyItems) {
+  adt::SpscRing<std::unique_ptr<int>> ring(2);
+  ring.push(std::make_unique<int>(7));
+  auto p = ring.pop();
+  ASSERT_NE(p, nullptr);
+  EXPECT_EQ(*p, 7);
+}
+
+TEST(SpscRingInt, ProducerConsumerKeepOrder) {
+  const int kItems = 200000;
+  adt::SpscRing<int> ring(16); // small ring makes both sides wait
+  std::vector<int> received;
+  received.reserve(kItems);
+  std::thread consumer([&ring, &received] {
+    for (int i = 0; i < kItems; ++i) {
+      received.push_back(ring.pop());
+    }
+  });
+  for (int i = 0; i < kItems; ++i) {
+    ring.push(i);
+  }
+  consumer.join();
+  ASSERT_EQ(received.size(), kItems);
+  for (int i = 0; i < kItems; ++i) {
+    ASSERT_EQ(received[i], i);
+  }
+}
+
+} // namespace
+} // namespace project
+} // namespace my
@@ -0,0 +1,133 @@
+#include "string_adt.h"
+
+#include <gtest/gtest.h>
+#include <random>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace my {
+namespace project {
+namespace {
+
+using adt::StringKey;
+
+// keys around the prefix and inline sizes, embedded zeros and 0xff bytes
+std::vector<std::string> EdgeKeys() {
+  std::vector<std::string> keys = {"", "a", std::string("a\0", 2),
+                                   std::string("a\0b", 3), "ab", "\xff",
+                                   "\xff\xff", "b"};
+  for (std::size_t n : {7, 8, 9, 27, 28, 29, 64}) {
+    keys.push_back(std::string(n, 'x'));
+    keys.push_back(std::string(n - 1, 'x') + 'y');
+    keys.push_back(std::string(n - 1, 'x') + '\0');
+  }
+  return keys;
+}
+
+TEST(StringKey, OrderMatchesString) {
+  auto keys = EdgeKeys();
+  for (const auto &a : keys) {
+    for (const auto &b : keys) {
+      StringKey x(a);
+      StringKey y = StringKey::Borrow(b);
+      EXPECT_EQ(x <=> y, a <=> b) << a << " " << b;
+      EXPECT_EQ(x == y, a == b);
+    }
+  }
+}
+
+TEST(StringKey, CopyOwnsBytes) {
+  std::string text(40, 'k');
+  StringKey borrowed = StringKey::Borrow(text);
+  StringKey copy = borrowed;
+  text[30] = 'z';
+  EXPECT_EQ(borrowed.view(), text);
+  EXPECT_EQ(copy.view(), std::string(40, 'k'));
+  StringKey moved = std::move(copy);
+  EXPECT_EQ(moved.size(), 40);
+  EXPECT_EQ(copy.size(), 0);
+  copy = moved;
+  EXPECT_EQ(copy, moved);
+  EXPECT_EQ(StringKey("short").str(), "short");
+}
+
+TEST(StringAdt, MatchesStdSet) {
+  std::mt19937 gen(49);
+  // path-like keys share long prefixes
+  std::vector<std::string> parts = {"/usr", "/lib", "/local", "/share",
+                                    "/x86_64-linux-gnu", "/a", "/b"};
+  std::uniform_int_distribution<std::size_t> part(0, parts.size() - 1);
+  std::uniform_int_distribution<> depth(1, 8);
+  auto make = [&] {
+    std::string key;
+    for (int d = depth(gen); d > 0; --d) {
+      key += parts[part(gen)];
+    }
+    return key;
+  };
+  adt::StringAdt tree;
+  std::set<std::string> expected;
+  for (int i = 0; i < 5000; ++i) {
+    auto key = make();
+    if (i % 4 == 0) {
+      EXPECT_EQ(tree.erase(key), expected.erase(key));
+    } else {
+      EXPECT_EQ(tree.insert(key), expected.insert(key).second);
+    }
+  }
+  for (const auto &key : EdgeKeys()) {
+    tree.insert(key);
+    expected.insert(key);
+  }
+  ASSERT_EQ(tree.size(), expected.size());
+  std::vector<std::string> all;
+  tree.for_each_in_range(
+      "", "\xff\xff\xff",
+      [&all](std::string_view key) { all.emplace_back(key); });
+  EXPECT_EQ(all, std::vector<std::string>(expected.begin(), expected.end()));
+  for (int i = 0; i < 300; ++i) {
+    auto a = make();
+    auto b = make();
+    if (b < a) {
+      std::swap(a, b);
+    }
+    EXPECT_EQ(tree.CountByRange(a, b),
+              std::distance(expected.lower_bound(a), expected.upper_bound(b)));
+    EXPECT_EQ(tree.contains(a), expected.count(a) > 0);
+    EXPECT_EQ(tree.rank(a), static_cast<std::size_t>(std::distance(
+                                expected.begin(), expected.lower_bound(a))));
+    auto prefix = a.substr(0, a.size() / 2);
+    std::size_t with_prefix = 0;
+    for (const auto &key : expected) {
+      with_prefix += key.starts_with(prefix);
+    }
+    EXPECT_EQ(tree.CountByPrefix(prefix), with_prefix) << prefix;
+  }
+  EXPECT_EQ(tree.CountByPrefix(""), expected.size());
+  EXPECT_EQ(tree.CountByPrefix("\xff"), 2);
+  EXPECT_EQ(tree.CountByPrefix(std::string("a\0", 2)), 2);
+  EXPECT_EQ(tree.CountByPrefix("xxxxxxxxx"), 13);
+  EXPECT_EQ(tree.CountByPrefix("/usr/lib/usr/lib/usr/lib/usr/lib/usr/lib/q"),
+            0);
+}
+
+TEST(StringAdt, Multiset) {
+  adt::StringAdt tree;
+  tree.SetMultiset(true);
+  std::string long_key(50, 'p');
+  for (int i = 0; i < 3; ++i) {
+    EXPECT_TRUE(tree.insert(long_key));
+    EXPECT_TRUE(tree.insert("p"));
+  }
+  EXPECT_EQ(tree.count(long_key), 3);
+  EXPECT_EQ(tree.CountByPrefix("pp"), 3);
+  EXPECT_EQ(tree.CountByPrefix("p"), 6);
+  EXPECT_EQ(tree.erase(long_key), 1);
+  EXPECT_EQ(tree.CountByRange("p", long_key), 5);
+}
+
+} // namespace
+} // namespace project
+} // namespace my
@@ -1,7 +1,17 @@
 #include "simple_adt.h"
 
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
 #include <gtest/gtest.h>
 #include <iterator>
+#include <limits>
+#include <random>
+#include <set>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <utility>
 #include <vector>
 
 namespace my {
@@ -535,6 +545,705 @@ TEST(AdtInt, DecrementEndIterator) {
   EXPECT_EQ(*it, 150);
 }
 
+TEST(AdtInt, RankSelect) {
+  auto dt = adt::Adt<int>{};
+  std::vector<int> source = {100, 50, 150, 25, 75, 125, 175, 12, 35, 20};
+  for (int a : source) {
+    dt.insert(a);
+  }
+  std::vector<int> required_inorder = {12, 20,  25,  35,  50,
+                                       75, 100, 125, 150, 175};
+  for (std::size_t i = 0; i < required_inorder.size(); ++i) {
+    EXPECT_EQ(*dt.select(i), required_inorder[i]);
+    EXPECT_EQ(dt.rank(required_inorder[i]), i);
+    EXPECT_EQ(dt.rank(required_inorder[i] + 1), i + 1);
+  }
+  EXPECT_EQ(dt.select(required_inorder.size()), dt.end());
+  EXPECT_EQ(dt.rank(0), 0);
+  auto it = dt.select(3);
+  ++it;
+  EXPECT_EQ(*it, 50);
+}
+
+TEST(AdtInt, DeferredTags) {
+  auto eager = adt::Adt<int>{};
+  auto deferred = adt::Adt<int>{};
+  deferred.SetDeferredTags(true);
+  EXPECT_TRUE(deferred.DeferredTags());
+  for (int i = 0; i < 1000; ++i) {
+    int a = (i * 7919) % 1009;
+    eager.insert(a);
+    deferred.insert(a);
+    if (i % 97 == 0) {
+      EXPECT_EQ(deferred.CountByRange(a / 2, a), eager.CountByRange(a / 2, a));
+    }
+  }
+  EXPECT_EQ(deferred.GetPreorderVector(), eager.GetPreorderVector());
+  EXPECT_EQ(deferred.GetInorderAvlBalanceVector(),
+            eager.GetInorderAvlBalanceVector());
+  for (int a = 0; a < 1009; a += 13) {
+    EXPECT_EQ(deferred.CountByRange(a, a + 100),
+              eager.CountByRange(a, a + 100));
+    EXPECT_EQ(deferred.rank(a), eager.rank(a));
+  }
+  deferred.insert(2000);
+  EXPECT_EQ(*deferred.select(deferred.size() - 1), 2000);
+  deferred.SetDeferredTags(false);
+  deferred.insert(3000);
+  EXPECT_EQ(deferred.CountByRange(1500, 3500), 2);
+}
+
+TEST(AdtInt, InsertHint) {
+  auto plain = adt::Adt<int>{};
+  auto hinted = adt::Adt<int>{};
+  std::vector<int> source = {100, 50, 150, 25, 75, 125, 175, 12, 35, 20};
+  auto it = hinted.end();
+  for (int a : source) {
+    plain.insert(a);
+    auto result = hinted.insert(it, a);
+    EXPECT_TRUE(result.second);
+    EXPECT_EQ(*result.first, a);
+    it = hinted.begin();
+  }
+  auto result = hinted.insert(hinted.find(75), 75);
+  EXPECT_FALSE(result.second);
+  EXPECT_EQ(*result.first, 75);
+  result = hinted.insert(hinted.find(175), 60);
+  EXPECT_TRUE(result.second);
+  EXPECT_EQ(*result.first, 60);
+  EXPECT_EQ(*(++result.first), 75);
+  plain.insert(60);
+  EXPECT_EQ(plain.GetPreorderVector(), hinted.GetPreorderVector());
+  EXPECT_EQ(plain.GetInorderAvlBalanceVector(),
+            hinted.GetInorderAvlBalanceVector());
+}
+
+TEST(AdtInt, InsertSortedSequences) {
+  const int n = 1000;
+  std::vector<int> required_inorder(n);
+  for (int i = 0; i < n; ++i) {
+    required_inorder[i] = i;
+  }
+  auto ascending = adt::Adt<int>{};
+  auto descending = adt::Adt<int>{};
+  auto jitter = adt::Adt<int>{};
+  for (int i = 0; i < n; ++i) {
+    ascending.insert(i);
+    descending.insert(n - 1 - i);
+    jitter.insert(i % 2 == 0 ? std::min(i + 1, n - 1) : i - 1);
+  }
+  jitter.insert(n - 1);
+  for (auto *dt : {&ascending, &descending, &jitter}) {
+    EXPECT_EQ(dt->size(), static_cast<std::size_t>(n));
+    EXPECT_EQ(dt->GetInorderVector(), required_inorder);
+    EXPECT_EQ(dt->CountByRange(100, 199), 100);
+    for (int a : dt->GetInorderAvlBalanceVector()) {
+      EXPECT_LE(std::abs(a), 1);
+    }
+  }
+  // perfect tree of 2^k - 1 ascending keys
+  auto perfect = adt::Adt<int>{};
+  for (int i = 1; i < 16; ++i) {
+    perfect.insert(i);
+  }
+  std::vector<int> required_preorder = {8,  4,  2,  1,  3,  6,  5, 7,
+                                        12, 10, 9, 11, 14, 13, 15};
+  EXPECT_EQ(perfect.GetPreorderVector(), required_preorder);
+}
+
+TEST(AdtInt, BatchedLookups) {
+  auto dt = adt::Adt<int>{};
+  EXPECT_EQ(dt.find_many(std::vector<int>{1, 2}),
+            std::vector<adt::Adt<int>::iterator>(2, dt.end()));
+  for (int i = 0; i < 500; ++i) {
+    dt.insert((i * 37) % 1000);
+  }
+  std::vector<int> keys;
+  std::vector<std::pair<int, int>> ranges;
+  for (int i = -5; i < 1010; i += 3) {
+    keys.push_back(i);
+    ranges.emplace_back(i, i + 50);
+    ranges.emplace_back(i + 50, i);
+  }
+  auto found = dt.find_many(keys);
+  auto lower = dt.lower_bound_many(keys);
+  auto counts = dt.count_many(ranges);
+  ASSERT_EQ(found.size(), keys.size());
+  ASSERT_EQ(lower.size(), keys.size());
+  ASSERT_EQ(counts.size(), ranges.size());
+  for (std::size_t i = 0; i < keys.size(); ++i) {
+    EXPECT_EQ(found[i], dt.find(keys[i]));
+    EXPECT_EQ(lower[i], dt.lower_bound(keys[i]));
+  }
+  for (std::size_t i = 0; i < ranges.size(); ++i) {
+    EXPECT_EQ(counts[i], dt.CountByRange(ranges[i].first, ranges[i].second));
+  }
+}
+
+TEST(AdtInt, SortedBatchCount) {
+  auto dt = adt::Adt<int>{};
+  EXPECT_EQ(dt.count_many_sorted(std::vector<std::pair<int, int>>{{1, 2}}),
+            std::vector<int>{0});
+  dt.SetMultiset(true);
+  std::mt19937 gen(53);
+  std::uniform_int_distribution<> key(0, 2000);
+  for (int i = 0; i < 3000; ++i) {
+    dt.insert(key(gen));
+  }
+  // equal ends, empty, reversed and repeated ranges
+  std::vector<std::pair<int, int>> ranges = {
+      {5, 5}, {5, 5}, {-10, -1}, {100, 50}, {0, 2000}, {2001, 3000}};
+  for (int i = 0; i < 2000; ++i) {
+    int a = key(gen);
+    ranges.emplace_back(a, a + key(gen) % 300);
+  }
+  auto counts = dt.count_many_sorted(ranges);
+  ASSERT_EQ(counts.size(), ranges.size());
+  for (std::size_t i = 0; i < ranges.size(); ++i) {
+    ASSERT_EQ(counts[i], dt.CountByRange(ranges[i].first, ranges[i].second));
+  }
+  EXPECT_EQ(dt.count_many(ranges), counts); // batch is large, walk is sorted
+  // small batch takes interleaved descents
+  auto big = adt::Adt<int>{};
+  for (int i = 0; i < 100000; ++i) {
+    big.insert(i * 3);
+  }
+  ranges.resize(1000);
+  counts = big.count_many(ranges);
+  for (std::size_t i = 0; i < ranges.size(); ++i) {
+    ASSERT_EQ(counts[i], big.CountByRange(ranges[i].first, ranges[i].second));
+  }
+}
+
+TEST(AdtInt, Histogram) {
+  auto dt = adt::Adt<int>{};
+  EXPECT_EQ(dt.Histogram(std::vector<int>{0, 10, 20}),
+            (std::vector<std::size_t>{0, 0}));
+  dt.SetMultiset(true);
+  std::mt19937 gen(59);
+  std::uniform_int_distribution<> key(0, 10000);
+  std::multiset<int> expected;
+  for (int i = 0; i < 20000; ++i) {
+    int a = key(gen);
+    dt.insert(a);
+    expected.insert(a);
+  }
+  std::vector<int> boundaries = {-5, 0, 0, 1};
+  for (int b = 7; b < 10100; b += 1 + key(gen) % 40) {
+    boundaries.push_back(b);
+  }
+  auto buckets = dt.Histogram(boundaries);
+  ASSERT_EQ(buckets.size(), boundaries.size() - 1);
+  for (std::size_t i = 0; i < buckets.size(); ++i) {
+    ASSERT_EQ(buckets[i],
+              static_cast<std::size_t>(
+                  std::distance(expected.lower_bound(boundaries[i]),
+                                expected.lower_bound(boundaries[i + 1]))));
+  }
+  EXPECT_TRUE(dt.Histogram(std::vector<int>{1}).empty());
+  EXPECT_TRUE(dt.Histogram(std::vector<int>{5, 3, 8}).empty());
+}
+
+TEST(AdtInt, ForEachInRange) {
+  auto dt = adt::Adt<int>{};
+  std::vector<int> source = {100, 50, 150, 25, 75, 125, 175, 12, 35, 20};
+  for (int a : source) {
+    dt.insert(a);
+  }
+  std::vector<int> visited;
+  dt.for_each_in_range(20, 100, [&visited](int a) { visited.push_back(a); });
+  std::vector<int> required = {20, 25, 35, 50, 75, 100};
+  EXPECT_EQ(visited, required);
+  visited.clear();
+  dt.for_each_in_range(176, 200, [&visited](int a) { visited.push_back(a); });
+  dt.for_each_in_range(0, 11, [&visited](int a) { visited.push_back(a); });
+  dt.for_each_in_range(100, 50, [&visited](int a) { visited.push_back(a); });
+  EXPECT_TRUE(visited.empty());
+}
+
+TEST(AdtInt, CopyRange) {
+  auto dt = adt::Adt<int>{};
+  std::vector<int> out;
+  dt.copy_range(0, 10, out);
+  EXPECT_TRUE(out.empty());
+  for (int i = 0; i < 1000; ++i) {
+    dt.insert((i * 7919) % 1000);
+  }
+  for (int a = -10; a < 1010; a += 17) {
+    for (int b = a; b < 1010; b += 111) {
+      out.clear();
+      dt.copy_range(a, b, out);
+      std::vector<int> required;
+      for (auto it = dt.lower_bound(a); it != dt.end() && *it <= b; ++it) {
+        required.push_back(*it);
+      }
+      EXPECT_EQ(out, required);
+    }
+  }
+  out = {-1};
+  dt.copy_range(0, 2, out);
+  EXPECT_EQ(out, (std::vector<int>{-1, 0, 1, 2}));
+}
+
+TEST(AdtInt, LargeTreeTraversals) {
+  auto dt = adt::Adt<int>{};
+  const int n = 1 << 16;
+  for (int i = 0; i < n; ++i) {
+    dt.insert(static_cast<int>((i * 40503LL) % n));
+  }
+  auto inorder = dt.GetInorderVector();
+  auto preorder = dt.GetPreorderVector();
+  ASSERT_EQ(inorder.size(), static_cast<std::size_t>(n));
+  ASSERT_EQ(preorder.size(), static_cast<std::size_t>(n));
+  EXPECT_TRUE(std::is_sorted(inorder.begin(), inorder.end()));
+  EXPECT_EQ(preorder.front(), *dt.select(dt.rank(preorder.front())));
+  auto it = dt.begin();
+  auto copy = it;
+  ++it;
+  EXPECT_EQ(*copy, 0);
+  EXPECT_EQ(*it, 1);
+}
+
+TEST(AdtInt, Compact) {
+  auto dt = adt::Adt<int>{};
+  std::mt19937 gen(11);
+  std::uniform_int_distribution<> distrib(0, 100000);
+  for (int i = 0; i < 20000; ++i) {
+    dt.insert(distrib(gen));
+  }
+  dt.SetDeferredTags(true);
+  for (int i = 0; i < 1000; ++i) {
+    dt.insert(distrib(gen));
+  }
+  auto preorder = dt.GetPreorderVector();
+  auto balance = dt.GetInorderAvlBalanceVector();
+  std::vector<int> counts;
+  for (int a = 0; a < 100000; a += 997) {
+    counts.push_back(dt.CountByRange(a, a + 5000));
+  }
+  dt.Compact(true);
+  EXPECT_EQ(dt.GetPreorderVector(), preorder);
+  EXPECT_EQ(dt.GetInorderAvlBalanceVector(), balance);
+  for (int a = 0, i = 0; a < 100000; a += 997, ++i) {
+    EXPECT_EQ(dt.CountByRange(a, a + 5000), counts[i]);
+  }
+  // nodes in the slab and on the heap mix freely
+  for (int i = 0; i < 1000; ++i) {
+    dt.insert(distrib(gen));
+  }
+  dt.Compact();
+  auto inorder = dt.GetInorderVector();
+  EXPECT_TRUE(std::is_sorted(inorder.begin(), inorder.end()));
+  EXPECT_EQ(inorder.size(), dt.size());
+  EXPECT_EQ(dt.CountByRange(0, 100000), static_cast<int>(dt.size()));
+  dt.Clear();
+  dt.Compact();
+  EXPECT_EQ(dt.size(), 0);
+  EXPECT_EQ(dt.begin(), dt.end());
+}
+
+TEST(AdtInt, Multiset) {
+  auto dt = adt::Adt<int>{};
+  dt.SetMultiset(true);
+  std::multiset<int> expected;
+  for (int i = 0; i < 5000; ++i) {
+    int a = (i * 7919) % 101;
+    auto [it, inserted] = dt.insert(a);
+    EXPECT_TRUE(inserted);
+    EXPECT_EQ(*it, a);
+    expected.insert(a);
+  }
+  EXPECT_EQ(dt.size(), expected.size());
+  EXPECT_EQ(dt.GetPreorderVector().size(), 101); // one node per key
+  EXPECT_EQ(dt.count(5), expected.count(5));
+  EXPECT_EQ(dt.count(1000), 0);
+  EXPECT_TRUE(std::equal(dt.begin(), dt.end(), expected.begin(),
+                         expected.end()));
+  EXPECT_EQ(dt.GetInorderVector(),
+            std::vector<int>(expected.begin(), expected.end()));
+  std::vector<int> reversed;
+  for (auto it = dt.end(); it != dt.begin();) {
+    reversed.push_back(*--it);
+  }
+  EXPECT_TRUE(std::equal(reversed.begin(), reversed.end(), expected.rbegin(),
+                         expected.rend()));
+  for (int a = -1; a <= 101; a += 7) {
+    EXPECT_EQ(dt.rank(a), static_cast<std::size_t>(std::distance(
+                              expected.begin(), expected.lower_bound(a))));
+    EXPECT_EQ(dt.CountByRange(a, a + 20),
+              std::distance(expected.lower_bound(a),
+                            expected.upper_bound(a + 20)));
+    EXPECT_EQ(*dt.upper_bound(a + 1), *expected.upper_bound(a + 1));
+    EXPECT_EQ(*dt.lower_bound(a + 1), *expected.lower_bound(a + 1));
+  }
+  for (std::size_t k = 0; k < expected.size(); k += 37) {
+    auto it = dt.select(k);
+    EXPECT_EQ(*it, *std::next(expected.begin(), k));
+    EXPECT_EQ(*++it, *std::next(expected.begin(), k + 1));
+  }
+  std::vector<std::pair<int, int>> ranges = {{3, 9}, {50, 50}, {90, 200}};
+  for (std::size_t i = 0; i < ranges.size(); ++i) {
+    EXPECT_EQ(dt.count_many(ranges)[i],
+              dt.CountByRange(ranges[i].first, ranges[i].second));
+  }
+  std::vector<int> out;
+  dt.copy_range(10, 12, out);
+  EXPECT_EQ(out.size(), expected.count(10) + expected.count(11) +
+                            expected.count(12));
+  // set mode rejects new copies but keeps stored ones
+  dt.SetMultiset(false);
+  EXPECT_FALSE(dt.insert(5).second);
+  EXPECT_EQ(dt.count(5), expected.count(5));
+}
+
+TEST(AdtInt, Erase) {
+  std::mt19937 gen(31);
+  std::uniform_int_distribution<> key(0, 2000);
+  for (bool deferred : {false, true}) {
+    auto dt = adt::Adt<int>{};
+    dt.SetDeferredTags(deferred);
+    std::set<int> expected;
+    for (int i = 0; i < 20000; ++i) {
+      int a = key(gen);
+      if (i % 3 == 0) {
+        auto it = dt.Erase(a);
+        bool found = expected.erase(a) > 0;
+        auto next = expected.lower_bound(a);
+        EXPECT_EQ(it == dt.end(), !found || next == expected.end());
+        if (found && next != expected.end()) {
+          EXPECT_EQ(*it, *next);
+        }
+      } else {
+        dt.insert(a);
+        expected.insert(a);
+      }
+      if (i % 1000 == 0) {
+        EXPECT_EQ(dt.CountByRange(a, a + 300),
+                  std::distance(expected.lower_bound(a),
+                                expected.upper_bound(a + 300)));
+      }
+    }
+    EXPECT_EQ(dt.size(), expected.size());
+    EXPECT_EQ(dt.GetInorderVector(),
+              std::vector<int>(expected.begin(), expected.end()));
+    for (int b : dt.GetInorderAvlBalanceVector()) {
+      EXPECT_LE(std::abs(b), 1);
+    }
+    for (int a = 0; a <= 2000; a += 97) {
+      EXPECT_EQ(dt.rank(a), static_cast<std::size_t>(std::distance(
+                                expected.begin(), expected.lower_bound(a))));
+    }
+    // erase everything through iterators
+    for (auto it = dt.begin(); it != dt.end();) {
+      dt.Erase(it);
+    }
+    EXPECT_EQ(dt.size(), 0);
+    EXPECT_EQ(dt.begin(), dt.end());
+    EXPECT_EQ(dt.CountByRange(0, 2000), 0);
+    dt.insert(5);
+    EXPECT_EQ(dt.CountByRange(0, 2000), 1);
+  }
+}
+
+TEST(AdtInt, EraseMultiset) {
+  auto dt = adt::Adt<int>{};
+  dt.SetMultiset(true);
+  for (int a : {1, 2, 2, 2, 3}) {
+    dt.insert(a);
+  }
+  auto it = dt.Erase(2);
+  EXPECT_EQ(*it, 2);
+  EXPECT_EQ(dt.count(2), 2);
+  EXPECT_EQ(dt.CountByRange(2, 2), 2);
+  it = std::next(dt.begin(), 2); // second copy of 2
+  dt.Erase(it);
+  EXPECT_EQ(*it, 3);
+  EXPECT_EQ(dt.GetInorderVector(), (std::vector<int>{1, 2, 3}));
+  EXPECT_EQ(dt.Erase(7), dt.end());
+  EXPECT_EQ(dt.erase(7), 0);
+  EXPECT_EQ(dt.erase(1), 1);
+  EXPECT_EQ(dt.size(), 2);
+}
+
+TEST(AdtInt, ShiftFrom) {
+  std::mt19937 gen(48);
+  std::uniform_int_distribution<> op(0, 9);
+  std::uniform_int_distribution<> delta(0, 40);
+  for (bool deferred : {false, true}) {
+    auto dt = adt::Adt<int>{};
+    dt.SetMultiset(true);
+    dt.SetDeferredTags(deferred);
+    std::multiset<int> expected;
+    auto count = [&expected](int a, int b) {
+      return a > b ? 0
+                   : static_cast<int>(std::distance(expected.lower_bound(a),
+                                                    expected.upper_bound(b)));
+    };
+    for (int i = 0; i < 8000; ++i) {
+      int top = expected.empty() ? 1000 : *expected.rbegin() + 10;
+      int a = std::uniform_int_distribution<>(0, top)(gen);
+      int kind = op(gen);
+      if (kind == 0) { // shift a suffix up, away from the keys below it
+        int d = delta(gen);
+        ASSERT_TRUE(dt.ShiftFrom(a, d));
+        std::multiset<int> shifted;
+        for (int v : expected) {
+          shifted.insert(v < a ? v : v + d);
+        }
+        expected.swap(shifted);
+      } else if (kind < 3) {
+        EXPECT_EQ(dt.erase(a), expected.count(a) > 0 ? 1 : 0);
+        if (auto it = expected.find(a); it != expected.end()) {
+          expected.erase(it);
+        }
+      } else {
+        dt.insert(a);
+        expected.insert(a);
+      }
+      if (i % 500 == 0) {
+        int b = a + top / 8;
+        EXPECT_EQ(dt.CountByRange(a, b), count(a, b));
+        EXPECT_EQ(dt.count(a), expected.count(a));
+        EXPECT_EQ(dt.find(a) == dt.end(), expected.count(a) == 0);
+        EXPECT_EQ(dt.rank(a), static_cast<std::size_t>(std::distance(
+                                  expected.begin(), expected.lower_bound(a))));
+        auto lower = dt.lower_bound(a);
+        if (expected.lower_bound(a) != expected.end()) {
+          EXPECT_EQ(*lower, *expected.lower_bound(a));
+        }
+        std::vector<int> out;
+        dt.copy_range(a, b, out);
+        EXPECT_EQ(out, std::vector<int>(expected.lower_bound(a),
+                                        expected.upper_bound(b)));
+      }
+      if (i % 2000 == 0) { // both batched paths
+        std::vector<std::pair<int, int>> ranges;
+        for (int r = 0; r < 40; ++r) {
+          int c = std::uniform_int_distribution<>(0, top)(gen);
+          ranges.emplace_back(c, c + top / 20);
+        }
+        auto many = dt.count_many(ranges);
+        auto sorted = dt.count_many_sorted(ranges);
+        for (std::size_t r = 0; r < ranges.size(); ++r) {
+          EXPECT_EQ(many[r], count(ranges[r].first, ranges[r].second));
+          EXPECT_EQ(sorted[r], many[r]);
+        }
+        EXPECT_TRUE(std::equal(dt.begin(), dt.end(), expected.begin(),
+                               expected.end()));
+      }
+    }
+    std::vector<int> reversed;
+    for (auto it = dt.end(); it != dt.begin();) {
+      reversed.push_back(*--it);
+    }
+    EXPECT_TRUE(std::equal(reversed.begin(), reversed.end(),
+                           expected.rbegin(), expected.rend()));
+    EXPECT_FALSE(dt.ShiftFrom(0, -1));
+    ASSERT_TRUE(dt.ShiftFrom(*expected.begin(), 1000000));
+    dt.Compact();
+    std::vector<int> all;
+    for (int v : expected) {
+      all.push_back(v + 1000000);
+    }
+    EXPECT_EQ(dt.GetInorderVector(), all);
+    EXPECT_EQ(dt.CountByRange(0, 999999), 0);
+    for (int b : dt.GetInorderAvlBalanceVector()) {
+      EXPECT_LE(std::abs(b), 1);
+    }
+  }
+}
+
+TEST(AdtInt, ShiftFromNearMax) {
+  const int kMax = std::numeric_limits<int>::max();
+  auto dt = adt::Adt<int>{};
+  for (int a = 1; a <= 100; ++a) {
+    dt.insert(a);
+  }
+  EXPECT_TRUE(dt.ShiftFrom(101, kMax)); // no key is shifted
+  EXPECT_FALSE(dt.ShiftFrom(50, kMax - 99));
+  EXPECT_EQ(dt.GetInorderVector().back(), 100);
+  ASSERT_TRUE(dt.ShiftFrom(50, kMax - 100));
+  EXPECT_FALSE(dt.ShiftFrom(1, 1));
+  EXPECT_FALSE(dt.ShiftFrom(kMax, 1));
+  EXPECT_TRUE(dt.ShiftFrom(kMax, 0));
+  EXPECT_FALSE(dt.ShiftFrom(20, 1)); // the suffix takes kMax along
+  EXPECT_EQ(dt.CountByRange(50, kMax - 51), 0);
+  EXPECT_EQ(dt.CountByRange(kMax - 50, kMax), 51);
+  EXPECT_EQ(*dt.pre_end(), kMax);
+  // once RefreshTags() applied the shifts, readers share the tree
+  dt.RefreshTags();
+  auto read = [&dt] {
+    std::size_t total = 0;
+    for (int a = 0; a < 100; ++a) {
+      total += dt.CountByRange(a, kMax - a) + dt.count(kMax - a);
+    }
+    return total;
+  };
+  const std::size_t expected = read();
+  std::vector<std::size_t> totals(4);
+  std::vector<std::thread> readers;
+  for (auto &total : totals) {
+    readers.emplace_back([&read, &total] { total = read(); });
+  }
+  for (auto &reader : readers) {
+    reader.join();
+  }
+  EXPECT_EQ(totals, std::vector<std::size_t>(4, expected));
+}
+
+TEST(AdtInt, Snapshot) {
+  std::mt19937 gen(41);
+  std::uniform_int_distribution<> key(0, 100000);
+  for (bool multiset : {false, true}) {
+    auto dt = adt::Adt<int>{};
+    dt.SetMultiset(multiset);
+    for (int i = 0; i < 20000; ++i) {
+      dt.insert(key(gen) % (multiset ? 1000 : 100000));
+    }
+    std::stringstream stream;
+    EXPECT_TRUE(dt.SaveSnapshot(stream));
+    auto loaded = adt::Adt<int>{};
+    loaded.insert(7); // replaced by snapshot
+    EXPECT_TRUE(loaded.LoadSnapshot(stream));
+    EXPECT_EQ(loaded.size(), dt.size());
+    EXPECT_EQ(loaded.Multiset(), multiset);
+    EXPECT_EQ(loaded.GetPreorderVector(), dt.GetPreorderVector());
+    EXPECT_EQ(loaded.GetInorderVector(), dt.GetInorderVector());
+    EXPECT_EQ(loaded.GetInorderAvlBalanceVector(),
+              dt.GetInorderAvlBalanceVector());
+    for (int a = 0; a < 100000; a += 977) {
+      EXPECT_EQ(loaded.CountByRange(a, a + 5000), dt.CountByRange(a, a + 5000));
+      EXPECT_EQ(loaded.rank(a), dt.rank(a));
+    }
+    // loaded tree stays a normal tree
+    loaded.insert(-1);
+    loaded.erase(*std::next(loaded.begin(), 100));
+    EXPECT_EQ(loaded.size(), dt.size());
+  }
+}
+
+TEST(AdtInt, SnapshotOfSortedKeys) {
+  for (int n = 0; n < 300; n += 1 + n / 10) {
+    std::vector<int> sorted;
+    for (int i = 0; i < n; ++i) {
+      sorted.push_back(i / 3 * 10); // three copies of every key
+    }
+    std::stringstream stream;
+    ASSERT_TRUE(adt::Adt<int>::SaveSnapshot(stream, sorted, true));
+    auto loaded = adt::Adt<int>{};
+    ASSERT_TRUE(loaded.LoadSnapshot(stream)) << n; // checks the AVL shape
+    EXPECT_TRUE(loaded.Multiset());
+    EXPECT_EQ(loaded.GetInorderVector(), sorted);
+    EXPECT_EQ(loaded.CountByRange(10, 25), std::min(n, 9) - std::min(n, 3));
+    loaded.insert(-5);
+    loaded.erase(0);
+    EXPECT_EQ(loaded.size(), static_cast<std::size_t>(n) + (n > 0 ? 0 : 1));
+  }
+}
+
+// snapshot of int keys from preorder records {flags, key}, flags: 1 - has
+// left child, 2 - has right child, bits 2-3 - balance factor + 1
+std::string MakeSnapshot(
+    const std::vector<std::pair<unsigned char, int>> &records) {
+  std::string bytes("ADTS");
+  auto put = [&bytes](const auto &v) {
+    bytes.append(reinterpret_cast<const char *>(&v), sizeof(v));
+  };
+  put(std::uint32_t{1});
+  put(std::uint32_t{sizeof(int)});
+  put(std::uint32_t{0});
+  put(std::uint64_t{records.size()});
+  put(std::uint64_t{records.size()});
+  for (auto [flags, key] : records) {
+    bytes += static_cast<char>(flags);
+    put(key);
+  }
+  put(adt::Fnv1a(bytes.data(), bytes.size()));
+  return bytes;
+}
+
+TEST(AdtInt, SnapshotShape) {
+  const unsigned char kLeft = 1;
+  const unsigned char kRight = 2;
+  auto balance = [](int b) { return static_cast<unsigned char>((b + 1) << 2); };
+  auto loaded = adt::Adt<int>{};
+  std::string good = MakeSnapshot(
+      {{kLeft | kRight | balance(0), 2}, {balance(0), 1}, {balance(0), 3}});
+  ASSERT_TRUE(loaded.LoadSnapshot(std::span<const char>(good)));
+  EXPECT_EQ(loaded.GetInorderVector(), (std::vector<int>{1, 2, 3}));
+  // same shape, balance factor of the root does not match
+  std::string tilted = MakeSnapshot(
+      {{kLeft | kRight | balance(1), 2}, {balance(0), 1}, {balance(0), 3}});
+  EXPECT_FALSE(loaded.LoadSnapshot(std::span<const char>(tilted)));
+  // left chain deeper than the path stack of a descent, valid checksum
+  std::vector<std::pair<unsigned char, int>> chain;
+  for (int key = 200; key > 1; --key) {
+    chain.emplace_back(kLeft | balance(-1), key);
+  }
+  chain.emplace_back(balance(0), 1);
+  std::string deep = MakeSnapshot(chain);
+  EXPECT_FALSE(loaded.LoadSnapshot(std::span<const char>(deep)));
+  EXPECT_EQ(loaded.GetInorderVector(), (std::vector<int>{1, 2, 3}));
+  EXPECT_NE(loaded.find(1), loaded.end());
+}
+
+TEST(AdtInt, MultisetCopyLimit) {
+  auto dt = adt::Adt<int>{};
+  dt.SetMultiset(true);
+  dt.insert(5);
+  dt.insert(5);
+  std::stringstream stream;
+  dt.SaveSnapshot(stream);
+  // raise the stored count of 5 and the item total to the limit, the count
+  // is the last field before the checksum, the total ends the header
+  std::string bytes = stream.str();
+  const std::uint32_t limit = UINT32_MAX;
+  const std::uint64_t items = limit;
+  const std::size_t body = bytes.size() - sizeof(std::uint64_t);
+  std::memcpy(bytes.data() + body - sizeof(limit), &limit, sizeof(limit));
+  std::memcpy(bytes.data() + 24, &items, sizeof(items));
+  const std::uint64_t hash = adt::Fnv1a(bytes.data(), body);
+  std::memcpy(bytes.data() + body, &hash, sizeof(hash));
+  ASSERT_TRUE(dt.LoadSnapshot(std::span<const char>(bytes)));
+  EXPECT_EQ(dt.count(5), limit);
+  EXPECT_FALSE(dt.insert(5).second);
+  EXPECT_EQ(dt.count(5), limit);
+  EXPECT_EQ(dt.erase(5), 1);
+  EXPECT_TRUE(dt.insert(5).second);
+  EXPECT_EQ(dt.size(), items);
+}
+
+TEST(AdtInt, SnapshotErrors) {
+  auto dt = adt::Adt<int>{};
+  for (int a : {5, 3, 8, 1}) {
+    dt.insert(a);
+  }
+  std::stringstream stream;
+  dt.SaveSnapshot(stream);
+  std::string bytes = stream.str();
+
+  auto empty = adt::Adt<int>{};
+  std::stringstream empty_stream;
+  empty.SaveSnapshot(empty_stream);
+  auto loaded = adt::Adt<int>{};
+  loaded.insert(42);
+  EXPECT_TRUE(loaded.LoadSnapshot(empty_stream));
+  EXPECT_EQ(loaded.size(), 0);
+  EXPECT_EQ(loaded.begin(), loaded.end());
+
+  loaded.insert(42);
+  std::string corrupted = bytes;
+  corrupted[corrupted.size() / 2] ^= 1;
+  EXPECT_FALSE(loaded.LoadSnapshot(std::span<const char>(corrupted)));
+  EXPECT_FALSE(loaded.LoadSnapshot(
+      std::span<const char>(bytes).first(bytes.size() - 1)));
+  EXPECT_EQ(loaded.GetInorderVector(), (std::vector<int>{42})); // unchanged
+  auto wide = adt::Adt<long long>{};
+  EXPECT_FALSE(wide.LoadSnapshot(std::span<const char>(bytes)));
+  EXPECT_TRUE(loaded.LoadSnapshot(std::span<const char>(bytes)));
+  EXPECT_EQ(loaded.GetInorderVector(), (std::vector<int>{1, 3, 5, 8}));
+}
+
 } // namespace
 } // namespace project
 } // namespace my
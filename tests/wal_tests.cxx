@@ -0,0 +1,202 @@
+#include "wal.h"
+
+#if defined(__unix__)
+#include <csignal>
+#include <filesystem>
+#include <fstream>
+#include <gtest/gtest.h>
+#include <random>
+#include <set>
+#include <string>
+#include <vector>
+
+#include <sys/resource.h>
+
+namespace my {
+namespace project {
+namespace {
+
+std::filesystem::path TempDir(const std::string &name) {
+  auto dir = std::filesystem::temp_directory_path() /
+             (name + std::to_string(getpid()));
+  std::filesystem::remove_all(dir);
+  return dir;
+}
+
+std::size_t FilesWithPrefix(const std::filesystem::path &dir,
+                            const std::string &prefix) {
+  std::size_t result = 0;
+  for (const auto &entry : std::filesystem::directory_iterator(dir)) {
+    result += entry.path().filename().string().starts_with(prefix + ".0");
+  }
+  return result;
+}
+
+TEST(WriteAheadLogInt, GroupCommitAndTornTail) {
+  auto dir = TempDir("wal_log");
+  std::filesystem::create_directories(dir);
+  auto path = (dir / "wal.1").string();
+  adt::WriteAheadLog<int> wal;
+  ASSERT_TRUE(wal.Open(path, 4));
+  for (int a = 0; a < 10; ++a) {
+    EXPECT_TRUE(wal.Append(a));
+  }
+  EXPECT_EQ(wal.Syncs(), 2);
+  EXPECT_TRUE(wal.Close()); // third batch of 2 keys
+  std::vector<int> keys;
+  EXPECT_EQ(adt::WriteAheadLog<int>::Replay(
+                path, [&keys](int a) { keys.push_back(a); }),
+            10);
+  EXPECT_EQ(keys, (std::vector<int>{0, 1, 2, 3, 4, 5, 6, 7, 8, 9}));
+  // crash in the middle of the last batch
+  std::filesystem::resize_file(path, std::filesystem::file_size(path) - 3);
+  EXPECT_EQ(adt::WriteAheadLog<int>::Replay(path, [](int) {}), 8);
+  std::filesystem::remove_all(dir);
+}
+
+TEST(WriteAheadLogInt, WriteErrors) {
+  auto dir = TempDir("wal_errors");
+  std::filesystem::create_directories(dir);
+  auto path = (dir / "wal.1").string();
+  adt::WriteAheadLog<int> wal;
+  ASSERT_TRUE(wal.Open(path, 4));
+  for (int a = 0; a < 4; ++a) {
+    EXPECT_TRUE(wal.Append(a));
+  }
+  // the file size limit lets the second batch in only partly
+  rlimit old_limit;
+  getrlimit(RLIMIT_FSIZE, &old_limit);
+  rlimit limit = old_limit;
+  limit.rlim_cur = std::filesystem::file_size(path) + 8;
+  auto old_handler = std::signal(SIGXFSZ, SIG_IGN);
+  setrlimit(RLIMIT_FSIZE, &limit);
+  for (int a = 4; a < 7; ++a) {
+    EXPECT_TRUE(wal.Append(a));
+  }
+  EXPECT_FALSE(wal.Append(7));
+  setrlimit(RLIMIT_FSIZE, &old_limit);
+  std::signal(SIGXFSZ, old_handler);
+  EXPECT_FALSE(wal.Failed()); // cut back, keys are still pending
+  EXPECT_TRUE(wal.Append(8));
+  EXPECT_TRUE(wal.Close());
+  std::vector<int> keys;
+  adt::WriteAheadLog<int>::Replay(path, [&keys](int a) { keys.push_back(a); });
+  EXPECT_EQ(keys, (std::vector<int>{0, 1, 2, 3, 4, 5, 6, 7, 8}));
+  std::filesystem::remove_all(dir);
+
+  // a device that can not be cut back fails the log for good
+  if (std::filesystem::exists("/dev/full")) {
+    ASSERT_TRUE(wal.Open("/dev/full", 2));
+    EXPECT_TRUE(wal.Append(1));
+    EXPECT_FALSE(wal.Append(2));
+    EXPECT_TRUE(wal.Failed());
+    EXPECT_FALSE(wal.Append(3));
+    EXPECT_FALSE(wal.Commit());
+    EXPECT_FALSE(wal.Close());
+  }
+}
+
+TEST(DurableAdtInt, RecoverFromLog) {
+  auto dir = TempDir("wal_recover");
+  std::set<int> expected;
+  {
+    adt::DurableAdt<int> tree;
+    ASSERT_TRUE(tree.Open(dir.string(), {16, 0}));
+    for (int a = 0; a < 1000; ++a) {
+      EXPECT_TRUE(tree.insert(a * 7 % 1000));
+      EXPECT_TRUE(tree.insert(a * 7 % 1000)); // duplicate is not logged
+      expected.insert(a * 7 % 1000);
+    }
+  }
+  adt::DurableAdt<int> tree;
+  ASSERT_TRUE(tree.Open(dir.string(), {16, 0}));
+  EXPECT_EQ(tree.ReplayedKeys(), 1000);
+  EXPECT_EQ(tree.Tree().GetInorderVector(),
+            std::vector<int>(expected.begin(), expected.end()));
+  EXPECT_EQ(tree.CountByRange(100, 199), 100);
+  tree.Close();
+  std::filesystem::remove_all(dir);
+}
+
+TEST(DurableAdtInt, CheckpointAndLogTail) {
+  auto dir = TempDir("wal_checkpoint");
+  std::mt19937 gen(47);
+  std::uniform_int_distribution<> key(0, 1000000);
+  std::set<int> expected;
+  {
+    adt::DurableAdt<int> tree;
+    ASSERT_TRUE(tree.Open(dir.string(), {64, 1000}));
+    while (expected.size() < 5500) {
+      int a = key(gen);
+      tree.insert(a);
+      expected.insert(a);
+    }
+    EXPECT_TRUE(tree.WaitCheckpoint());
+  }
+  // old checkpoints and covered logs are removed
+  EXPECT_EQ(FilesWithPrefix(dir, "checkpoint"), 1);
+  EXPECT_EQ(FilesWithPrefix(dir, "wal"), 1);
+  adt::DurableAdt<int> tree;
+  ASSERT_TRUE(tree.Open(dir.string(), {64, 1000}));
+  EXPECT_EQ(tree.ReplayedKeys(), 500);
+  EXPECT_EQ(tree.Tree().GetInorderVector(),
+            std::vector<int>(expected.begin(), expected.end()));
+  EXPECT_TRUE(tree.insert(-1));
+  EXPECT_TRUE(tree.Checkpoint());
+  EXPECT_TRUE(tree.Close());
+  adt::DurableAdt<int> reopened;
+  ASSERT_TRUE(reopened.Open(dir.string(), {64, 1000}));
+  EXPECT_EQ(reopened.ReplayedKeys(), 0);
+  EXPECT_EQ(reopened.size(), expected.size() + 1);
+  reopened.Close();
+  std::filesystem::remove_all(dir);
+}
+
+TEST(DurableAdtInt, FailedCheckpointIsRetried) {
+  auto dir = TempDir("wal_failed_checkpoint");
+  adt::DurableAdt<int> tree;
+  ASSERT_TRUE(tree.Open(dir.string(), {16, 100}));
+  // a directory in the way of the temporary checkpoint file
+  std::filesystem::create_directory(dir / "checkpoint.tmp");
+  int a = 0;
+  for (; a < 199; ++a) {
+    EXPECT_TRUE(tree.insert(a));
+  }
+  EXPECT_FALSE(tree.insert(a++)); // reports the failed background write
+  std::filesystem::remove(dir / "checkpoint.tmp");
+  for (; a < 300; ++a) {
+    EXPECT_TRUE(tree.insert(a)); // the 100th one starts a new checkpoint
+  }
+  EXPECT_TRUE(tree.WaitCheckpoint());
+  EXPECT_TRUE(tree.Close());
+  EXPECT_EQ(FilesWithPrefix(dir, "checkpoint"), 1);
+  adt::DurableAdt<int> reopened;
+  ASSERT_TRUE(reopened.Open(dir.string(), {16, 100}));
+  EXPECT_EQ(reopened.size(), 300);
+  EXPECT_EQ(reopened.ReplayedKeys(), 0);
+  reopened.Close();
+  std::filesystem::remove_all(dir);
+}
+
+TEST(DurableAdtInt, IgnoresStrayFiles) {
+  auto dir = TempDir("wal_stray");
+  std::filesystem::create_directories(dir);
+  for (const char *name : {"wal.999999999999999999999", "wal.-1", "wal.",
+                           "checkpoint.12a", "checkpoint.tmp"}) {
+    std::ofstream(dir / name) << "x";
+  }
+  adt::DurableAdt<int> tree;
+  ASSERT_TRUE(tree.Open(dir.string(), {16, 0}));
+  EXPECT_EQ(tree.size(), 0);
+  EXPECT_TRUE(tree.insert(5));
+  EXPECT_TRUE(tree.Close());
+  ASSERT_TRUE(tree.Open(dir.string(), {16, 0}));
+  EXPECT_EQ(tree.ReplayedKeys(), 1);
+  tree.Close();
+  std::filesystem::remove_all(dir);
+}
+
+} // namespace
+} // namespace project
+} // namespace my
+#endif
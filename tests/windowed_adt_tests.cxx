@@ -0,0 +1,72 @@
+#include "windowed_adt.h"
+
+#include <algorithm>
+#include <chrono>
+#include <deque>
+#include <gtest/gtest.h>
+#include <random>
+
+namespace my {
+namespace project {
+namespace {
+
+using Window = adt::WindowedAdt<int>;
+
+int CountByRange(const std::deque<int> &keys, int first, int second) {
+  return static_cast<int>(std::count_if(
+      keys.begin(), keys.end(),
+      [first, second](int a) { return first <= a && a <= second; }));
+}
+
+TEST(WindowedAdtInt, LastKeys) {
+  auto window = Window(3);
+  for (int a : {5, 1, 5, 7}) {
+    window.insert(a);
+  }
+  EXPECT_EQ(window.size(), 3);
+  EXPECT_EQ(window.CountByRange(0, 10), 3);
+  EXPECT_EQ(window.CountByRange(5, 5), 1); // first 5 left the window
+  EXPECT_EQ(window.Tree().GetInorderVector(), (std::vector<int>{1, 5, 7}));
+}
+
+TEST(WindowedAdtInt, MatchesDeque) {
+  std::mt19937 gen(37);
+  std::uniform_int_distribution<> key(0, 1000);
+  const std::size_t kWindow = 700;
+  auto window = Window(kWindow);
+  std::deque<int> expected;
+  for (int i = 0; i < 20000; ++i) {
+    int a = key(gen);
+    window.insert(a);
+    expected.push_back(a);
+    if (expected.size() > kWindow) {
+      expected.pop_front();
+    }
+    if (i % 50 == 0) {
+      int first = key(gen);
+      ASSERT_EQ(window.CountByRange(first, first + 100),
+                CountByRange(expected, first, first + 100));
+    }
+  }
+  EXPECT_EQ(window.size(), kWindow);
+}
+
+TEST(WindowedAdtInt, Ttl) {
+  using namespace std::chrono_literals;
+  auto window = Window(0, 10s);
+  auto start = Window::Clock::time_point{};
+  for (int i = 0; i < 100; ++i) {
+    window.insert(i, start + std::chrono::seconds(i)); // one key per second
+  }
+  EXPECT_EQ(window.size(), 10); // keys 90 ... 99
+  EXPECT_EQ(window.CountByRange(0, 89), 0);
+  window.Expire(start + 105s);
+  EXPECT_EQ(window.size(), 4);
+  EXPECT_EQ(window.CountByRange(96, 99), 4);
+  window.Expire(start + 200s);
+  EXPECT_EQ(window.size(), 0);
+}
+
+} // namespace
+} // namespace project
+} // namespace my